@@ -0,0 +1,644 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include <gst/gst.h>
+
+#include "audio-player.h"
+#include "marshal.h"
+
+/**
+ * AudioPlayer plays URIs through playbin2. In gapless mode, the URI set
+ * with audio_player_set_next_uri() is handed to playbin2 when it asks
+ * for one through 'about-to-finish', which happens while the current
+ * stream is still playing. playbin2 then prepares the next stream and
+ * switches over without leaving the PLAYING state.
+ *
+ * Probes on the audio sink watch the running time of the buffers going
+ * out, so that 'track-changed' can report the gap between the end of
+ * one track and the start of the next. When tracks are switched by
+ * restarting the pipeline after EOS, the gap is measured on the clock
+ * on the wall instead.
+ **/
+
+G_DEFINE_TYPE (AudioPlayer,
+               audio_player,
+               G_TYPE_OBJECT);
+
+enum {
+        SIGNAL_EOS,
+        SIGNAL_TRACK_CHANGED,
+        SIGNAL_LAST
+};
+
+static guint signals[SIGNAL_LAST];
+
+struct _AudioPlayerPrivate {
+        GstElement  *playbin;
+        guint        bus_watch_id;
+
+        char        *uri;
+        gboolean     playing;
+        gboolean     gapless;
+
+        /**
+         * Shared with the streaming threads, protected by @lock.
+         **/
+        GMutex      *lock;
+
+        char        *next_uri;       /* For 'about-to-finish' */
+        char        *switching_uri;  /* Handed to playbin2, not audible */
+        gboolean     new_segment;    /* @switching_uri's segment arrived */
+
+        GstSegment   segment;        /* Current segment at the sink */
+        GstClockTime last_end;       /* Running time the audio ends at */
+
+        gboolean     in_eos;
+        gboolean     measure_restart;
+        GTimeVal     eos_time;
+
+        /**
+         * Bumped by audio_player_set_uri(), so that track changes
+         * queued before are dropped.
+         **/
+        guint        generation;
+};
+
+#define GET_PRIVATE(o) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
+                                      TYPE_AUDIO_PLAYER, \
+                                      AudioPlayerPrivate))
+
+typedef struct {
+        AudioPlayer *player;
+        char        *uri;
+        double       gap;
+        guint        generation;
+} TrackChange;
+
+/**
+ * Emits 'track-changed' for @change from the main loop, unless a URI
+ * was set since it was queued.
+ **/
+static gboolean
+emit_track_changed (TrackChange *change)
+{
+        AudioPlayer *player = change->player;
+        gboolean stale;
+
+        g_mutex_lock (player->priv->lock);
+        stale = change->generation != player->priv->generation;
+        g_mutex_unlock (player->priv->lock);
+
+        if (stale) {
+                g_free (change->uri);
+        } else {
+                if (change->uri) {
+                        g_free (player->priv->uri);
+                        player->priv->uri = change->uri;
+                }
+
+                g_signal_emit (player,
+                               signals[SIGNAL_TRACK_CHANGED],
+                               0,
+                               player->priv->uri,
+                               change->gap);
+        }
+
+        g_object_unref (player);
+
+        g_slice_free (TrackChange, change);
+
+        return FALSE;
+}
+
+/**
+ * Schedules 'track-changed' with a gap of @gap milliseconds. @uri is
+ * taken over, and is NULL if the URI did not change. Called with the
+ * lock held.
+ **/
+static void
+queue_track_changed (AudioPlayer *player,
+                     char        *uri,
+                     double       gap)
+{
+        TrackChange *change;
+
+        change = g_slice_new (TrackChange);
+
+        change->player     = g_object_ref (player);
+        change->uri        = uri;
+        change->gap        = gap;
+        change->generation = player->priv->generation;
+
+        g_idle_add ((GSourceFunc) emit_track_changed, change);
+}
+
+/**
+ * playbin2 is about to run out of data. Runs in a streaming thread.
+ **/
+static void
+about_to_finish_cb (GstElement  *playbin,
+                    AudioPlayer *player)
+{
+        AudioPlayerPrivate *priv = player->priv;
+
+        g_mutex_lock (priv->lock);
+
+        if (priv->gapless && priv->next_uri) {
+                g_object_set (playbin, "uri", priv->next_uri, NULL);
+
+                g_free (priv->switching_uri);
+                priv->switching_uri = priv->next_uri;
+                priv->next_uri = NULL;
+
+                priv->new_segment = FALSE;
+        }
+
+        g_mutex_unlock (priv->lock);
+}
+
+/**
+ * Tracks the segment on the audio sink. Runs in a streaming thread.
+ **/
+static gboolean
+sink_event_probe (GstPad      *pad,
+                  GstEvent    *event,
+                  AudioPlayer *player)
+{
+        AudioPlayerPrivate *priv = player->priv;
+
+        g_mutex_lock (priv->lock);
+
+        switch (GST_EVENT_TYPE (event)) {
+        case GST_EVENT_NEWSEGMENT:
+        {
+                gboolean update;
+                double rate, applied_rate;
+                GstFormat format;
+                gint64 start, stop, position;
+
+                gst_event_parse_new_segment_full (event,
+                                                  &update,
+                                                  &rate,
+                                                  &applied_rate,
+                                                  &format,
+                                                  &start,
+                                                  &stop,
+                                                  &position);
+
+                if (format == GST_FORMAT_TIME) {
+                        gst_segment_set_newsegment_full (&priv->segment,
+                                                         update,
+                                                         rate,
+                                                         applied_rate,
+                                                         format,
+                                                         start,
+                                                         stop,
+                                                         position);
+                }
+
+                if (!update && priv->switching_uri)
+                        priv->new_segment = TRUE;
+
+                break;
+        }
+        case GST_EVENT_FLUSH_STOP:
+                gst_segment_init (&priv->segment, GST_FORMAT_TIME);
+                priv->last_end = GST_CLOCK_TIME_NONE;
+                break;
+        default:
+                break;
+        }
+
+        g_mutex_unlock (priv->lock);
+
+        return TRUE;
+}
+
+/**
+ * Measures gaps from the buffers reaching the audio sink. Runs in a
+ * streaming thread.
+ **/
+static gboolean
+sink_buffer_probe (GstPad      *pad,
+                   GstBuffer   *buffer,
+                   AudioPlayer *player)
+{
+        AudioPlayerPrivate *priv = player->priv;
+        GstClockTime timestamp, running_time;
+
+        timestamp = GST_BUFFER_TIMESTAMP (buffer);
+        if (!GST_CLOCK_TIME_IS_VALID (timestamp))
+                return TRUE;
+
+        g_mutex_lock (priv->lock);
+
+        running_time = gst_segment_to_running_time (&priv->segment,
+                                                    GST_FORMAT_TIME,
+                                                    timestamp);
+
+        if (priv->new_segment) {
+                double gap = 0.0;
+
+                /**
+                 * First buffer of the next track: compare with where
+                 * the previous one ended.
+                 **/
+                if (GST_CLOCK_TIME_IS_VALID (priv->last_end) &&
+                    GST_CLOCK_TIME_IS_VALID (running_time)) {
+                        gap = ((double) running_time -
+                               (double) priv->last_end) / GST_MSECOND;
+                }
+
+                queue_track_changed (player, priv->switching_uri, gap);
+
+                priv->switching_uri = NULL;
+                priv->new_segment = FALSE;
+        } else if (priv->measure_restart) {
+                GTimeVal now;
+
+                g_get_current_time (&now);
+
+                queue_track_changed (player,
+                                     NULL,
+                                     (now.tv_sec - priv->eos_time.tv_sec) *
+                                     1000.0 +
+                                     (now.tv_usec - priv->eos_time.tv_usec) /
+                                     1000.0);
+
+                priv->measure_restart = FALSE;
+        }
+
+        if (GST_CLOCK_TIME_IS_VALID (running_time)) {
+                priv->last_end = running_time;
+
+                if (GST_BUFFER_DURATION_IS_VALID (buffer))
+                        priv->last_end += GST_BUFFER_DURATION (buffer);
+        }
+
+        g_mutex_unlock (priv->lock);
+
+        return TRUE;
+}
+
+/**
+ * Handles messages from playbin2 in the main loop.
+ **/
+static gboolean
+bus_watch_cb (GstBus      *bus,
+              GstMessage  *message,
+              AudioPlayer *player)
+{
+        AudioPlayerPrivate *priv = player->priv;
+
+        switch (GST_MESSAGE_TYPE (message)) {
+        case GST_MESSAGE_EOS:
+                /**
+                 * If a new URI is set from the 'eos' handler, measure how
+                 * long it takes to be heard.
+                 **/
+                g_mutex_lock (priv->lock);
+                g_get_current_time (&priv->eos_time);
+                priv->in_eos = TRUE;
+                g_mutex_unlock (priv->lock);
+
+                g_signal_emit (player, signals[SIGNAL_EOS], 0);
+
+                g_mutex_lock (priv->lock);
+                priv->in_eos = FALSE;
+                g_mutex_unlock (priv->lock);
+
+                break;
+        case GST_MESSAGE_ERROR:
+        {
+                GError *error;
+
+                gst_message_parse_error (message, &error, NULL);
+                g_warning ("%s", error->message);
+                g_error_free (error);
+
+                gst_element_set_state (priv->playbin, GST_STATE_NULL);
+                priv->playing = FALSE;
+
+                break;
+        }
+        default:
+                break;
+        }
+
+        return TRUE;
+}
+
+static void
+audio_player_init (AudioPlayer *player)
+{
+        AudioPlayerPrivate *priv;
+        GstElement *audio_sink;
+        GstBus *bus;
+        GstPad *pad;
+
+        priv = player->priv = GET_PRIVATE (player);
+
+        priv->lock = g_mutex_new ();
+        priv->gapless = TRUE;
+
+        gst_segment_init (&priv->segment, GST_FORMAT_TIME);
+        priv->last_end = GST_CLOCK_TIME_NONE;
+
+        priv->playbin = gst_element_factory_make ("playbin2", NULL);
+        gst_object_ref (priv->playbin);
+        gst_object_sink (GST_OBJECT (priv->playbin));
+
+        audio_sink = gst_element_factory_make ("autoaudiosink", NULL);
+        g_object_set (priv->playbin, "audio-sink", audio_sink, NULL);
+
+        pad = gst_element_get_static_pad (audio_sink, "sink");
+        gst_pad_add_event_probe (pad,
+                                 G_CALLBACK (sink_event_probe),
+                                 player);
+        gst_pad_add_buffer_probe (pad,
+                                  G_CALLBACK (sink_buffer_probe),
+                                  player);
+        gst_object_unref (pad);
+
+        g_signal_connect (priv->playbin,
+                          "about-to-finish",
+                          G_CALLBACK (about_to_finish_cb),
+                          player);
+
+        bus = gst_element_get_bus (priv->playbin);
+        priv->bus_watch_id = gst_bus_add_watch (bus,
+                                                (GstBusFunc) bus_watch_cb,
+                                                player);
+        gst_object_unref (bus);
+}
+
+static void
+audio_player_dispose (GObject *object)
+{
+        AudioPlayer *player;
+        GObjectClass *object_class;
+
+        player = AUDIO_PLAYER (object);
+
+        if (player->priv->playbin) {
+                g_source_remove (player->priv->bus_watch_id);
+
+                gst_element_set_state (player->priv->playbin,
+                                       GST_STATE_NULL);
+                gst_object_unref (player->priv->playbin);
+                player->priv->playbin = NULL;
+        }
+
+        object_class = G_OBJECT_CLASS (audio_player_parent_class);
+        object_class->dispose (object);
+}
+
+static void
+audio_player_finalize (GObject *object)
+{
+        AudioPlayer *player;
+        GObjectClass *object_class;
+
+        player = AUDIO_PLAYER (object);
+
+        g_free (player->priv->uri);
+        g_free (player->priv->next_uri);
+        g_free (player->priv->switching_uri);
+
+        g_mutex_free (player->priv->lock);
+
+        object_class = G_OBJECT_CLASS (audio_player_parent_class);
+        object_class->finalize (object);
+}
+
+static void
+audio_player_class_init (AudioPlayerClass *klass)
+{
+        GObjectClass *object_class;
+
+        object_class = G_OBJECT_CLASS (klass);
+
+        object_class->dispose  = audio_player_dispose;
+        object_class->finalize = audio_player_finalize;
+
+        g_type_class_add_private (klass, sizeof (AudioPlayerPrivate));
+
+        signals[SIGNAL_EOS] =
+                g_signal_new ("eos",
+                              TYPE_AUDIO_PLAYER,
+                              G_SIGNAL_RUN_LAST,
+                              G_STRUCT_OFFSET (AudioPlayerClass, eos),
+                              NULL,
+                              NULL,
+                              g_cclosure_marshal_VOID__VOID,
+                              G_TYPE_NONE,
+                              0);
+
+        signals[SIGNAL_TRACK_CHANGED] =
+                g_signal_new ("track-changed",
+                              TYPE_AUDIO_PLAYER,
+                              G_SIGNAL_RUN_LAST,
+                              G_STRUCT_OFFSET (AudioPlayerClass,
+                                               track_changed),
+                              NULL,
+                              NULL,
+                              gaku_marshal_VOID__STRING_DOUBLE,
+                              G_TYPE_NONE,
+                              2,
+                              G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                              G_TYPE_DOUBLE);
+}
+
+/**
+ * audio_player_new
+ *
+ * Return value: A new #AudioPlayer.
+ **/
+AudioPlayer *
+audio_player_new (void)
+{
+        return g_object_new (TYPE_AUDIO_PLAYER, NULL);
+}
+
+/**
+ * audio_player_set_uri
+ * @player: A #AudioPlayer
+ * @uri: An URI, or NULL
+ *
+ * Switches to @uri right away, restarting the pipeline. 'track-changed'
+ * is emitted once it is heard, if this happens from the 'eos' handler.
+ **/
+void
+audio_player_set_uri (AudioPlayer *player,
+                      const char  *uri)
+{
+        AudioPlayerPrivate *priv;
+
+        g_return_if_fail (IS_AUDIO_PLAYER (player));
+
+        priv = player->priv;
+
+        g_free (priv->uri);
+        priv->uri = g_strdup (uri);
+
+        gst_element_set_state (priv->playbin, GST_STATE_READY);
+
+        g_mutex_lock (priv->lock);
+
+        priv->generation++;
+
+        g_free (priv->switching_uri);
+        priv->switching_uri = NULL;
+        priv->new_segment = FALSE;
+
+        gst_segment_init (&priv->segment, GST_FORMAT_TIME);
+        priv->last_end = GST_CLOCK_TIME_NONE;
+
+        priv->measure_restart = priv->in_eos && uri;
+
+        g_mutex_unlock (priv->lock);
+
+        if (!uri) {
+                gst_element_set_state (priv->playbin, GST_STATE_NULL);
+
+                return;
+        }
+
+        g_object_set (priv->playbin, "uri", uri, NULL);
+
+        gst_element_set_state (priv->playbin,
+                               priv->playing ? GST_STATE_PLAYING :
+                                               GST_STATE_PAUSED);
+}
+
+/**
+ * audio_player_get_uri
+ * @player: A #AudioPlayer
+ *
+ * Return value: The URI being played.
+ **/
+const char *
+audio_player_get_uri (AudioPlayer *player)
+{
+        g_return_val_if_fail (IS_AUDIO_PLAYER (player), NULL);
+
+        return player->priv->uri;
+}
+
+/**
+ * audio_player_set_next_uri
+ * @player: A #AudioPlayer
+ * @uri: An URI, or NULL
+ *
+ * Sets the URI to continue with when the current one ends. In gapless
+ * mode it is prepared before the current stream ends, and played right
+ * after without a gap.
+ **/
+void
+audio_player_set_next_uri (AudioPlayer *player,
+                           const char  *uri)
+{
+        AudioPlayerPrivate *priv;
+
+        g_return_if_fail (IS_AUDIO_PLAYER (player));
+
+        priv = player->priv;
+
+        g_mutex_lock (priv->lock);
+
+        if (g_strcmp0 (priv->next_uri, uri)) {
+                g_free (priv->next_uri);
+                priv->next_uri = g_strdup (uri);
+        }
+
+        g_mutex_unlock (priv->lock);
+}
+
+/**
+ * audio_player_set_playing
+ * @player: A #AudioPlayer
+ * @playing: TRUE to play, FALSE to pause
+ **/
+void
+audio_player_set_playing (AudioPlayer *player,
+                          gboolean     playing)
+{
+        AudioPlayerPrivate *priv;
+
+        g_return_if_fail (IS_AUDIO_PLAYER (player));
+
+        priv = player->priv;
+
+        priv->playing = playing;
+
+        if (!priv->uri)
+                return;
+
+        gst_element_set_state (priv->playbin,
+                               playing ? GST_STATE_PLAYING :
+                                         GST_STATE_PAUSED);
+}
+
+/**
+ * audio_player_get_playing
+ * @player: A #AudioPlayer
+ *
+ * Return value: TRUE if @player is playing.
+ **/
+gboolean
+audio_player_get_playing (AudioPlayer *player)
+{
+        g_return_val_if_fail (IS_AUDIO_PLAYER (player), FALSE);
+
+        return player->priv->playing;
+}
+
+/**
+ * audio_player_set_gapless
+ * @player: A #AudioPlayer
+ * @gapless: TRUE to prepare the next URI before the current one ends
+ *
+ * Gapless mode is on by default.
+ **/
+void
+audio_player_set_gapless (AudioPlayer *player,
+                          gboolean     gapless)
+{
+        g_return_if_fail (IS_AUDIO_PLAYER (player));
+
+        g_mutex_lock (player->priv->lock);
+        player->priv->gapless = gapless;
+        g_mutex_unlock (player->priv->lock);
+}
+
+/**
+ * audio_player_get_gapless
+ * @player: A #AudioPlayer
+ *
+ * Return value: TRUE if @player is in gapless mode.
+ **/
+gboolean
+audio_player_get_gapless (AudioPlayer *player)
+{
+        g_return_val_if_fail (IS_AUDIO_PLAYER (player), FALSE);
+
+        return player->priv->gapless;
+}
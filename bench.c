@@ -0,0 +1,1019 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#include "library.h"
+#include "playlist-model.h"
+#include "playlist-parser.h"
+#include "playlist-writer.h"
+#include "search-index.h"
+#include "tag-cache.h"
+#include "tag-scheduler.h"
+
+/**
+ * Microbenchmarks for the hot paths: parsing playlists, adding rows,
+ * applying tag scan results, rendering rows, sorting and searching.
+ * Every benchmark is run at each playlist size, and reports one line of
+ * JSON: the time and the number of allocations per operation. Search
+ * queries report one line each, as their cost varies a lot.
+ *
+ * Allocations are counted through a GMemVTable, with GSlice told to use
+ * it too, so they include everything GLib allocates on our behalf.
+ *
+ * Saving the playlist is timed as well, and the saved playlist is then
+ * parsed back and checked against the model; a mismatch makes the run
+ * fail.
+ *
+ * Run with --scan FILES [READERS] to measure how many files per second
+ * TagScheduler scans with one reader, two readers and so on up to
+ * READERS, one per CPU by default.
+ *
+ * Run with --generate N FILE to just write a synthetic playlist.
+ **/
+
+static volatile int n_allocs;
+
+static gpointer
+counting_malloc (gsize n_bytes)
+{
+        g_atomic_int_inc (&n_allocs);
+
+        return malloc (n_bytes);
+}
+
+static gpointer
+counting_realloc (gpointer mem,
+                  gsize    n_bytes)
+{
+        g_atomic_int_inc (&n_allocs);
+
+        return realloc (mem, n_bytes);
+}
+
+static gpointer
+counting_calloc (gsize n_blocks,
+                 gsize n_block_bytes)
+{
+        g_atomic_int_inc (&n_allocs);
+
+        return calloc (n_blocks, n_block_bytes);
+}
+
+static GMemVTable counting_vtable = {
+        counting_malloc,
+        counting_realloc,
+        free,
+        counting_calloc,
+        counting_malloc,
+        counting_realloc
+};
+
+/**
+ * A running measurement.
+ **/
+typedef struct {
+        const char *name;
+        int         n_rows;
+        int         n_threads; /* Reported if not 0 */
+        const char *query;     /* Reported if not NULL */
+
+        GTimer     *timer;
+        int         allocs;
+} Bench;
+
+static void
+bench_start (Bench      *bench,
+             const char *name,
+             int         n_rows)
+{
+        bench->name      = name;
+        bench->n_rows    = n_rows;
+        bench->n_threads = 0;
+        bench->query     = NULL;
+        bench->timer     = g_timer_new ();
+        bench->allocs = g_atomic_int_get (&n_allocs);
+
+        g_timer_start (bench->timer);
+}
+
+/**
+ * Ends the measurement and reports it, @n_ops operations in all.
+ **/
+static void
+bench_stop (Bench *bench,
+            int    n_ops)
+{
+        double elapsed;
+        int allocs;
+
+        g_timer_stop (bench->timer);
+
+        allocs  = g_atomic_int_get (&n_allocs) - bench->allocs;
+        elapsed = g_timer_elapsed (bench->timer, NULL);
+
+        g_timer_destroy (bench->timer);
+
+        n_ops = MAX (n_ops, 1);
+
+        printf ("{\"benchmark\": \"%s\", \"rows\": %d, ",
+                bench->name,
+                bench->n_rows);
+
+        if (bench->n_threads > 0)
+                printf ("\"threads\": %d, ", bench->n_threads);
+
+        if (bench->query)
+                printf ("\"query\": \"%s\", ", bench->query);
+
+        printf ("\"ops\": %d, \"ns_per_op\": %.1f, "
+                "\"ops_per_second\": %.1f, \"allocs_per_op\": %.3f}\n",
+                n_ops,
+                elapsed * 1e9 / n_ops,
+                elapsed > 0 ? n_ops / elapsed : 0.0,
+                (double) allocs / n_ops);
+        fflush (stdout);
+}
+
+/**
+ * Writes a playlist of @n_entries entries to @filename, mixing absolute
+ * paths, paths relative to the playlist, URIs and DOS line endings, with
+ * #EXTINF lines for every other entry.
+ **/
+static gboolean
+generate_playlist (const char *filename,
+                   int         n_entries)
+{
+        FILE *file;
+        int i;
+
+        file = fopen (filename, "w");
+        if (!file)
+                return FALSE;
+
+        fputs ("#EXTM3U\n", file);
+
+        for (i = 0; i < n_entries; i++) {
+                const char *eol = (i % 3 == 0) ? "\r\n" : "\n";
+
+                if (i % 2 == 0) {
+                        fprintf (file,
+                                 "#EXTINF:%d,Artist %d - Title %d%s",
+                                 120 + i % 300, i % 1000, i, eol);
+                }
+
+                switch (i % 3) {
+                case 0:
+                        fprintf (file,
+                                 "/music/Artist %d/Album %d/%02d Title %d.mp3%s",
+                                 i % 1000, i % 5000, i % 20, i, eol);
+                        break;
+                case 1:
+                        fprintf (file,
+                                 "Artist %d/Title %d.ogg%s",
+                                 i % 1000, i, eol);
+                        break;
+                case 2:
+                        fprintf (file,
+                                 "file:///music/Artist%%20%d/Title%%20%d.flac%s",
+                                 i % 1000, i, eol);
+                        break;
+                }
+        }
+
+        return fclose (file) == 0;
+}
+
+static void
+count_entry_cb (PlaylistParser *parser,
+                const char     *uri,
+                const char     *title,
+                const char     *artist,
+                int             duration,
+                int            *n_entries)
+{
+        (*n_entries)++;
+}
+
+static void
+bench_parse (int n_rows)
+{
+        PlaylistParser *parser;
+        GError *error = NULL;
+        Bench bench;
+        char *filename, *uri;
+        int fd, n_entries = 0;
+
+        fd = g_file_open_tmp ("gaku-bench-XXXXXX.m3u", &filename, &error);
+        if (fd < 0) {
+                g_warning ("%s", error->message);
+                g_error_free (error);
+
+                return;
+        }
+
+        close (fd);
+
+        if (!generate_playlist (filename, n_rows)) {
+                g_warning ("Failed to write %s", filename);
+                g_unlink (filename);
+                g_free (filename);
+
+                return;
+        }
+
+        uri = g_filename_to_uri (filename, NULL, NULL);
+
+        parser = playlist_parser_new ();
+        g_signal_connect (parser,
+                          "entry",
+                          G_CALLBACK (count_entry_cb),
+                          &n_entries);
+
+        bench_start (&bench, "parse", n_rows);
+
+        if (!playlist_parser_parse (parser, uri, &error)) {
+                g_warning ("%s", error->message);
+                g_error_free (error);
+        }
+
+        bench_stop (&bench, n_entries);
+
+        g_object_unref (parser);
+
+        g_unlink (filename);
+        g_free (filename);
+        g_free (uri);
+}
+
+/**
+ * The rows the model benchmarks work on. Every tenth URI is a duplicate
+ * of the one before, as happens with real playlists. The URIs are of
+ * files in a new directory, which rows_write_files() creates, as
+ * TagCache only stores tags of files that exist.
+ **/
+typedef struct {
+        int    n_rows;
+
+        char  *dirname;
+        char **filenames;
+        char **uris;
+        char **titles;
+        char **artists;
+        char **albums;
+        int   *track_numbers;
+} Rows;
+
+static gboolean
+rows_init (Rows *rows,
+           int   n_rows)
+{
+        int i;
+
+        rows->dirname = g_build_filename (g_get_tmp_dir (),
+                                          "gaku-bench-XXXXXX",
+                                          NULL);
+        if (!mkdtemp (rows->dirname)) {
+                fprintf (stderr, "Failed to create %s\n", rows->dirname);
+                g_free (rows->dirname);
+
+                return FALSE;
+        }
+
+        rows->n_rows        = n_rows;
+        rows->filenames     = g_new (char *, n_rows);
+        rows->uris          = g_new (char *, n_rows);
+        rows->titles        = g_new (char *, n_rows);
+        rows->artists       = g_new (char *, n_rows);
+        rows->albums        = g_new (char *, n_rows);
+        rows->track_numbers = g_new (int, n_rows);
+
+        for (i = 0; i < n_rows; i++) {
+                int track = (i % 10 == 9) ? i - 1 : i;
+                char *basename;
+
+                basename = g_strdup_printf
+                        ("Artist %d - Album %d - %02d Title %d.ogg",
+                         track % 1000, track % 5000, track % 20, track);
+                rows->filenames[i] = g_build_filename (rows->dirname,
+                                                       basename,
+                                                       NULL);
+                g_free (basename);
+
+                rows->uris[i] = g_filename_to_uri (rows->filenames[i],
+                                                   NULL,
+                                                   NULL);
+                rows->titles[i]  = g_strdup_printf ("Title %d", track);
+                rows->artists[i] = g_strdup_printf ("Artist %d",
+                                                    track % 1000);
+                rows->albums[i]  = g_strdup_printf ("Album %d",
+                                                    track % 5000);
+                rows->track_numbers[i] = track % 20;
+        }
+
+        return TRUE;
+}
+
+/**
+ * Creates the files @rows are of, empty.
+ **/
+static gboolean
+rows_write_files (Rows *rows)
+{
+        int i;
+
+        for (i = 0; i < rows->n_rows; i++) {
+                if (!g_file_set_contents (rows->filenames[i], "", 0, NULL)) {
+                        fprintf (stderr,
+                                 "Failed to write %s\n",
+                                 rows->filenames[i]);
+
+                        return FALSE;
+                }
+        }
+
+        return TRUE;
+}
+
+static void
+rows_free (Rows *rows)
+{
+        int i;
+
+        for (i = 0; i < rows->n_rows; i++) {
+                g_unlink (rows->filenames[i]);
+
+                g_free (rows->filenames[i]);
+                g_free (rows->uris[i]);
+                g_free (rows->titles[i]);
+                g_free (rows->artists[i]);
+                g_free (rows->albums[i]);
+        }
+
+        g_rmdir (rows->dirname);
+
+        g_free (rows->dirname);
+        g_free (rows->filenames);
+        g_free (rows->uris);
+        g_free (rows->titles);
+        g_free (rows->artists);
+        g_free (rows->albums);
+        g_free (rows->track_numbers);
+}
+
+/**
+ * What add_uris() in main.c does to the model.
+ **/
+static void
+bench_append (PlaylistModel *model,
+              Rows          *rows)
+{
+        Bench bench;
+
+        bench_start (&bench, "append", rows->n_rows);
+
+        playlist_model_append_uris (model,
+                                    (const char **) rows->uris,
+                                    NULL,
+                                    NULL,
+                                    rows->n_rows);
+
+        bench_stop (&bench, rows->n_rows);
+}
+
+/**
+ * What main.c does for each tag scan result: tag_scheduler_uri_scanned_cb()
+ * stores it in the tag cache and the library, then apply_scan_result()
+ * indexes it and shows it in the model.
+ **/
+static void
+bench_tag_update (PlaylistModel *model,
+                  Rows          *rows)
+{
+        TagCache *cache;
+        Library *library;
+        SearchIndex *index;
+        GtkTreeIter iter;
+        Bench bench;
+        char *filename;
+        int i;
+
+        if (!rows_write_files (rows))
+                return;
+
+        /**
+         * Neither is ever saved, so these files are not written.
+         **/
+        filename = g_build_filename (rows->dirname, "tags", NULL);
+        cache = tag_cache_new (filename);
+        g_free (filename);
+
+        filename = g_build_filename (rows->dirname, "library", NULL);
+        library = library_new (filename);
+        g_free (filename);
+
+        index = search_index_new ();
+
+        bench_start (&bench, "tag_update", rows->n_rows);
+
+        for (i = 0; i < rows->n_rows; i++) {
+                tag_cache_store (cache,
+                                 rows->uris[i],
+                                 rows->titles[i],
+                                 rows->artists[i],
+                                 180);
+
+                library_store (library,
+                               rows->uris[i],
+                               rows->titles[i],
+                               rows->artists[i],
+                               rows->albums[i],
+                               rows->track_numbers[i],
+                               180);
+
+                if (!playlist_model_find_uri (model, rows->uris[i], &iter))
+                        continue;
+
+                search_index_set (index,
+                                  rows->uris[i],
+                                  rows->titles[i],
+                                  rows->artists[i]);
+
+                do {
+                        playlist_model_set (model,
+                                            &iter,
+                                            rows->titles[i],
+                                            rows->artists[i]);
+                } while (playlist_model_find_uri_next (model, &iter));
+        }
+
+        bench_stop (&bench, rows->n_rows);
+
+        g_object_unref (index);
+        g_object_unref (library);
+        g_object_unref (cache);
+}
+
+/**
+ * What the cell data functions in main.c ask of the model for each row
+ * drawn. The first pass builds the cached display texts, the second
+ * one finds them.
+ **/
+static void
+bench_render (PlaylistModel *model,
+              const char    *name,
+              int            n_rows)
+{
+        GtkTreeIter iter;
+        Bench bench;
+        int i, title_length;
+
+        bench_start (&bench, name, n_rows);
+
+        for (i = 0; i < n_rows; i++) {
+                playlist_model_get_iter_at (model, &iter, i);
+
+                playlist_model_iter_is_playing (model, &iter);
+                playlist_model_get_text (model, &iter, &title_length);
+        }
+
+        bench_stop (&bench, n_rows);
+}
+
+static void
+bench_sort (PlaylistModel       *model,
+            const char          *name,
+            PlaylistModelColumn  column,
+            int                  n_rows)
+{
+        Bench bench;
+
+        bench_start (&bench, name, n_rows);
+
+        playlist_model_sort (model, column);
+
+        bench_stop (&bench, 1);
+}
+
+/**
+ * Builds a search index over @rows, then times a mix of queries, from
+ * rare words to common ones, one per keystroke, each on its own.
+ **/
+static void
+bench_search (Rows *rows)
+{
+        static const char *queries[] = {
+                "t", "ti", "tit", "titl", "title", "title 4", "title 42",
+                "art", "artist 7", "artist 99 title", "album 1234",
+                "nothing"
+        };
+        SearchIndex *index;
+        GPtrArray *uris;
+        Bench bench;
+        guint i;
+        int j;
+
+        index = search_index_new ();
+        uris = g_ptr_array_new ();
+
+        bench_start (&bench, "search_index", rows->n_rows);
+
+        for (j = 0; j < rows->n_rows; j++) {
+                search_index_set (index,
+                                  rows->uris[j],
+                                  rows->titles[j],
+                                  rows->artists[j]);
+        }
+
+        /**
+         * Keys are built from an idle; let it run.
+         **/
+        while (g_main_context_iteration (NULL, FALSE))
+                ;
+
+        bench_stop (&bench, rows->n_rows);
+
+        for (i = 0; i < G_N_ELEMENTS (queries); i++) {
+                g_ptr_array_set_size (uris, 0);
+
+                bench_start (&bench, "search_query", rows->n_rows);
+                bench.query = queries[i];
+
+                search_index_query (index, queries[i], uris);
+
+                bench_stop (&bench, 1);
+        }
+
+        g_ptr_array_free (uris, TRUE);
+        g_object_unref (index);
+}
+
+static int
+round_trip_duration (const char *uri,
+                     gpointer    user_data)
+{
+        return 180;
+}
+
+typedef struct {
+        PlaylistModel *model;
+        int            n_entries;
+        gboolean       ok;
+} RoundTrip;
+
+/**
+ * Returns what is left of tag @str after a round trip: line breaks become
+ * spaces, and empty strings NULL.
+ **/
+static char *
+round_trip_tag (const char *str)
+{
+        char *ret;
+
+        if (!str || str[0] == '\0')
+                return NULL;
+
+        ret = g_strdup (str);
+        g_strdelimit (ret, "\r\n", ' ');
+
+        return ret;
+}
+
+static void
+round_trip_entry_cb (PlaylistParser *parser,
+                     const char     *uri,
+                     const char     *title,
+                     const char     *artist,
+                     int             duration,
+                     RoundTrip      *round_trip)
+{
+        GtkTreeIter iter;
+        char *expected_title, *expected_artist;
+        int i;
+
+        i = round_trip->n_entries++;
+
+        if (!round_trip->ok)
+                return;
+
+        if (!playlist_model_get_iter_at (round_trip->model, &iter, i)) {
+                fprintf (stderr, "Round trip: extra entry %s\n", uri);
+                round_trip->ok = FALSE;
+
+                return;
+        }
+
+        expected_title  = round_trip_tag
+                (playlist_model_peek_title (round_trip->model, &iter));
+        expected_artist = round_trip_tag
+                (playlist_model_get_artist (round_trip->model, &iter));
+
+        if (strcmp (uri, playlist_model_get_uri (round_trip->model, &iter)) ||
+            g_strcmp0 (title, expected_title) ||
+            g_strcmp0 (artist, expected_artist) ||
+            duration != 180) {
+                fprintf (stderr,
+                         "Round trip: row %d came back as "
+                         "%s, \"%s\", \"%s\", %d\n",
+                         i,
+                         uri,
+                         title ? title : "(null)",
+                         artist ? artist : "(null)",
+                         duration);
+                round_trip->ok = FALSE;
+        }
+
+        g_free (expected_title);
+        g_free (expected_artist);
+}
+
+/**
+ * Times saving @model, then parses the saved playlist and checks that
+ * every row came back. A few rows get tags that need care first: line
+ * breaks, and " - " in the title or the artist. Returns FALSE if
+ * anything did not come back.
+ **/
+static gboolean
+bench_save (PlaylistModel *model,
+            Rows          *rows)
+{
+        static const char *tags[][2] = {
+                { "Line\nbreak\r\nin title", "Artist\nwith break" },
+                { "Title",                   "Artist - Band" },
+                { "Title - Part 1",          NULL },
+                { "Title - Part 2",          "Artist - Band" }
+        };
+        PlaylistParser *parser;
+        RoundTrip round_trip;
+        GtkTreeIter iter;
+        GError *error = NULL;
+        Bench bench;
+        char *filename, *uri;
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS (tags); i++) {
+                if (playlist_model_get_iter_at (model, &iter, i))
+                        playlist_model_set (model,
+                                            &iter,
+                                            tags[i][0],
+                                            tags[i][1]);
+        }
+
+        filename = g_build_filename (rows->dirname, "saved.m3u", NULL);
+
+        bench_start (&bench, "save", rows->n_rows);
+
+        if (!playlist_writer_save_m3u (model,
+                                       filename,
+                                       round_trip_duration,
+                                       NULL,
+                                       &error)) {
+                fprintf (stderr, "%s\n", error->message);
+                g_error_free (error);
+                g_free (filename);
+
+                return FALSE;
+        }
+
+        bench_stop (&bench, rows->n_rows);
+
+        round_trip.model     = model;
+        round_trip.n_entries = 0;
+        round_trip.ok        = TRUE;
+
+        parser = playlist_parser_new ();
+        g_signal_connect (parser,
+                          "entry",
+                          G_CALLBACK (round_trip_entry_cb),
+                          &round_trip);
+
+        uri = g_filename_to_uri (filename, NULL, NULL);
+
+        if (!playlist_parser_parse (parser, uri, &error)) {
+                fprintf (stderr, "%s\n", error->message);
+                g_error_free (error);
+
+                round_trip.ok = FALSE;
+        }
+
+        if (round_trip.ok &&
+            round_trip.n_entries != playlist_model_get_n_rows (model)) {
+                fprintf (stderr,
+                         "Round trip: %d of %d rows came back\n",
+                         round_trip.n_entries,
+                         playlist_model_get_n_rows (model));
+
+                round_trip.ok = FALSE;
+        }
+
+        g_object_unref (parser);
+
+        g_unlink (filename);
+
+        g_free (uri);
+        g_free (filename);
+
+        return round_trip.ok;
+}
+
+/**
+ * Runs all benchmarks with @n_rows rows. Returns FALSE if a check
+ * failed.
+ **/
+static gboolean
+run (int n_rows)
+{
+        PlaylistModel *model;
+        gboolean ret;
+        Rows rows;
+
+        bench_parse (n_rows);
+
+        if (!rows_init (&rows, n_rows))
+                return FALSE;
+
+        model = playlist_model_new ();
+
+        bench_append (model, &rows);
+        bench_render (model, "render_cold", n_rows);
+        bench_tag_update (model, &rows);
+        bench_render (model, "render_cold_tagged", n_rows);
+        bench_render (model, "render_warm", n_rows);
+        bench_sort (model, "sort_title", PLAYLIST_MODEL_COL_TITLE, n_rows);
+        bench_sort (model, "sort_title_cached",
+                    PLAYLIST_MODEL_COL_TITLE, n_rows);
+        bench_sort (model, "sort_artist", PLAYLIST_MODEL_COL_ARTIST, n_rows);
+
+        ret = bench_save (model, &rows);
+
+        g_object_unref (model);
+
+        bench_search (&rows);
+
+        rows_free (&rows);
+
+        return ret;
+}
+
+/**
+ * Writes a WAV file of @n_samples samples of silence to @filename.
+ **/
+static gboolean
+write_wav (const char *filename,
+           guint32     n_samples)
+{
+        FILE *file;
+        guint32 header[11], data_size;
+        gboolean ret;
+        guint32 i;
+
+        data_size = n_samples * 2;
+
+        memcpy (&header[0], "RIFF", 4);
+        header[1]  = GUINT32_TO_LE (36 + data_size);
+        memcpy (&header[2], "WAVE", 4);
+        memcpy (&header[3], "fmt ", 4);
+        header[4]  = GUINT32_TO_LE (16);
+        header[5]  = GUINT32_TO_LE (1 | 1 << 16);   /* PCM, mono */
+        header[6]  = GUINT32_TO_LE (8000);          /* Sample rate */
+        header[7]  = GUINT32_TO_LE (16000);         /* Byte rate */
+        header[8]  = GUINT32_TO_LE (2 | 16 << 16);  /* 16 bit samples */
+        memcpy (&header[9], "data", 4);
+        header[10] = GUINT32_TO_LE (data_size);
+
+        file = fopen (filename, "wb");
+        if (!file)
+                return FALSE;
+
+        ret = fwrite (header, sizeof (header), 1, file) == 1;
+
+        for (i = 0; i < n_samples && ret; i++)
+                ret = fputc (0, file) != EOF && fputc (0, file) != EOF;
+
+        return fclose (file) == 0 && ret;
+}
+
+typedef struct {
+        GMainLoop *loop;
+        int        n_left;
+} ScanState;
+
+static void
+uri_scanned_cb (TagScheduler *scheduler,
+                const char   *uri,
+                GError       *error,
+                GstTagList   *tag_list,
+                ScanState    *state)
+{
+        if (--state->n_left == 0)
+                g_main_loop_quit (state->loop);
+}
+
+/**
+ * Has a TagScheduler with @n_readers readers scan @n_files URIs.
+ **/
+static void
+bench_scan (char **uris,
+            int    n_files,
+            int    n_readers)
+{
+        TagScheduler *scheduler;
+        ScanState state;
+        Bench bench;
+        int i;
+
+        scheduler = tag_scheduler_new (n_readers);
+
+        state.loop   = g_main_loop_new (NULL, FALSE);
+        state.n_left = n_files;
+
+        g_signal_connect (scheduler,
+                          "uri-scanned",
+                          G_CALLBACK (uri_scanned_cb),
+                          &state);
+
+        bench_start (&bench, "tag_scan", n_files);
+        bench.n_threads = n_readers;
+
+        for (i = 0; i < n_files; i++)
+                tag_scheduler_scan_uri (scheduler, uris[i]);
+
+        g_main_loop_run (state.loop);
+
+        bench_stop (&bench, n_files);
+
+        g_main_loop_unref (state.loop);
+        g_object_unref (scheduler);
+}
+
+/**
+ * Writes @n_files short WAV files to a new directory, and scans them
+ * with 1 to @max_readers readers.
+ **/
+static gboolean
+run_scan (int n_files,
+          int max_readers)
+{
+        char *dirname, **uris;
+        gboolean ret = TRUE;
+        int i;
+
+        dirname = g_build_filename (g_get_tmp_dir (),
+                                    "gaku-bench-XXXXXX",
+                                    NULL);
+        if (!mkdtemp (dirname)) {
+                fprintf (stderr, "Failed to create %s\n", dirname);
+                g_free (dirname);
+
+                return FALSE;
+        }
+
+        uris = g_new0 (char *, n_files + 1);
+
+        for (i = 0; i < n_files && ret; i++) {
+                char *basename, *filename;
+
+                basename = g_strdup_printf ("%06d.wav", i);
+                filename = g_build_filename (dirname, basename, NULL);
+                g_free (basename);
+
+                ret = write_wav (filename, 8000);
+                if (ret)
+                        uris[i] = g_filename_to_uri (filename, NULL, NULL);
+                else
+                        fprintf (stderr, "Failed to write %s\n", filename);
+
+                g_free (filename);
+        }
+
+        for (i = 1; i <= max_readers && ret; i++)
+                bench_scan (uris, n_files, i);
+
+        for (i = 0; i < n_files && uris[i]; i++) {
+                char *filename;
+
+                filename = g_filename_from_uri (uris[i], NULL, NULL);
+                g_unlink (filename);
+                g_free (filename);
+        }
+
+        g_rmdir (dirname);
+
+        g_strfreev (uris);
+        g_free (dirname);
+
+        return ret;
+}
+
+static void
+usage (const char *name)
+{
+        fprintf (stderr,
+                 "Usage: %s [ROWS...]\n"
+                 "       %s --scan FILES [READERS]\n"
+                 "       %s --generate ROWS FILE\n",
+                 name,
+                 name,
+                 name);
+}
+
+int
+main (int argc, char **argv)
+{
+        int i;
+
+        /**
+         * Count every allocation, GSlice ones included. This has to
+         * come before anything else touches GLib.
+         **/
+        setenv ("G_SLICE", "always-malloc", TRUE);
+        g_mem_set_vtable (&counting_vtable);
+
+        if (!g_thread_supported ())
+                g_thread_init (NULL);
+
+        gst_init (&argc, &argv);
+
+        if (argc > 1 && !strcmp (argv[1], "--scan")) {
+                int n_files, max_readers;
+
+                if (argc != 3 && argc != 4) {
+                        usage (argv[0]);
+
+                        return 1;
+                }
+
+                n_files = atoi (argv[2]);
+
+                if (argc == 4)
+                        max_readers = atoi (argv[3]);
+                else
+                        max_readers = MAX (sysconf (_SC_NPROCESSORS_ONLN), 1);
+
+                if (n_files <= 0 || max_readers <= 0) {
+                        usage (argv[0]);
+
+                        return 1;
+                }
+
+                return run_scan (n_files, max_readers) ? 0 : 1;
+        }
+
+        if (argc > 1 && !strcmp (argv[1], "--generate")) {
+                if (argc != 4) {
+                        usage (argv[0]);
+
+                        return 1;
+                }
+
+                if (!generate_playlist (argv[3], atoi (argv[2]))) {
+                        fprintf (stderr, "Failed to write %s\n", argv[3]);
+
+                        return 1;
+                }
+
+                return 0;
+        }
+
+        if (argc == 1) {
+                return run (1000) &&
+                       run (100000) &&
+                       run (1000000) ? 0 : 1;
+        }
+
+        for (i = 1; i < argc; i++) {
+                int n_rows = atoi (argv[i]);
+
+                if (n_rows <= 0) {
+                        usage (argv[0]);
+
+                        return 1;
+                }
+
+                if (!run (n_rows))
+                        return 1;
+        }
+
+        return 0;
+}
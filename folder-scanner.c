@@ -0,0 +1,708 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "folder-scanner.h"
+#include "marshal.h"
+
+/**
+ * FolderScanner walks directory trees with a pool of threads, each
+ * reading one directory at a time. Reading directories is what takes
+ * time, so more threads than CPUs are used. Every directory becomes a
+ * node in a tree that mirrors the file system, with its audio files
+ * and subdirectories sorted by name. The main loop walks that tree in
+ * order as nodes come in: first a directory's files, then its
+ * subdirectories. So the files are delivered in the same order however
+ * the threads are scheduled.
+ *
+ * Directories are handed to the threads in that same order, so that
+ * the walk in the main loop waits as little as possible.
+ **/
+
+#define BATCH_SIZE 256
+
+G_DEFINE_TYPE (FolderScanner,
+               folder_scanner,
+               G_TYPE_OBJECT);
+
+enum {
+        SIGNAL_FILES_FOUND,
+        SIGNAL_LAST
+};
+
+static guint signals[SIGNAL_LAST];
+
+struct _FolderScannerPrivate {
+        GThreadPool *pool;
+};
+
+#define GET_PRIVATE(o) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
+                                      TYPE_FOLDER_SCANNER, \
+                                      FolderScannerPrivate))
+
+typedef struct _ScanJob ScanJob;
+typedef struct _Dir     Dir;
+
+struct _Dir {
+        ScanJob   *job;
+        Dir       *parent;
+        char      *path;
+
+        /**
+         * Indices of the directory and its ancestors among their
+         * siblings, from the root down: the order it is delivered in.
+         **/
+        guint     *order;
+        guint      depth;
+
+        /**
+         * Filled in by the thread reading the directory.
+         **/
+        GPtrArray *files;    /* URIs */
+        GPtrArray *children; /* Dir */
+
+        /**
+         * Protected by the job's mutex.
+         **/
+        gboolean   scanned;
+
+        /**
+         * Owned by the main thread.
+         **/
+        guint      next_file;
+        guint      next_child;
+};
+
+struct _ScanJob {
+        FolderScanner      *scanner;
+        GSimpleAsyncResult *result;
+        GCancellable       *cancellable;
+
+        /**
+         * Protected by @mutex.
+         **/
+        GMutex             *mutex;
+        guint               n_pending; /* Directories not read yet */
+        guint               idle_id;
+
+        /**
+         * Owned by the main thread.
+         **/
+        Dir                *root;
+        Dir                *cursor;    /* Next to deliver from, or NULL */
+        GPtrArray          *batch;
+};
+
+/**
+ * File extensions of the audio files we pick up without further ado.
+ **/
+static const char *audio_extensions[] = {
+        "aac", "aif", "aiff", "ape", "flac", "m4a", "mka", "mp2", "mp3",
+        "mpc", "oga", "ogg", "opus", "spx", "wav", "wma", "wv", NULL
+};
+
+/**
+ * Returns TRUE if @name looks like an audio file: it has a known audio
+ * extension, or the MIME type guessed from it is an audio type other
+ * than a playlist.
+ **/
+static gboolean
+is_audio_file (const char *name)
+{
+        const char *dot;
+        char *content_type;
+        gboolean ret;
+        int i;
+
+        dot = strrchr (name, '.');
+        if (dot) {
+                for (i = 0; audio_extensions[i]; i++) {
+                        if (!g_ascii_strcasecmp (dot + 1,
+                                                 audio_extensions[i]))
+                                return TRUE;
+                }
+        }
+
+        content_type = g_content_type_guess (name, NULL, 0, NULL);
+
+        ret = (g_str_has_prefix (content_type, "audio/") &&
+               !strstr (content_type, "mpegurl") &&
+               !strstr (content_type, "scpls"));
+
+        g_free (content_type);
+
+        return ret;
+}
+
+static Dir *
+dir_new (ScanJob    *job,
+         Dir        *parent,
+         const char *path,
+         guint       index)
+{
+        Dir *dir;
+
+        dir = g_slice_new0 (Dir);
+
+        dir->job    = job;
+        dir->parent = parent;
+        dir->path   = g_strdup (path);
+
+        if (parent) {
+                dir->depth = parent->depth + 1;
+                dir->order = g_new (guint, dir->depth);
+
+                memcpy (dir->order, parent->order,
+                        parent->depth * sizeof (guint));
+                dir->order[parent->depth] = index;
+        }
+
+        return dir;
+}
+
+static void
+dir_free (Dir *dir)
+{
+        guint i;
+
+        if (dir->files) {
+                g_ptr_array_foreach (dir->files, (GFunc) g_free, NULL);
+                g_ptr_array_free (dir->files, TRUE);
+        }
+
+        if (dir->children) {
+                for (i = 0; i < dir->children->len; i++) {
+                        Dir *child = g_ptr_array_index (dir->children, i);
+
+                        if (child)
+                                dir_free (child);
+                }
+
+                g_ptr_array_free (dir->children, TRUE);
+        }
+
+        g_free (dir->order);
+        g_free (dir->path);
+
+        g_slice_free (Dir, dir);
+}
+
+/**
+ * Orders directories the way they are delivered.
+ **/
+static int
+compare_dirs (const Dir *a,
+              const Dir *b,
+              gpointer   user_data)
+{
+        guint i;
+
+        for (i = 0; i < a->depth && i < b->depth; i++) {
+                if (a->order[i] != b->order[i])
+                        return a->order[i] < b->order[i] ? -1 : 1;
+        }
+
+        return (int) a->depth - (int) b->depth;
+}
+
+static int
+compare_names (const char **a,
+               const char **b)
+{
+        return strcmp (*a, *b);
+}
+
+typedef enum {
+        ENTRY_OTHER,
+        ENTRY_FILE,
+        ENTRY_DIR
+} EntryType;
+
+/**
+ * Works out what @entry in @dir is, without a stat() where the file
+ * system already told us. Symbolic links to files are followed, those
+ * to directories are not, so that we cannot end up in a loop.
+ **/
+static EntryType
+get_entry_type (Dir           *dir,
+                struct dirent *entry)
+{
+        struct stat st;
+        char *path;
+        int ret;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+        switch (entry->d_type) {
+        case DT_REG:
+                return ENTRY_FILE;
+        case DT_DIR:
+                return ENTRY_DIR;
+        case DT_LNK:
+        case DT_UNKNOWN:
+                break;
+        default:
+                return ENTRY_OTHER;
+        }
+#endif
+
+        path = g_build_filename (dir->path, entry->d_name, NULL);
+
+        ret = lstat (path, &st);
+        if (ret == 0 && S_ISLNK (st.st_mode))
+                ret = stat (path, &st) == 0 && S_ISREG (st.st_mode) ? 0 : -1;
+
+        g_free (path);
+
+        if (ret < 0)
+                return ENTRY_OTHER;
+
+        if (S_ISREG (st.st_mode))
+                return ENTRY_FILE;
+        if (S_ISDIR (st.st_mode))
+                return ENTRY_DIR;
+
+        return ENTRY_OTHER;
+}
+
+static gboolean
+deliver (ScanJob *job);
+
+/**
+ * Makes sure deliver() runs. Call with @job's mutex held.
+ **/
+static void
+schedule_delivery (ScanJob *job)
+{
+        if (!job->idle_id)
+                job->idle_id = g_idle_add ((GSourceFunc) deliver, job);
+}
+
+/**
+ * Reads @dir, and queues its subdirectories. Runs in a pool thread.
+ **/
+static void
+scan_dir (Dir           *dir,
+          FolderScanner *scanner)
+{
+        ScanJob *job = dir->job;
+        GPtrArray *files, *dirs;
+        DIR *handle;
+        guint i;
+
+        files = g_ptr_array_new ();
+        dirs  = g_ptr_array_new ();
+
+        /**
+         * readdir() gets the entries from the kernel many at a time.
+         **/
+        handle = NULL;
+        if (!g_cancellable_is_cancelled (job->cancellable))
+                handle = opendir (dir->path);
+
+        if (handle) {
+                struct dirent *entry;
+
+                while ((entry = readdir (handle))) {
+                        /**
+                         * Skip '.', '..' and hidden files.
+                         **/
+                        if (entry->d_name[0] == '.')
+                                continue;
+
+                        switch (get_entry_type (dir, entry)) {
+                        case ENTRY_FILE:
+                                if (is_audio_file (entry->d_name)) {
+                                        g_ptr_array_add
+                                                (files,
+                                                 g_strdup (entry->d_name));
+                                }
+                                break;
+                        case ENTRY_DIR:
+                                g_ptr_array_add (dirs,
+                                                 g_strdup (entry->d_name));
+                                break;
+                        default:
+                                break;
+                        }
+                }
+
+                closedir (handle);
+        }
+
+        g_ptr_array_sort (files, (GCompareFunc) compare_names);
+        g_ptr_array_sort (dirs, (GCompareFunc) compare_names);
+
+        dir->files = g_ptr_array_sized_new (files->len);
+        for (i = 0; i < files->len; i++) {
+                char *path, *uri;
+
+                path = g_build_filename (dir->path,
+                                         g_ptr_array_index (files, i),
+                                         NULL);
+                uri = g_filename_to_uri (path, NULL, NULL);
+                if (uri)
+                        g_ptr_array_add (dir->files, uri);
+
+                g_free (path);
+        }
+
+        dir->children = g_ptr_array_sized_new (dirs->len);
+        for (i = 0; i < dirs->len; i++) {
+                char *path;
+
+                path = g_build_filename (dir->path,
+                                         g_ptr_array_index (dirs, i),
+                                         NULL);
+                g_ptr_array_add (dir->children,
+                                 dir_new (job, dir, path, i));
+
+                g_free (path);
+        }
+
+        g_ptr_array_foreach (files, (GFunc) g_free, NULL);
+        g_ptr_array_free (files, TRUE);
+        g_ptr_array_foreach (dirs, (GFunc) g_free, NULL);
+        g_ptr_array_free (dirs, TRUE);
+
+        g_mutex_lock (job->mutex);
+
+        dir->scanned = TRUE;
+
+        job->n_pending += dir->children->len;
+        job->n_pending--;
+
+        for (i = 0; i < dir->children->len; i++) {
+                g_thread_pool_push (scanner->priv->pool,
+                                    g_ptr_array_index (dir->children, i),
+                                    NULL);
+        }
+
+        schedule_delivery (job);
+
+        g_mutex_unlock (job->mutex);
+}
+
+static void
+folder_scanner_init (FolderScanner *scanner)
+{
+        long n_threads;
+
+        scanner->priv = GET_PRIVATE (scanner);
+
+        /**
+         * Threads mostly wait for the disk; keep a few more of them
+         * than there are CPUs.
+         **/
+        n_threads = 2 * sysconf (_SC_NPROCESSORS_ONLN);
+        n_threads = CLAMP (n_threads, 4, 16);
+
+        scanner->priv->pool = g_thread_pool_new ((GFunc) scan_dir,
+                                                 scanner,
+                                                 n_threads,
+                                                 FALSE,
+                                                 NULL);
+
+        g_thread_pool_set_sort_function (scanner->priv->pool,
+                                         (GCompareDataFunc) compare_dirs,
+                                         NULL);
+}
+
+static void
+folder_scanner_dispose (GObject *object)
+{
+        FolderScanner *scanner;
+        GObjectClass *object_class;
+
+        scanner = FOLDER_SCANNER (object);
+
+        if (scanner->priv->pool) {
+                g_thread_pool_free (scanner->priv->pool, FALSE, TRUE);
+                scanner->priv->pool = NULL;
+        }
+
+        object_class = G_OBJECT_CLASS (folder_scanner_parent_class);
+        object_class->dispose (object);
+}
+
+static void
+folder_scanner_class_init (FolderScannerClass *klass)
+{
+        GObjectClass *object_class;
+
+        object_class = G_OBJECT_CLASS (klass);
+
+        object_class->dispose = folder_scanner_dispose;
+
+        g_type_class_add_private (klass, sizeof (FolderScannerPrivate));
+
+        signals[SIGNAL_FILES_FOUND] =
+                g_signal_new ("files-found",
+                              TYPE_FOLDER_SCANNER,
+                              G_SIGNAL_RUN_LAST,
+                              G_STRUCT_OFFSET (FolderScannerClass,
+                                               files_found),
+                              NULL,
+                              NULL,
+                              gaku_marshal_VOID__POINTER_INT,
+                              G_TYPE_NONE,
+                              2,
+                              G_TYPE_POINTER,
+                              G_TYPE_INT);
+}
+
+/**
+ * folder_scanner_new
+ *
+ * Return value: A new #FolderScanner.
+ **/
+FolderScanner *
+folder_scanner_new (void)
+{
+        return g_object_new (TYPE_FOLDER_SCANNER, NULL);
+}
+
+static void
+scan_job_free (ScanJob *job)
+{
+        if (job->root)
+                dir_free (job->root);
+
+        g_ptr_array_foreach (job->batch, (GFunc) g_free, NULL);
+        g_ptr_array_free (job->batch, TRUE);
+
+        g_mutex_free (job->mutex);
+
+        if (job->cancellable)
+                g_object_unref (job->cancellable);
+
+        g_object_unref (job->result);
+        g_object_unref (job->scanner);
+
+        g_slice_free (ScanJob, job);
+}
+
+/**
+ * Moves the files of the directories read so far into @job's batch, in
+ * order, until it is full. Directories are freed once done with. Call
+ * with @job's mutex held.
+ **/
+static void
+fill_batch (ScanJob *job)
+{
+        while (job->cursor && job->batch->len < BATCH_SIZE) {
+                Dir *dir = job->cursor;
+
+                if (!dir->scanned)
+                        break;
+
+                while (dir->next_file < dir->files->len &&
+                       job->batch->len < BATCH_SIZE) {
+                        g_ptr_array_add (job->batch,
+                                         g_ptr_array_index (dir->files,
+                                                            dir->next_file));
+                        g_ptr_array_index (dir->files, dir->next_file) = NULL;
+
+                        dir->next_file++;
+                }
+
+                if (dir->next_file < dir->files->len)
+                        break;
+
+                if (dir->next_child < dir->children->len) {
+                        job->cursor = g_ptr_array_index (dir->children,
+                                                         dir->next_child);
+                        dir->next_child++;
+
+                        continue;
+                }
+
+                /**
+                 * All of @dir was delivered. Move back up.
+                 **/
+                job->cursor = dir->parent;
+
+                if (dir->parent) {
+                        g_ptr_array_index (dir->parent->children,
+                                           dir->parent->next_child - 1) =
+                                NULL;
+                } else
+                        job->root = NULL;
+
+                dir_free (dir);
+        }
+}
+
+/**
+ * Emits the next batch of files found for @job, or completes @job if
+ * all were delivered.
+ **/
+static gboolean
+deliver (ScanJob *job)
+{
+        gboolean cancelled, finished;
+        guint i;
+
+        g_mutex_lock (job->mutex);
+
+        cancelled = g_cancellable_is_cancelled (job->cancellable);
+        if (!cancelled)
+                fill_batch (job);
+
+        finished = (!job->cursor || cancelled) && job->n_pending == 0;
+
+        if (job->batch->len == 0 && !finished)
+                job->idle_id = 0;
+
+        g_mutex_unlock (job->mutex);
+
+        if (job->batch->len > 0) {
+                if (!cancelled) {
+                        g_signal_emit (job->scanner,
+                                       signals[SIGNAL_FILES_FOUND],
+                                       0,
+                                       job->batch->pdata,
+                                       job->batch->len);
+                }
+
+                for (i = 0; i < job->batch->len; i++)
+                        g_free (g_ptr_array_index (job->batch, i));
+                g_ptr_array_set_size (job->batch, 0);
+
+                return TRUE;
+        }
+
+        if (!finished)
+                return FALSE;
+
+        /**
+         * All done.
+         **/
+        if (cancelled) {
+                g_simple_async_result_set_error (job->result,
+                                                 G_IO_ERROR,
+                                                 G_IO_ERROR_CANCELLED,
+                                                 "Operation was cancelled");
+        }
+
+        g_simple_async_result_complete (job->result);
+
+        scan_job_free (job);
+
+        return FALSE;
+}
+
+/**
+ * folder_scanner_scan_async
+ * @scanner: A #FolderScanner
+ * @uri: The URI of a local directory
+ * @cancellable: Optional #GCancellable, or NULL
+ * @callback: A #GAsyncReadyCallback to call when done
+ * @user_data: The data to pass to @callback
+ *
+ * Looks for audio files in @uri and the directories below it, using a
+ * number of threads. Hidden files and directories are skipped. The URIs
+ * of the files found are passed to 'files-found' in batches, from the
+ * main loop, ordered by name per directory: first the files in a
+ * directory, then those below each of its subdirectories. Once
+ * @cancellable is cancelled no more batches are delivered.
+ *
+ * When done, @callback is called, which should call
+ * folder_scanner_scan_finish().
+ **/
+void
+folder_scanner_scan_async (FolderScanner      *scanner,
+                           const char         *uri,
+                           GCancellable       *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer            user_data)
+{
+        ScanJob *job;
+        char *path;
+
+        g_return_if_fail (IS_FOLDER_SCANNER (scanner));
+        g_return_if_fail (uri != NULL);
+
+        job = g_slice_new0 (ScanJob);
+
+        job->scanner = g_object_ref (scanner);
+        job->result = g_simple_async_result_new (G_OBJECT (scanner),
+                                                 callback,
+                                                 user_data,
+                                                 folder_scanner_scan_async);
+        job->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+
+        job->mutex = g_mutex_new ();
+        job->batch = g_ptr_array_sized_new (BATCH_SIZE);
+
+        path = g_filename_from_uri (uri, NULL, NULL);
+        if (!path) {
+                g_simple_async_result_set_error (job->result,
+                                                 G_IO_ERROR,
+                                                 G_IO_ERROR_NOT_SUPPORTED,
+                                                 "Not a local folder: %s",
+                                                 uri);
+                g_simple_async_result_complete_in_idle (job->result);
+
+                scan_job_free (job);
+
+                return;
+        }
+
+        job->root = dir_new (job, NULL, path, 0);
+        job->cursor = job->root;
+        job->n_pending = 1;
+
+        g_free (path);
+
+        g_thread_pool_push (scanner->priv->pool, job->root, NULL);
+}
+
+/**
+ * folder_scanner_scan_finish
+ * @scanner: A #FolderScanner
+ * @result: The #GAsyncResult passed to the callback
+ * @error: Location where to store a #GError if an error occurs.
+ *
+ * Finishes an operation started with folder_scanner_scan_async().
+ *
+ * Return value: TRUE on success, FALSE if an error occured or the
+ * operation was cancelled, in which case @error is set as well.
+ **/
+gboolean
+folder_scanner_scan_finish (FolderScanner *scanner,
+                            GAsyncResult  *result,
+                            GError       **error)
+{
+        GSimpleAsyncResult *simple;
+
+        g_return_val_if_fail (IS_FOLDER_SCANNER (scanner), FALSE);
+        g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (result), FALSE);
+
+        simple = G_SIMPLE_ASYNC_RESULT (result);
+
+        g_return_val_if_fail (g_simple_async_result_get_source_tag (simple) ==
+                              folder_scanner_scan_async, FALSE);
+
+        return !g_simple_async_result_propagate_error (simple, error);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __FOLDER_SCANNER_H__
+#define __FOLDER_SCANNER_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_FOLDER_SCANNER \
+                (folder_scanner_get_type ())
+#define FOLDER_SCANNER(obj) \
+                (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                 TYPE_FOLDER_SCANNER, \
+                 FolderScanner))
+#define FOLDER_SCANNER_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_CAST ((klass), \
+                 TYPE_FOLDER_SCANNER, \
+                 FolderScannerClass))
+#define IS_FOLDER_SCANNER(obj) \
+                (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                 TYPE_FOLDER_SCANNER))
+#define IS_FOLDER_SCANNER_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                 TYPE_FOLDER_SCANNER))
+#define FOLDER_SCANNER_GET_CLASS(obj) \
+                (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+                 TYPE_FOLDER_SCANNER, \
+                 FolderScannerClass))
+
+typedef struct _FolderScannerPrivate FolderScannerPrivate;
+
+typedef struct {
+        GObject parent;
+
+        FolderScannerPrivate *priv;
+} FolderScanner;
+
+typedef struct {
+        GObjectClass parent_class;
+
+        /* Signals */
+        void (* files_found) (FolderScanner *scanner,
+                              const char   **uris,
+                              int            n_uris);
+
+        /* Future padding */
+        void (* _reserved1) (void);
+        void (* _reserved2) (void);
+        void (* _reserved3) (void);
+        void (* _reserved4) (void);
+} FolderScannerClass;
+
+GType
+folder_scanner_get_type    (void) G_GNUC_CONST;
+
+FolderScanner *
+folder_scanner_new         (void);
+
+void
+folder_scanner_scan_async  (FolderScanner      *scanner,
+                            const char         *uri,
+                            GCancellable       *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer            user_data);
+
+gboolean
+folder_scanner_scan_finish (FolderScanner      *scanner,
+                            GAsyncResult       *result,
+                            GError            **error);
+
+G_END_DECLS
+
+#endif /* __FOLDER_SCANNER_H__ */
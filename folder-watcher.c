@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include <gio/gio.h>
+
+#include "folder-watcher.h"
+#include "marshal.h"
+
+/**
+ * FolderWatcher keeps a GFileMonitor on every folder holding a file it
+ * was told about. Events for the files in those folders are collected
+ * until things quiet down, so that a file being written or a whole
+ * album being retagged comes out as one batch, with every file in it
+ * once. Only the last word on each file counts: one that was deleted
+ * and created again, as editors saving through a temporary file do,
+ * was changed.
+ **/
+
+/**
+ * Milliseconds without events before the collected ones are delivered,
+ * and the longest they are held back by a folder that keeps changing.
+ **/
+#define QUIET_PERIOD 500
+#define MAX_DELAY    5000
+
+G_DEFINE_TYPE (FolderWatcher,
+               folder_watcher,
+               G_TYPE_OBJECT);
+
+enum {
+        SIGNAL_FILES_CHANGED,
+        SIGNAL_FILES_DELETED,
+        SIGNAL_LAST
+};
+
+static guint signals[SIGNAL_LAST];
+
+typedef enum {
+        EVENT_CHANGED,
+        EVENT_DELETED
+} Event;
+
+struct _FolderWatcherPrivate {
+        GHashTable *monitors; /* Folder URI -> GFileMonitor, or NULL */
+
+        GHashTable *pending;  /* File URI -> Event */
+        guint       flush_id;
+        GTimeVal    first_event; /* Of those pending */
+};
+
+#define GET_PRIVATE(o) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
+                                      TYPE_FOLDER_WATCHER, \
+                                      FolderWatcherPrivate))
+
+static void
+free_monitor (GFileMonitor *monitor)
+{
+        if (!monitor)
+                return;
+
+        g_file_monitor_cancel (monitor);
+        g_object_unref (monitor);
+}
+
+static void
+folder_watcher_init (FolderWatcher *watcher)
+{
+        watcher->priv = GET_PRIVATE (watcher);
+
+        watcher->priv->monitors =
+                g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) free_monitor);
+
+        watcher->priv->pending =
+                g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       NULL);
+}
+
+static void
+folder_watcher_dispose (GObject *object)
+{
+        FolderWatcher *watcher;
+        GObjectClass *object_class;
+
+        watcher = FOLDER_WATCHER (object);
+
+        folder_watcher_clear (watcher);
+
+        object_class = G_OBJECT_CLASS (folder_watcher_parent_class);
+        object_class->dispose (object);
+}
+
+static void
+folder_watcher_finalize (GObject *object)
+{
+        FolderWatcher *watcher;
+        GObjectClass *object_class;
+
+        watcher = FOLDER_WATCHER (object);
+
+        g_hash_table_destroy (watcher->priv->monitors);
+        g_hash_table_destroy (watcher->priv->pending);
+
+        object_class = G_OBJECT_CLASS (folder_watcher_parent_class);
+        object_class->finalize (object);
+}
+
+static void
+folder_watcher_class_init (FolderWatcherClass *klass)
+{
+        GObjectClass *object_class;
+
+        object_class = G_OBJECT_CLASS (klass);
+
+        object_class->dispose  = folder_watcher_dispose;
+        object_class->finalize = folder_watcher_finalize;
+
+        g_type_class_add_private (klass, sizeof (FolderWatcherPrivate));
+
+        signals[SIGNAL_FILES_CHANGED] =
+                g_signal_new ("files-changed",
+                              TYPE_FOLDER_WATCHER,
+                              G_SIGNAL_RUN_LAST,
+                              G_STRUCT_OFFSET (FolderWatcherClass,
+                                               files_changed),
+                              NULL,
+                              NULL,
+                              gaku_marshal_VOID__POINTER_INT,
+                              G_TYPE_NONE,
+                              2,
+                              G_TYPE_POINTER,
+                              G_TYPE_INT);
+
+        signals[SIGNAL_FILES_DELETED] =
+                g_signal_new ("files-deleted",
+                              TYPE_FOLDER_WATCHER,
+                              G_SIGNAL_RUN_LAST,
+                              G_STRUCT_OFFSET (FolderWatcherClass,
+                                               files_deleted),
+                              NULL,
+                              NULL,
+                              gaku_marshal_VOID__POINTER_INT,
+                              G_TYPE_NONE,
+                              2,
+                              G_TYPE_POINTER,
+                              G_TYPE_INT);
+}
+
+/**
+ * folder_watcher_new
+ *
+ * Return value: A new #FolderWatcher.
+ **/
+FolderWatcher *
+folder_watcher_new (void)
+{
+        return g_object_new (TYPE_FOLDER_WATCHER, NULL);
+}
+
+static void
+sort_event (const char *uri,
+            gpointer    event,
+            GPtrArray **arrays)
+{
+        g_ptr_array_add (arrays[GPOINTER_TO_INT (event)], (gpointer) uri);
+}
+
+/**
+ * Delivers the events collected.
+ **/
+static gboolean
+flush (FolderWatcher *watcher)
+{
+        FolderWatcherPrivate *priv = watcher->priv;
+        GPtrArray *arrays[2];
+        GHashTable *pending;
+
+        priv->flush_id = 0;
+
+        /**
+         * Handlers might add URIs, which might bring in new events.
+         **/
+        pending = priv->pending;
+        priv->pending = g_hash_table_new_full (g_str_hash,
+                                               g_str_equal,
+                                               g_free,
+                                               NULL);
+
+        arrays[EVENT_CHANGED] = g_ptr_array_new ();
+        arrays[EVENT_DELETED] = g_ptr_array_new ();
+
+        g_hash_table_foreach (pending, (GHFunc) sort_event, arrays);
+
+        g_object_ref (watcher);
+
+        if (arrays[EVENT_DELETED]->len > 0) {
+                g_signal_emit (watcher,
+                               signals[SIGNAL_FILES_DELETED],
+                               0,
+                               arrays[EVENT_DELETED]->pdata,
+                               arrays[EVENT_DELETED]->len);
+        }
+
+        if (arrays[EVENT_CHANGED]->len > 0) {
+                g_signal_emit (watcher,
+                               signals[SIGNAL_FILES_CHANGED],
+                               0,
+                               arrays[EVENT_CHANGED]->pdata,
+                               arrays[EVENT_CHANGED]->len);
+        }
+
+        g_object_unref (watcher);
+
+        g_ptr_array_free (arrays[EVENT_CHANGED], TRUE);
+        g_ptr_array_free (arrays[EVENT_DELETED], TRUE);
+
+        g_hash_table_destroy (pending);
+
+        return FALSE;
+}
+
+/**
+ * Something happened in one of our folders.
+ **/
+static void
+monitor_changed_cb (GFileMonitor     *monitor,
+                    GFile            *file,
+                    GFile            *other_file,
+                    GFileMonitorEvent event_type,
+                    FolderWatcher    *watcher)
+{
+        FolderWatcherPrivate *priv = watcher->priv;
+        Event event;
+        glong delay;
+
+        switch (event_type) {
+        case G_FILE_MONITOR_EVENT_CHANGED:
+        case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+        case G_FILE_MONITOR_EVENT_CREATED:
+                event = EVENT_CHANGED;
+                break;
+        case G_FILE_MONITOR_EVENT_DELETED:
+                event = EVENT_DELETED;
+                break;
+        default:
+                return;
+        }
+
+        g_hash_table_replace (priv->pending,
+                              g_file_get_uri (file),
+                              GINT_TO_POINTER (event));
+
+        /**
+         * Wait for things to quiet down, but no longer than MAX_DELAY
+         * after the first event.
+         **/
+        if (priv->flush_id) {
+                GTimeVal now;
+                glong waited;
+
+                g_source_remove (priv->flush_id);
+
+                g_get_current_time (&now);
+                waited = (now.tv_sec - priv->first_event.tv_sec) * 1000 +
+                         (now.tv_usec - priv->first_event.tv_usec) / 1000;
+
+                delay = CLAMP (MAX_DELAY - waited, 0, QUIET_PERIOD);
+        } else {
+                g_get_current_time (&priv->first_event);
+
+                delay = QUIET_PERIOD;
+        }
+
+        priv->flush_id = g_timeout_add (delay,
+                                        (GSourceFunc) flush,
+                                        watcher);
+}
+
+/**
+ * folder_watcher_add_uri
+ * @watcher: A #FolderWatcher
+ * @uri: The URI of a file
+ *
+ * Starts watching the folder holding @uri, if not watched yet.
+ * 'files-changed' and 'files-deleted' are emitted for the files in
+ * watched folders that change or are deleted. Receivers should ignore
+ * the files they do not know about.
+ **/
+void
+folder_watcher_add_uri (FolderWatcher *watcher,
+                        const char    *uri)
+{
+        FolderWatcherPrivate *priv;
+        GFileMonitor *monitor;
+        GFile *folder;
+        GError *error;
+        const char *slash;
+        char *folder_uri;
+
+        g_return_if_fail (IS_FOLDER_WATCHER (watcher));
+        g_return_if_fail (uri != NULL);
+
+        priv = watcher->priv;
+
+        slash = strrchr (uri, '/');
+        if (!slash)
+                return;
+
+        folder_uri = g_strndup (uri, slash - uri);
+
+        if (g_hash_table_lookup_extended (priv->monitors,
+                                          folder_uri,
+                                          NULL,
+                                          NULL)) {
+                g_free (folder_uri);
+
+                return;
+        }
+
+        folder = g_file_new_for_uri (folder_uri);
+
+        error = NULL;
+        monitor = g_file_monitor_directory (folder,
+                                            G_FILE_MONITOR_NONE,
+                                            NULL,
+                                            &error);
+
+        g_object_unref (folder);
+
+        if (monitor) {
+                g_signal_connect (monitor,
+                                  "changed",
+                                  G_CALLBACK (monitor_changed_cb),
+                                  watcher);
+        } else {
+                /**
+                 * Remember, so that we do not try again for every file
+                 * in there.
+                 **/
+                g_debug ("Cannot watch %s: %s", folder_uri, error->message);
+
+                g_error_free (error);
+        }
+
+        g_hash_table_insert (priv->monitors, folder_uri, monitor);
+}
+
+/**
+ * folder_watcher_clear
+ * @watcher: A #FolderWatcher
+ *
+ * Stops watching all folders, and drops the events not delivered yet.
+ **/
+void
+folder_watcher_clear (FolderWatcher *watcher)
+{
+        FolderWatcherPrivate *priv;
+
+        g_return_if_fail (IS_FOLDER_WATCHER (watcher));
+
+        priv = watcher->priv;
+
+        g_hash_table_remove_all (priv->monitors);
+        g_hash_table_remove_all (priv->pending);
+
+        if (priv->flush_id) {
+                g_source_remove (priv->flush_id);
+                priv->flush_id = 0;
+        }
+}
+
+/**
+ * folder_watcher_get_n_folders
+ * @watcher: A #FolderWatcher
+ *
+ * Return value: The number of folders watched.
+ **/
+guint
+folder_watcher_get_n_folders (FolderWatcher *watcher)
+{
+        g_return_val_if_fail (IS_FOLDER_WATCHER (watcher), 0);
+
+        return g_hash_table_size (watcher->priv->monitors);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __FOLDER_WATCHER_H__
+#define __FOLDER_WATCHER_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_FOLDER_WATCHER \
+                (folder_watcher_get_type ())
+#define FOLDER_WATCHER(obj) \
+                (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                 TYPE_FOLDER_WATCHER, \
+                 FolderWatcher))
+#define FOLDER_WATCHER_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_CAST ((klass), \
+                 TYPE_FOLDER_WATCHER, \
+                 FolderWatcherClass))
+#define IS_FOLDER_WATCHER(obj) \
+                (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                 TYPE_FOLDER_WATCHER))
+#define IS_FOLDER_WATCHER_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                 TYPE_FOLDER_WATCHER))
+#define FOLDER_WATCHER_GET_CLASS(obj) \
+                (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+                 TYPE_FOLDER_WATCHER, \
+                 FolderWatcherClass))
+
+typedef struct _FolderWatcherPrivate FolderWatcherPrivate;
+
+typedef struct {
+        GObject parent;
+
+        FolderWatcherPrivate *priv;
+} FolderWatcher;
+
+typedef struct {
+        GObjectClass parent_class;
+
+        /* Signals */
+        void (* files_changed) (FolderWatcher *watcher,
+                                const char   **uris,
+                                int            n_uris);
+        void (* files_deleted) (FolderWatcher *watcher,
+                                const char   **uris,
+                                int            n_uris);
+
+        /* Future padding */
+        void (* _reserved1) (void);
+        void (* _reserved2) (void);
+        void (* _reserved3) (void);
+        void (* _reserved4) (void);
+} FolderWatcherClass;
+
+GType
+folder_watcher_get_type        (void) G_GNUC_CONST;
+
+FolderWatcher *
+folder_watcher_new             (void);
+
+void
+folder_watcher_add_uri         (FolderWatcher *watcher,
+                                const char    *uri);
+
+void
+folder_watcher_clear           (FolderWatcher *watcher);
+
+guint
+folder_watcher_get_n_folders   (FolderWatcher *watcher);
+
+G_END_DECLS
+
+#endif /* __FOLDER_WATCHER_H__ */
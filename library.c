@@ -0,0 +1,968 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "library.h"
+
+/**
+ * The library keeps every track it was told about in columns, one array
+ * per field, indexed by track ID. Strings live in a GStringChunk; album
+ * and artist names are interned there, and tracks refer to their album
+ * by ID, albums to their artist. Looking a track up by URI goes through
+ * an open addressing table of track IDs, hashed by URI.
+ *
+ * Albums and artists are kept as linked lists through the columns:
+ * every artist points to its first album, every album to the next album
+ * by the same artist and to its first and last tracks, and every track
+ * to the previous and next ones on the same album, ordered by track
+ * number. Getting all the tracks of an album or artist thus only visits
+ * those tracks. Tracks mostly come in order, or without a number, so
+ * they are linked in by walking back from the last one, and unlinked
+ * without walking at all.
+ *
+ * All of this takes about 44 bytes per track besides the strings.
+ *
+ * The file is written with library_save(). It holds the columns, with
+ * strings as offsets into a block of NUL-terminated strings at the end;
+ * the lists are rebuilt when loading.
+ **/
+
+#define NO_ID G_MAXUINT32
+
+#define FILE_MAGIC      "GAKULIBR"
+#define FILE_VERSION    1
+#define FILE_BYTE_ORDER 0x01020304
+
+typedef struct {
+        char    magic[8];
+        guint32 version;
+        guint32 byte_order; /* FILE_BYTE_ORDER as written */
+        guint32 n_tracks;
+        guint32 n_albums;
+        guint32 n_artists;
+        guint32 strings_length;
+} FileHeader;
+
+typedef struct {
+        guint32 uri;    /* String offset */
+        guint32 title;  /* String offset, or NO_ID */
+        guint32 album;
+        gint32  duration;
+        guint32 track_number;
+} FileTrack;
+
+typedef struct {
+        guint32 name;   /* String offset */
+        guint32 artist;
+} FileAlbum;
+
+typedef struct {
+        guint32 name;   /* String offset */
+} FileArtist;
+
+typedef struct {
+        const char *name;
+        guint32     artist;
+        guint32     first_track;
+        guint32     last_track;
+        guint32     next_album;  /* By the same artist */
+} Album;
+
+typedef struct {
+        const char *name;
+        guint32     first_album;
+} Artist;
+
+G_DEFINE_TYPE (Library,
+               library,
+               G_TYPE_OBJECT);
+
+struct _LibraryPrivate {
+        char         *filename;
+
+        GStringChunk *strings;
+
+        /**
+         * Track columns.
+         **/
+        GArray       *uris;          /* const char * */
+        GArray       *titles;        /* const char *, or NULL */
+        GArray       *albums;        /* guint32 */
+        GArray       *durations;     /* gint32, in seconds or -1 */
+        GArray       *track_numbers; /* guint16, or 0 */
+        GArray       *next_tracks;   /* guint32, on the same album */
+        GArray       *prev_tracks;   /* guint32, on the same album */
+
+        /**
+         * Track IDs hashed by URI, NO_ID where free. The number of
+         * slots is a power of two, at least twice the number of tracks.
+         **/
+        guint32      *slots;
+        guint32       n_slots;
+
+        GArray       *album_list;    /* Album */
+        GArray       *artist_list;   /* Artist */
+        GHashTable   *artist_index;  /* Name -> artist ID + 1 */
+
+        gboolean      dirty;
+};
+
+#define GET_PRIVATE(o) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
+                                      TYPE_LIBRARY, \
+                                      LibraryPrivate))
+
+#define TRACK_URI(priv, id) \
+        g_array_index ((priv)->uris, const char *, (id))
+#define TRACK_TITLE(priv, id) \
+        g_array_index ((priv)->titles, const char *, (id))
+#define TRACK_ALBUM(priv, id) \
+        g_array_index ((priv)->albums, guint32, (id))
+#define TRACK_NUMBER(priv, id) \
+        g_array_index ((priv)->track_numbers, guint16, (id))
+#define TRACK_NEXT(priv, id) \
+        g_array_index ((priv)->next_tracks, guint32, (id))
+#define TRACK_PREV(priv, id) \
+        g_array_index ((priv)->prev_tracks, guint32, (id))
+
+#define ALBUM(priv, id) \
+        (&g_array_index ((priv)->album_list, Album, (id)))
+#define ARTIST(priv, id) \
+        (&g_array_index ((priv)->artist_list, Artist, (id)))
+
+static void
+library_init (Library *library)
+{
+        LibraryPrivate *priv;
+
+        priv = library->priv = GET_PRIVATE (library);
+
+        priv->strings = g_string_chunk_new (64 * 1024);
+
+        priv->uris          = g_array_new (FALSE, FALSE, sizeof (char *));
+        priv->titles        = g_array_new (FALSE, FALSE, sizeof (char *));
+        priv->albums        = g_array_new (FALSE, FALSE, sizeof (guint32));
+        priv->durations     = g_array_new (FALSE, FALSE, sizeof (gint32));
+        priv->track_numbers = g_array_new (FALSE, FALSE, sizeof (guint16));
+        priv->next_tracks   = g_array_new (FALSE, FALSE, sizeof (guint32));
+        priv->prev_tracks   = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+        priv->album_list  = g_array_new (FALSE, FALSE, sizeof (Album));
+        priv->artist_list = g_array_new (FALSE, FALSE, sizeof (Artist));
+
+        priv->artist_index = g_hash_table_new (g_str_hash, g_str_equal);
+}
+
+static void
+library_finalize (GObject *object)
+{
+        Library *library;
+        LibraryPrivate *priv;
+        GObjectClass *object_class;
+
+        library = LIBRARY (object);
+        priv = library->priv;
+
+        g_hash_table_destroy (priv->artist_index);
+
+        g_array_free (priv->uris, TRUE);
+        g_array_free (priv->titles, TRUE);
+        g_array_free (priv->albums, TRUE);
+        g_array_free (priv->durations, TRUE);
+        g_array_free (priv->track_numbers, TRUE);
+        g_array_free (priv->next_tracks, TRUE);
+        g_array_free (priv->prev_tracks, TRUE);
+
+        g_array_free (priv->album_list, TRUE);
+        g_array_free (priv->artist_list, TRUE);
+
+        g_free (priv->slots);
+
+        g_string_chunk_free (priv->strings);
+
+        g_free (priv->filename);
+
+        object_class = G_OBJECT_CLASS (library_parent_class);
+        object_class->finalize (object);
+}
+
+static void
+library_class_init (LibraryClass *klass)
+{
+        GObjectClass *object_class;
+
+        object_class = G_OBJECT_CLASS (klass);
+
+        object_class->finalize = library_finalize;
+
+        g_type_class_add_private (klass, sizeof (LibraryPrivate));
+}
+
+/**
+ * Returns the slot for @uri: the one holding its track, or the free
+ * one it would go into.
+ **/
+static guint32
+find_slot (LibraryPrivate *priv,
+           const char     *uri)
+{
+        guint32 mask, slot;
+
+        mask = priv->n_slots - 1;
+
+        for (slot = g_str_hash (uri) & mask;
+             priv->slots[slot] != NO_ID;
+             slot = (slot + 1) & mask) {
+                if (!strcmp (TRACK_URI (priv, priv->slots[slot]), uri))
+                        break;
+        }
+
+        return slot;
+}
+
+/**
+ * Makes room for @n_tracks tracks in the URI table.
+ **/
+static void
+reserve_slots (LibraryPrivate *priv,
+               guint32         n_tracks)
+{
+        guint32 i;
+
+        if (priv->n_slots >= 2 * n_tracks && priv->n_slots > 0)
+                return;
+
+        g_free (priv->slots);
+
+        priv->n_slots = MAX (priv->n_slots, 64);
+        while (priv->n_slots < 2 * n_tracks)
+                priv->n_slots *= 2;
+
+        priv->slots = g_new (guint32, priv->n_slots);
+        memset (priv->slots, 0xff, priv->n_slots * sizeof (guint32));
+
+        for (i = 0; i < priv->uris->len; i++)
+                priv->slots[find_slot (priv, TRACK_URI (priv, i))] = i;
+}
+
+static guint32
+lookup_track (LibraryPrivate *priv,
+              const char     *uri)
+{
+        if (priv->n_slots == 0)
+                return NO_ID;
+
+        return priv->slots[find_slot (priv, uri)];
+}
+
+/**
+ * Returns the ID of the artist called @name, adding it if new.
+ **/
+static guint32
+get_artist (LibraryPrivate *priv,
+            const char     *name)
+{
+        Artist artist;
+        gpointer id;
+
+        id = g_hash_table_lookup (priv->artist_index, name);
+        if (id)
+                return GPOINTER_TO_UINT (id) - 1;
+
+        artist.name = g_string_chunk_insert_const (priv->strings, name);
+        artist.first_album = NO_ID;
+
+        g_array_append_val (priv->artist_list, artist);
+
+        g_hash_table_insert (priv->artist_index,
+                             (gpointer) artist.name,
+                             GUINT_TO_POINTER (priv->artist_list->len));
+
+        return priv->artist_list->len - 1;
+}
+
+/**
+ * Returns the ID of the album called @name by @artist, adding it if new.
+ * Artists have few albums; looking through them is cheap.
+ **/
+static guint32
+get_album (LibraryPrivate *priv,
+           const char     *name,
+           guint32         artist)
+{
+        Album album;
+        guint32 id;
+
+        for (id = ARTIST (priv, artist)->first_album;
+             id != NO_ID;
+             id = ALBUM (priv, id)->next_album) {
+                if (!strcmp (ALBUM (priv, id)->name, name))
+                        return id;
+        }
+
+        album.name        = g_string_chunk_insert_const (priv->strings, name);
+        album.artist      = artist;
+        album.first_track = NO_ID;
+        album.last_track  = NO_ID;
+        album.next_album  = ARTIST (priv, artist)->first_album;
+
+        g_array_append_val (priv->album_list, album);
+
+        id = priv->album_list->len - 1;
+        ARTIST (priv, artist)->first_album = id;
+
+        return id;
+}
+
+/**
+ * Links track @id into the track list of its album, by track number,
+ * after the tracks with the same number.
+ **/
+static void
+link_track (LibraryPrivate *priv,
+            guint32         id)
+{
+        Album *album;
+        guint32 prev, next;
+
+        album = ALBUM (priv, TRACK_ALBUM (priv, id));
+
+        prev = album->last_track;
+        while (prev != NO_ID &&
+               TRACK_NUMBER (priv, prev) > TRACK_NUMBER (priv, id))
+                prev = TRACK_PREV (priv, prev);
+
+        next = (prev != NO_ID) ? TRACK_NEXT (priv, prev) : album->first_track;
+
+        TRACK_PREV (priv, id) = prev;
+        TRACK_NEXT (priv, id) = next;
+
+        if (prev != NO_ID)
+                TRACK_NEXT (priv, prev) = id;
+        else
+                album->first_track = id;
+
+        if (next != NO_ID)
+                TRACK_PREV (priv, next) = id;
+        else
+                album->last_track = id;
+}
+
+static void
+unlink_track (LibraryPrivate *priv,
+              guint32         id)
+{
+        Album *album;
+        guint32 prev, next;
+
+        album = ALBUM (priv, TRACK_ALBUM (priv, id));
+
+        prev = TRACK_PREV (priv, id);
+        next = TRACK_NEXT (priv, id);
+
+        if (prev != NO_ID)
+                TRACK_NEXT (priv, prev) = next;
+        else
+                album->first_track = next;
+
+        if (next != NO_ID)
+                TRACK_PREV (priv, next) = prev;
+        else
+                album->last_track = prev;
+}
+
+/**
+ * Adds or updates the track for @uri.
+ **/
+static void
+store (LibraryPrivate *priv,
+       const char     *uri,
+       const char     *title,
+       guint32         album,
+       int             track_number,
+       int             duration)
+{
+        guint32 id, slot;
+        gint32 duration32 = duration;
+        guint16 track_number16 = CLAMP (track_number, 0, G_MAXUINT16);
+
+        reserve_slots (priv, priv->uris->len + 1);
+
+        slot = find_slot (priv, uri);
+        id = priv->slots[slot];
+
+        if (id == NO_ID) {
+                guint32 none = NO_ID;
+                const char *no_title = NULL;
+
+                uri = g_string_chunk_insert (priv->strings, uri);
+
+                id = priv->uris->len;
+                priv->slots[slot] = id;
+
+                g_array_append_val (priv->uris, uri);
+                g_array_append_val (priv->titles, no_title);
+                g_array_append_val (priv->albums, album);
+                g_array_append_val (priv->durations, duration32);
+                g_array_append_val (priv->track_numbers, track_number16);
+                g_array_append_val (priv->next_tracks, none);
+                g_array_append_val (priv->prev_tracks, none);
+        } else
+                unlink_track (priv, id);
+
+        /**
+         * Titles replaced here stay in the string chunk until the
+         * library is loaded again.
+         **/
+        if (title && (!TRACK_TITLE (priv, id) ||
+                      strcmp (TRACK_TITLE (priv, id), title))) {
+                title = g_string_chunk_insert (priv->strings, title);
+        } else if (title)
+                title = TRACK_TITLE (priv, id);
+
+        TRACK_TITLE (priv, id)  = title;
+        TRACK_ALBUM (priv, id)  = album;
+        TRACK_NUMBER (priv, id) = track_number16;
+        g_array_index (priv->durations, gint32, id) = duration32;
+
+        link_track (priv, id);
+}
+
+/**
+ * Returns the string at @offset in the @length bytes at @strings, or
+ * NULL if @offset is out of range. @strings ends in a NUL.
+ **/
+static const char *
+get_string (const char *strings,
+            guint32     length,
+            guint32     offset)
+{
+        if (offset >= length)
+                return NULL;
+
+        return strings + offset;
+}
+
+/**
+ * Loads the library file, if there is a valid one. Cannot be trusted.
+ **/
+static void
+load (LibraryPrivate *priv)
+{
+        const FileHeader *header;
+        const FileTrack *tracks;
+        const FileAlbum *albums;
+        const FileArtist *artists;
+        const char *strings;
+        guint32 *album_ids;
+        char *data;
+        gsize length, needed;
+        guint32 i;
+
+        if (!g_file_get_contents (priv->filename, &data, &length, NULL))
+                return;
+
+        header = (const FileHeader *) data;
+
+        if (length < sizeof (FileHeader) ||
+            memcmp (header->magic, FILE_MAGIC, sizeof (header->magic)) ||
+            header->version != FILE_VERSION ||
+            header->byte_order != FILE_BYTE_ORDER) {
+                g_free (data);
+
+                return;
+        }
+
+        needed = sizeof (FileHeader) +
+                 (gsize) header->n_tracks * sizeof (FileTrack) +
+                 (gsize) header->n_albums * sizeof (FileAlbum) +
+                 (gsize) header->n_artists * sizeof (FileArtist) +
+                 header->strings_length;
+
+        if (needed != length || header->strings_length == 0) {
+                g_free (data);
+
+                return;
+        }
+
+        tracks  = (const FileTrack *) (header + 1);
+        albums  = (const FileAlbum *) (tracks + header->n_tracks);
+        artists = (const FileArtist *) (albums + header->n_albums);
+        strings = (const char *) (artists + header->n_artists);
+
+        if (strings[header->strings_length - 1] != '\0') {
+                g_free (data);
+
+                return;
+        }
+
+        /**
+         * Artists and albums are interned again; map the album IDs in
+         * the file to ours. Anything out of range is left out.
+         **/
+        album_ids = g_new (guint32, header->n_albums);
+
+        for (i = 0; i < header->n_albums; i++) {
+                const char *name, *artist;
+
+                album_ids[i] = NO_ID;
+
+                name = get_string (strings,
+                                   header->strings_length,
+                                   albums[i].name);
+                if (!name || albums[i].artist >= header->n_artists)
+                        continue;
+
+                artist = get_string (strings,
+                                     header->strings_length,
+                                     artists[albums[i].artist].name);
+                if (!artist)
+                        continue;
+
+                album_ids[i] = get_album (priv,
+                                          name,
+                                          get_artist (priv, artist));
+        }
+
+        reserve_slots (priv, header->n_tracks);
+
+        for (i = 0; i < header->n_tracks; i++) {
+                const char *uri, *title;
+
+                uri = get_string (strings,
+                                  header->strings_length,
+                                  tracks[i].uri);
+                title = get_string (strings,
+                                    header->strings_length,
+                                    tracks[i].title);
+
+                if (!uri ||
+                    tracks[i].album >= header->n_albums ||
+                    album_ids[tracks[i].album] == NO_ID)
+                        continue;
+
+                store (priv,
+                       uri,
+                       title,
+                       album_ids[tracks[i].album],
+                       tracks[i].track_number,
+                       tracks[i].duration);
+        }
+
+        g_free (album_ids);
+        g_free (data);
+}
+
+/**
+ * library_new
+ * @filename: The library file
+ *
+ * Return value: A new #Library, holding what is in @filename if it is a
+ * valid library file.
+ **/
+Library *
+library_new (const char *filename)
+{
+        Library *library;
+
+        g_return_val_if_fail (filename != NULL, NULL);
+
+        library = g_object_new (TYPE_LIBRARY, NULL);
+
+        library->priv->filename = g_strdup (filename);
+
+        load (library->priv);
+
+        return library;
+}
+
+/**
+ * library_store
+ * @library: A #Library
+ * @uri: An URI
+ * @title: The title, or NULL
+ * @artist: The artist, or NULL
+ * @album: The album, or NULL
+ * @track_number: The number of the track on @album, or 0
+ * @duration: The duration in seconds, or -1
+ *
+ * Adds the track @uri to @library, or updates it.
+ **/
+void
+library_store (Library    *library,
+               const char *uri,
+               const char *title,
+               const char *artist,
+               const char *album,
+               int         track_number,
+               int         duration)
+{
+        LibraryPrivate *priv;
+
+        g_return_if_fail (IS_LIBRARY (library));
+        g_return_if_fail (uri != NULL);
+
+        priv = library->priv;
+
+        store (priv,
+               uri,
+               title,
+               get_album (priv,
+                          album ? album : "",
+                          get_artist (priv, artist ? artist : "")),
+               track_number,
+               duration);
+
+        priv->dirty = TRUE;
+}
+
+static const char *
+empty_to_null (const char *str)
+{
+        return (str && str[0] != '\0') ? str : NULL;
+}
+
+/**
+ * library_lookup
+ * @library: A #Library
+ * @uri: An URI
+ * @title: Return location for the title, or NULL
+ * @artist: Return location for the artist, or NULL
+ * @album: Return location for the album, or NULL
+ * @duration: Return location for the duration in seconds, or NULL
+ *
+ * Looks up the track @uri. Returned strings are NULL if unknown, and
+ * owned by @library.
+ *
+ * Return value: TRUE if @uri is in @library.
+ **/
+gboolean
+library_lookup (Library     *library,
+                const char  *uri,
+                const char **title,
+                const char **artist,
+                const char **album,
+                int         *duration)
+{
+        LibraryPrivate *priv;
+        Album *album_data;
+        guint32 id;
+
+        g_return_val_if_fail (IS_LIBRARY (library), FALSE);
+        g_return_val_if_fail (uri != NULL, FALSE);
+
+        priv = library->priv;
+
+        id = lookup_track (priv, uri);
+        if (id == NO_ID)
+                return FALSE;
+
+        album_data = ALBUM (priv, TRACK_ALBUM (priv, id));
+
+        if (title)
+                *title = TRACK_TITLE (priv, id);
+        if (artist)
+                *artist = empty_to_null (ARTIST (priv,
+                                                 album_data->artist)->name);
+        if (album)
+                *album = empty_to_null (album_data->name);
+        if (duration)
+                *duration = g_array_index (priv->durations, gint32, id);
+
+        return TRUE;
+}
+
+/**
+ * Appends the tracks on album @album to the arrays.
+ **/
+static void
+get_tracks (LibraryPrivate *priv,
+            guint32         album,
+            GPtrArray      *uris,
+            GPtrArray      *titles,
+            GPtrArray      *artists)
+{
+        const char *artist;
+        guint32 id;
+
+        artist = empty_to_null (ARTIST (priv, ALBUM (priv, album)->artist)->name);
+
+        for (id = ALBUM (priv, album)->first_track;
+             id != NO_ID;
+             id = TRACK_NEXT (priv, id)) {
+                g_ptr_array_add (uris, (gpointer) TRACK_URI (priv, id));
+
+                if (titles) {
+                        g_ptr_array_add (titles,
+                                         (gpointer) TRACK_TITLE (priv, id));
+                }
+
+                if (artists)
+                        g_ptr_array_add (artists, (gpointer) artist);
+        }
+}
+
+/**
+ * library_get_album_tracks
+ * @library: A #Library
+ * @uri: An URI
+ * @uris: A #GPtrArray to append the URIs to
+ * @titles: A #GPtrArray to append the titles to, or NULL
+ * @artists: A #GPtrArray to append the artists to, or NULL
+ *
+ * Appends the tracks on the album @uri is on, ordered by track number.
+ * Strings are owned by @library, and NULL where unknown. Only the
+ * tracks of the album are visited.
+ *
+ * Return value: TRUE if @uri is in @library.
+ **/
+gboolean
+library_get_album_tracks (Library    *library,
+                          const char *uri,
+                          GPtrArray  *uris,
+                          GPtrArray  *titles,
+                          GPtrArray  *artists)
+{
+        guint32 id;
+
+        g_return_val_if_fail (IS_LIBRARY (library), FALSE);
+        g_return_val_if_fail (uri != NULL, FALSE);
+        g_return_val_if_fail (uris != NULL, FALSE);
+
+        id = lookup_track (library->priv, uri);
+        if (id == NO_ID)
+                return FALSE;
+
+        get_tracks (library->priv,
+                    TRACK_ALBUM (library->priv, id),
+                    uris,
+                    titles,
+                    artists);
+
+        return TRUE;
+}
+
+/**
+ * library_get_artist_tracks
+ * @library: A #Library
+ * @uri: An URI
+ * @uris: A #GPtrArray to append the URIs to
+ * @titles: A #GPtrArray to append the titles to, or NULL
+ * @artists: A #GPtrArray to append the artists to, or NULL
+ *
+ * Appends all tracks by the artist of @uri, album by album, the album
+ * seen last first. Strings are owned by @library, and NULL where
+ * unknown. Only the tracks by the artist are visited.
+ *
+ * Return value: TRUE if @uri is in @library.
+ **/
+gboolean
+library_get_artist_tracks (Library    *library,
+                           const char *uri,
+                           GPtrArray  *uris,
+                           GPtrArray  *titles,
+                           GPtrArray  *artists)
+{
+        LibraryPrivate *priv;
+        guint32 id, album;
+
+        g_return_val_if_fail (IS_LIBRARY (library), FALSE);
+        g_return_val_if_fail (uri != NULL, FALSE);
+        g_return_val_if_fail (uris != NULL, FALSE);
+
+        priv = library->priv;
+
+        id = lookup_track (priv, uri);
+        if (id == NO_ID)
+                return FALSE;
+
+        for (album = ALBUM (priv, TRACK_ALBUM (priv, id))->artist,
+             album = ARTIST (priv, album)->first_album;
+             album != NO_ID;
+             album = ALBUM (priv, album)->next_album)
+                get_tracks (priv, album, uris, titles, artists);
+
+        return TRUE;
+}
+
+/**
+ * library_get_n_tracks
+ * @library: A #Library
+ *
+ * Return value: The number of tracks in @library.
+ **/
+guint
+library_get_n_tracks (Library *library)
+{
+        g_return_val_if_fail (IS_LIBRARY (library), 0);
+
+        return library->priv->uris->len;
+}
+
+typedef struct {
+        GByteArray *strings;
+        GHashTable *offsets; /* Strings -> offset + 1 */
+} StringWriter;
+
+/**
+ * Returns the offset of @str in the strings being written, adding it
+ * if new.
+ **/
+static guint32
+write_string (StringWriter *writer,
+              const char   *str)
+{
+        gpointer offset;
+
+        if (!str)
+                return NO_ID;
+
+        offset = g_hash_table_lookup (writer->offsets, str);
+        if (offset)
+                return GPOINTER_TO_UINT (offset) - 1;
+
+        offset = GUINT_TO_POINTER (writer->strings->len + 1);
+
+        g_byte_array_append (writer->strings,
+                             (const guint8 *) str,
+                             strlen (str) + 1);
+
+        g_hash_table_insert (writer->offsets, (gpointer) str, offset);
+
+        return GPOINTER_TO_UINT (offset) - 1;
+}
+
+/**
+ * library_save
+ * @library: A #Library
+ * @error: Location where to store a #GError if an error occurs.
+ *
+ * Writes @library to its file, if anything was stored. The file is
+ * replaced atomically.
+ *
+ * Return value: TRUE on success, FALSE if an error occured in which case
+ * @error is set as well.
+ **/
+gboolean
+library_save (Library *library,
+              GError **error)
+{
+        LibraryPrivate *priv;
+        StringWriter writer;
+        FileHeader header;
+        GByteArray *buffer;
+        char *dirname;
+        gboolean ret;
+        guint32 i;
+
+        g_return_val_if_fail (IS_LIBRARY (library), FALSE);
+
+        priv = library->priv;
+
+        if (!priv->dirty)
+                return TRUE;
+
+        writer.strings = g_byte_array_new ();
+        writer.offsets = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+        memset (&header, 0, sizeof (FileHeader));
+        memcpy (header.magic, FILE_MAGIC, sizeof (header.magic));
+        header.version    = FILE_VERSION;
+        header.byte_order = FILE_BYTE_ORDER;
+        header.n_tracks   = priv->uris->len;
+        header.n_albums   = priv->album_list->len;
+        header.n_artists  = priv->artist_list->len;
+
+        buffer = g_byte_array_new ();
+        g_byte_array_append (buffer,
+                             (const guint8 *) &header,
+                             sizeof (FileHeader));
+
+        /**
+         * Interned strings are shared; so are their offsets.
+         **/
+        for (i = 0; i < priv->uris->len; i++) {
+                FileTrack track;
+
+                track.uri          = write_string (&writer,
+                                                   TRACK_URI (priv, i));
+                track.title        = write_string (&writer,
+                                                   TRACK_TITLE (priv, i));
+                track.album        = TRACK_ALBUM (priv, i);
+                track.duration     = g_array_index (priv->durations,
+                                                    gint32, i);
+                track.track_number = TRACK_NUMBER (priv, i);
+
+                g_byte_array_append (buffer,
+                                     (const guint8 *) &track,
+                                     sizeof (FileTrack));
+        }
+
+        for (i = 0; i < priv->album_list->len; i++) {
+                FileAlbum album;
+
+                album.name   = write_string (&writer, ALBUM (priv, i)->name);
+                album.artist = ALBUM (priv, i)->artist;
+
+                g_byte_array_append (buffer,
+                                     (const guint8 *) &album,
+                                     sizeof (FileAlbum));
+        }
+
+        for (i = 0; i < priv->artist_list->len; i++) {
+                FileArtist artist;
+
+                artist.name = write_string (&writer, ARTIST (priv, i)->name);
+
+                g_byte_array_append (buffer,
+                                     (const guint8 *) &artist,
+                                     sizeof (FileArtist));
+        }
+
+        /**
+         * Never empty, so that the last byte is always a NUL.
+         **/
+        g_byte_array_append (writer.strings, (const guint8 *) "", 1);
+
+        ((FileHeader *) buffer->data)->strings_length = writer.strings->len;
+
+        g_byte_array_append (buffer,
+                             writer.strings->data,
+                             writer.strings->len);
+
+        dirname = g_path_get_dirname (priv->filename);
+        g_mkdir_with_parents (dirname, 0755);
+        g_free (dirname);
+
+        ret = g_file_set_contents (priv->filename,
+                                   (const char *) buffer->data,
+                                   buffer->len,
+                                   error);
+
+        g_byte_array_free (buffer, TRUE);
+        g_byte_array_free (writer.strings, TRUE);
+        g_hash_table_destroy (writer.offsets);
+
+        if (ret)
+                priv->dirty = FALSE;
+
+        return ret;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __LIBRARY_H__
+#define __LIBRARY_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_LIBRARY \
+                (library_get_type ())
+#define LIBRARY(obj) \
+                (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                 TYPE_LIBRARY, \
+                 Library))
+#define LIBRARY_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_CAST ((klass), \
+                 TYPE_LIBRARY, \
+                 LibraryClass))
+#define IS_LIBRARY(obj) \
+                (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                 TYPE_LIBRARY))
+#define IS_LIBRARY_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                 TYPE_LIBRARY))
+#define LIBRARY_GET_CLASS(obj) \
+                (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+                 TYPE_LIBRARY, \
+                 LibraryClass))
+
+typedef struct _LibraryPrivate LibraryPrivate;
+
+typedef struct {
+        GObject parent;
+
+        LibraryPrivate *priv;
+} Library;
+
+typedef struct {
+        GObjectClass parent_class;
+
+        /* Future padding */
+        void (* _reserved1) (void);
+        void (* _reserved2) (void);
+        void (* _reserved3) (void);
+        void (* _reserved4) (void);
+} LibraryClass;
+
+GType
+library_get_type          (void) G_GNUC_CONST;
+
+Library *
+library_new               (const char *filename);
+
+void
+library_store             (Library    *library,
+                           const char *uri,
+                           const char *title,
+                           const char *artist,
+                           const char *album,
+                           int         track_number,
+                           int         duration);
+
+gboolean
+library_lookup            (Library     *library,
+                           const char  *uri,
+                           const char **title,
+                           const char **artist,
+                           const char **album,
+                           int         *duration);
+
+gboolean
+library_get_album_tracks  (Library    *library,
+                           const char *uri,
+                           GPtrArray  *uris,
+                           GPtrArray  *titles,
+                           GPtrArray  *artists);
+
+gboolean
+library_get_artist_tracks (Library    *library,
+                           const char *uri,
+                           GPtrArray  *uris,
+                           GPtrArray  *titles,
+                           GPtrArray  *artists);
+
+guint
+library_get_n_tracks      (Library    *library);
+
+gboolean
+library_save              (Library    *library,
+                           GError    **error);
+
+G_END_DECLS
+
+#endif /* __LIBRARY_H__ */
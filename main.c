@@ -21,19 +21,53 @@
 
 #include <gst/gst.h>
 #include <gtk/gtk.h>
-#include <libowl-av/owl-audio-player.h>
-#include <libowl-av/owl-tag-reader.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "audio-player.h"
+#include "folder-scanner.h"
+#include "folder-watcher.h"
+#include "library.h"
+#include "playlist-model.h"
 #include "playlist-parser.h"
+#include "playlist-writer.h"
+#include "prefetcher.h"
+#include "search-index.h"
+#include "search-model.h"
+#include "tag-cache.h"
+#include "tag-scheduler.h"
 
 typedef struct {
         /**
          * Our special objects.
          **/
-        OwlAudioPlayer *audio_player;
+        AudioPlayer    *audio_player;
         PlaylistParser *playlist_parser;
-        OwlTagReader   *tag_reader;
+        TagScheduler   *tag_scheduler;
+        TagCache       *tag_cache;
+        Library        *library;
+        SearchIndex    *search_index;
+        Prefetcher     *prefetcher;
+        FolderScanner  *folder_scanner;
+        FolderWatcher  *folder_watcher; /* NULL unless watching */
+
+        /**
+         * Idle source reprioritizing tag scans, or 0.
+         **/
+        guint prioritize_scans_id;
+
+        /**
+         * Idle source telling the audio player and the prefetcher what
+         * plays next, or 0.
+         **/
+        guint update_upcoming_id;
+
+        /**
+         * Tag scan results waiting to be applied to the playlist, and
+         * the timeout applying them, or 0.
+         **/
+        GQueue *scan_results;
+        guint   scan_results_id;
 
         /**
          * UI objects.
@@ -43,46 +77,88 @@ typedef struct {
         GtkWidget *previous_button;
         GtkWidget *next_button;
         GtkWidget *tree_view;
+        GtkWidget *search_entry;
+
+        PlaylistModel *model;
+
+        /**
+         * The rows matching the search, shown instead of @model, or
+         * NULL if not searching, and the idle source adding the rest of
+         * them while the search index has more to look at, or 0.
+         **/
+        SearchModel *search_model;
+        guint        search_more_id;
+
+        /**
+         * Attribute lists making the first n bytes of a row's text bold,
+         * indexed by n. Shared by all rows with equally long titles.
+         **/
+        GPtrArray *bold_attrs;
 
-        GtkListStore *list_store;
-        GtkTreeRowReference *playing_row;
+        /**
+         * URIs collected while loading a playlist or parsing the command
+         * line, added in one batch afterwards, with their titles and
+         * artists if the playlist told us.
+         **/
+        GPtrArray *pending_uris;
+        GPtrArray *pending_titles;
+        GPtrArray *pending_artists;
+
+        /**
+         * Cancels the playlist being loaded, if any.
+         **/
+        GCancellable *playlist_cancellable;
+
+        /**
+         * Cancels the folders being imported, if any.
+         **/
+        GCancellable *folder_cancellable;
 
         char *last_folder;
+
+        /**
+         * Whether to start over after the last song.
+         **/
+        gboolean repeat;
 } AppData;
 
-enum {
-        COL_TITLE,
-        COL_ARTIST,
-        COL_URI
-};
+/**
+ * Returns the model shown by the tree view.
+ **/
+static GtkTreeModel *
+get_view_model (AppData *data)
+{
+        if (data->search_model)
+                return GTK_TREE_MODEL (data->search_model);
+
+        return GTK_TREE_MODEL (data->model);
+}
 
 /**
- * Returns TRUE if @iter is the currently playing row.
+ * Sets @iter to the row that plays after it, starting over at the first
+ * one if repeating.
  **/
 static gboolean
-iter_is_playing_row (AppData     *data,
-                     GtkTreeIter *iter)
+iter_next_playing (AppData     *data,
+                   GtkTreeIter *iter)
 {
-        GtkTreePath *path, *playing_path;
-        gboolean retval;
-
-        if (!data->playing_row)
-                return FALSE;
+        if (playlist_model_next_in_order (data->model, iter))
+                return TRUE;
 
-        playing_path = gtk_tree_row_reference_get_path (data->playing_row);
-        if (playing_path == NULL)
-                /* The currently playing row has been deleted */
+        if (!data->repeat)
                 return FALSE;
 
-        path = gtk_tree_model_get_path (GTK_TREE_MODEL (data->list_store),
-                                        iter);
-
-        retval = (gtk_tree_path_compare (path, playing_path) == 0);
-
-        gtk_tree_path_free (playing_path);
-        gtk_tree_path_free (path);
+        return playlist_model_first_in_order (data->model, iter);
+}
 
-        return retval;
+/**
+ * Returns TRUE if @iter is the currently playing row.
+ **/
+static gboolean
+iter_is_playing_row (AppData     *data,
+                     GtkTreeIter *iter)
+{
+        return playlist_model_iter_is_playing (data->model, iter);
 }
 
 static void
@@ -100,72 +176,184 @@ update_title (AppData *data, const char *title)
 }
 
 /**
- * Set @iter to be the playing row.
+ * Number of rows past the playing one whose scans are moved up, as they
+ * will be playing soon.
+ **/
+#define N_UPCOMING 1
+
+/**
+ * Moves the tag scans for the playing row, the rows about to play and
+ * the visible rows to the front of the queue.
+ **/
+static gboolean
+prioritize_scans (AppData *data)
+{
+        GtkTreePath *start, *end;
+        GtkTreeIter iter;
+        GPtrArray *uris;
+        int i;
+
+        data->prioritize_scans_id = 0;
+
+        if (tag_scheduler_get_n_pending (data->tag_scheduler) == 0)
+                return FALSE;
+
+        uris = g_ptr_array_new ();
+
+        if (playlist_model_get_playing (data->model, &iter)) {
+                i = 0;
+                do {
+                        g_ptr_array_add (uris, (gpointer)
+                                playlist_model_get_uri (data->model, &iter));
+                } while (i++ < N_UPCOMING &&
+                         iter_next_playing (data, &iter));
+        }
+
+        if (gtk_tree_view_get_visible_range (GTK_TREE_VIEW (data->tree_view),
+                                             &start,
+                                             &end)) {
+                GtkTreeModel *view_model = get_view_model (data);
+                int first, last;
+
+                first = gtk_tree_path_get_indices (start)[0];
+                last  = gtk_tree_path_get_indices (end)[0];
+
+                if (gtk_tree_model_iter_nth_child (view_model,
+                                                   &iter,
+                                                   NULL,
+                                                   first)) {
+                        i = first;
+                        do {
+                                g_ptr_array_add (uris, (gpointer)
+                                        playlist_model_get_uri (data->model,
+                                                                &iter));
+                        } while (i++ < last &&
+                                 gtk_tree_model_iter_next (view_model,
+                                                           &iter));
+                }
+
+                gtk_tree_path_free (start);
+                gtk_tree_path_free (end);
+        }
+
+        tag_scheduler_prioritize (data->tag_scheduler,
+                                  (const char **) uris->pdata,
+                                  uris->len);
+
+        g_ptr_array_free (uris, TRUE);
+
+        return FALSE;
+}
+
+/**
+ * Reprioritizes the tag scans once the current batch of changes is
+ * done.
  **/
 static void
-set_playing_row (AppData     *data,
-                 GtkTreeIter *iter)
+schedule_prioritize_scans (AppData *data)
 {
-        GtkTreeModel *tree_model;
-        GtkTreePath *path;
+        if (data->prioritize_scans_id)
+                return;
 
-        tree_model = GTK_TREE_MODEL (data->list_store);
+        data->prioritize_scans_id =
+                g_idle_add ((GSourceFunc) prioritize_scans, data);
+}
 
-        if (data->playing_row) {
-                GtkTreeIter playing_iter;
+/**
+ * Number of rows past the playing one that are read ahead, and the
+ * number of bytes read ahead for them in total.
+ **/
+#define N_PREFETCH      2
+#define PREFETCH_BUDGET (32 * 1024 * 1024)
 
-                path = gtk_tree_row_reference_get_path (data->playing_row);
+/**
+ * Tells the audio player which URI follows the playing one, so that it
+ * can be prepared before the playing one ends, and has the files of the
+ * rows after the playing one read ahead.
+ **/
+static gboolean
+update_upcoming (AppData *data)
+{
+        GtkTreeIter iter;
+        const char *uris[N_PREFETCH];
+        int n_uris = 0;
 
-                /**
-                 * Free old playing row.
-                 **/
-                gtk_tree_row_reference_free (data->playing_row);
-                data->playing_row = NULL;
+        data->update_upcoming_id = 0;
 
-                /**
-                 * Emit changed signal for old playing row.
-                 **/
-                gtk_tree_model_get_iter (tree_model, &playing_iter, path);
-                gtk_tree_model_row_changed (tree_model, path, &playing_iter);
+        if (playlist_model_get_playing (data->model, &iter)) {
+                while (n_uris < N_PREFETCH &&
+                       iter_next_playing (data, &iter)) {
+                        uris[n_uris++] = playlist_model_get_uri (data->model,
+                                                                 &iter);
+                }
         }
 
-        if (iter) {
-                char *uri, *title;
+        audio_player_set_next_uri (data->audio_player,
+                                   n_uris > 0 ? uris[0] : NULL);
 
-                path = gtk_tree_model_get_path (tree_model, iter);
+        prefetcher_set_uris (data->prefetcher, uris, n_uris);
 
-                /**
-                 * Create new playing row.
-                 **/
-                data->playing_row = gtk_tree_row_reference_new (tree_model,
-                                                                path);
+        return FALSE;
+}
 
-                /**
-                 * Emit changed signal for new playing row.
-                 **/
-                gtk_tree_model_row_changed (tree_model, path, iter);
+/**
+ * Updates the upcoming URIs once the current batch of changes is done.
+ **/
+static void
+schedule_update_upcoming (AppData *data)
+{
+        if (data->update_upcoming_id)
+                return;
 
-                gtk_tree_path_free (path);
-                
+        data->update_upcoming_id =
+                g_idle_add ((GSourceFunc) update_upcoming, data);
+}
+
+/**
+ * The playlist was scrolled. Scan the rows that came into view first.
+ **/
+static void
+vadjustment_value_changed_cb (GtkAdjustment *adjustment,
+                              AppData       *data)
+{
+        schedule_prioritize_scans (data);
+}
+
+/**
+ * Set @iter to be the playing row.
+ **/
+static void
+set_playing_row (AppData     *data,
+                 GtkTreeIter *iter)
+{
+        /**
+         * The model takes care of redrawing the old and new playing rows.
+         **/
+        playlist_model_set_playing (data->model, iter);
+
+        /**
+         * Leave the disk to the new playing row until we know what
+         * comes after it.
+         **/
+        prefetcher_cancel (data->prefetcher);
+
+        schedule_update_upcoming (data);
+
+        if (iter) {
                 /**
                  * Get data off new playing row.
                  **/
-                gtk_tree_model_get (tree_model,
-                                    iter,
-                                    COL_URI, &uri,
-                                    COL_TITLE, &title,
-                                    -1);
+                audio_player_set_uri
+                        (data->audio_player,
+                         playlist_model_get_uri (data->model, iter));
 
-                owl_audio_player_set_uri (data->audio_player, uri);
+                update_title (data,
+                              playlist_model_get_title (data->model, iter));
 
-                update_title (data, title);
+                schedule_prioritize_scans (data);
 
                 /* TODO show song metadata */
-
-                g_free (uri);
-                g_free (title);
         } else {
-                data->playing_row = NULL;
                 /**
                  * No playing row. Reset window title.
                  **/
@@ -180,22 +368,13 @@ set_playing_row (AppData     *data,
 static gboolean
 previous (AppData *data)
 {
-        GtkTreePath *path;
         GtkTreeIter iter;
 
-        if (!data->playing_row)
+        if (!playlist_model_get_playing (data->model, &iter))
                 return FALSE;
 
-        path = gtk_tree_row_reference_get_path (data->playing_row);
-        if (!gtk_tree_path_prev (path)) {
-                gtk_tree_path_free (path);
-
+        if (!playlist_model_prev_in_order (data->model, &iter))
                 return FALSE;
-        }
-
-        gtk_tree_model_get_iter (GTK_TREE_MODEL (data->list_store), 
-                                 &iter, path);
-        gtk_tree_path_free (path);
         
         set_playing_row (data, &iter);
         
@@ -208,20 +387,12 @@ previous (AppData *data)
 static gboolean
 next (AppData *data)
 {
-        GtkTreeModel *tree_model;
-        GtkTreePath *path;
         GtkTreeIter iter;
 
-        if (!data->playing_row)
+        if (!playlist_model_get_playing (data->model, &iter))
                 return FALSE;
-
-        tree_model = GTK_TREE_MODEL (data->list_store);
-
-        path = gtk_tree_row_reference_get_path (data->playing_row);
-        gtk_tree_model_get_iter (tree_model, &iter, path);
-        gtk_tree_path_free (path);
         
-        if (gtk_tree_model_iter_next (tree_model, &iter)) {
+        if (iter_next_playing (data, &iter)) {
                 set_playing_row (data, &iter);
                 return TRUE;
         } else {
@@ -236,8 +407,8 @@ next (AppData *data)
  * End of stream reached.
  **/
 static void
-eos_cb (OwlAudioPlayer *player,
-        AppData        *data)
+eos_cb (AudioPlayer *player,
+        AppData     *data)
 {
         /**
          * Go to next song.
@@ -245,6 +416,73 @@ eos_cb (OwlAudioPlayer *player,
         next (data);
 }
 
+/**
+ * The audio player started playing @uri, @gap milliseconds after the
+ * previous song ended. If it moved on by itself, follow it.
+ **/
+static void
+track_changed_cb (AudioPlayer *player,
+                  const char  *uri,
+                  double       gap,
+                  AppData     *data)
+{
+        GtkTreeIter iter;
+
+        g_debug ("Gap before %s: %.1f ms", uri, gap);
+
+        if (playlist_model_get_playing (data->model, &iter) &&
+            !strcmp (playlist_model_get_uri (data->model, &iter), uri))
+                return;
+
+        /**
+         * Most likely the next row, unless that was changed meanwhile.
+         **/
+        if (!playlist_model_get_playing (data->model, &iter) ||
+            !iter_next_playing (data, &iter) ||
+            strcmp (playlist_model_get_uri (data->model, &iter), uri)) {
+                if (!playlist_model_find_uri (data->model, uri, &iter))
+                        return;
+        }
+
+        playlist_model_set_playing (data->model, &iter);
+
+        update_title (data, playlist_model_get_title (data->model, &iter));
+
+        schedule_prioritize_scans (data);
+        schedule_update_upcoming (data);
+}
+
+/**
+ * Queues @uri, which is taken over, for adding with the next
+ * flush_pending_uris().
+ **/
+static void
+add_pending_uri (AppData    *data,
+                 char       *uri,
+                 const char *title,
+                 const char *artist)
+{
+        g_ptr_array_add (data->pending_uris, uri);
+        g_ptr_array_add (data->pending_titles, g_strdup (title));
+        g_ptr_array_add (data->pending_artists, g_strdup (artist));
+}
+
+/**
+ * Forgets about the pending URIs.
+ **/
+static void
+clear_pending_uris (AppData *data)
+{
+        g_ptr_array_foreach (data->pending_uris, (GFunc) g_free, NULL);
+        g_ptr_array_set_size (data->pending_uris, 0);
+
+        g_ptr_array_foreach (data->pending_titles, (GFunc) g_free, NULL);
+        g_ptr_array_set_size (data->pending_titles, 0);
+
+        g_ptr_array_foreach (data->pending_artists, (GFunc) g_free, NULL);
+        g_ptr_array_set_size (data->pending_artists, 0);
+}
+
 /**
  * We are loading a new playlist.
  **/
@@ -257,51 +495,163 @@ playlist_start_cb (PlaylistParser *parser,
         /**
          * Clear playlist.
          **/
-        gtk_list_store_clear (data->list_store);
+        playlist_model_clear (data->model);
+
+        search_index_clear (data->search_index);
+
+        if (data->folder_watcher)
+                folder_watcher_clear (data->folder_watcher);
+
+        clear_pending_uris (data);
 }
 
 /**
- * Add an URI to the playlist.
+ * Batches of at least this many rows are added or removed with the model
+ * detached from the tree view, so that the view does not have to process
+ * every single insertion or deletion.
+ **/
+#define BIG_BATCH 1000
+
+/**
+ * Add @n_uris URIs to the playlist in one go. @titles and @artists, if
+ * not NULL, hold what is known about them already.
  **/
 static void
-add_uri (AppData    *data,
-         const char *uri)
+add_uris (AppData     *data,
+          const char **uris,
+          const char **titles,
+          const char **artists,
+          int          n_uris)
 {
+        GPtrArray *new_uris, *new_titles, *new_artists, *scan_uris;
+        GHashTable *seen;
         GtkTreeIter iter;
-        char *filename, *basename;
+        const char *title, *artist;
+        int n_rows, i;
 
-        filename = g_filename_from_uri (uri, NULL, NULL);
-        if (!filename)
-                return;
+        new_uris    = g_ptr_array_sized_new (n_uris);
+        new_titles  = g_ptr_array_sized_new (n_uris);
+        new_artists = g_ptr_array_sized_new (n_uris);
+        scan_uris   = g_ptr_array_new ();
+
+        seen = g_hash_table_new (g_str_hash, g_str_equal);
+
+        for (i = 0; i < n_uris; i++) {
+                const char *uri = uris[i];
+
+                /**
+                 * We can only play local files.
+                 **/
+                if (g_ascii_strncasecmp (uri, "file:", 5))
+                        continue;
+
+                g_ptr_array_add (new_uris, (gpointer) uri);
+                g_ptr_array_add (new_titles,
+                                 (gpointer) (titles ? titles[i] : NULL));
+                g_ptr_array_add (new_artists,
+                                 (gpointer) (artists ? artists[i] : NULL));
+
+                /**
+                 * Rows for URIs we already know about take their tags
+                 * from the existing rows; only scan and index new ones,
+                 * once. Neither do we scan URIs the playlist gave a
+                 * title for.
+                 **/
+                if (playlist_model_find_uri (data->model, uri, &iter) ||
+                    g_hash_table_lookup (seen, uri))
+                        continue;
+
+                g_hash_table_insert (seen, (gpointer) uri, (gpointer) uri);
+
+                if (titles && titles[i]) {
+                        search_index_set (data->search_index,
+                                          uri,
+                                          titles[i],
+                                          artists ? artists[i] : NULL);
+
+                        continue;
+                }
+
+                /**
+                 * Take the tags from the cache. Should the file turn
+                 * out to have changed since it was scanned, the cache
+                 * tells us, and it is scanned again.
+                 **/
+                if (tag_cache_lookup (data->tag_cache,
+                                      uri,
+                                      &title,
+                                      &artist,
+                                      NULL)) {
+                        new_titles->pdata[new_titles->len - 1] =
+                                (gpointer) title;
+                        new_artists->pdata[new_artists->len - 1] =
+                                (gpointer) artist;
+
+                        search_index_set (data->search_index,
+                                          uri,
+                                          title,
+                                          artist);
+
+                        continue;
+                }
+
+                search_index_set (data->search_index, uri, NULL, NULL);
+
+                g_ptr_array_add (scan_uris, (gpointer) uri);
+        }
+
+        g_hash_table_destroy (seen);
 
         /**
-         * Display the file's basename by default.
-         **/
-        basename = g_path_get_basename (filename);
-        g_free (filename);
-        
-        /**
-         * Add to playlist.
+         * Add to playlist. The model displays the files' basenames until
+         * we know their titles.
          **/
-        gtk_list_store_insert_with_values (data->list_store,
-                                           &iter,
-                                           -1,
-                                           COL_TITLE, basename,
-                                           COL_ARTIST, "",
-                                           COL_URI, uri,
-                                           -1);
+        n_rows = playlist_model_get_n_rows (data->model);
 
-        g_free (basename);
+        if (new_uris->len >= BIG_BATCH) {
+                gtk_tree_view_set_model (GTK_TREE_VIEW (data->tree_view),
+                                         NULL);
+        }
+
+        playlist_model_append_uris (data->model,
+                                    (const char **) new_uris->pdata,
+                                    (const char **) new_titles->pdata,
+                                    (const char **) new_artists->pdata,
+                                    new_uris->len);
+
+        if (new_uris->len >= BIG_BATCH) {
+                gtk_tree_view_set_model (GTK_TREE_VIEW (data->tree_view),
+                                         get_view_model (data));
+        }
+
+        if (data->folder_watcher) {
+                for (i = 0; i < (int) new_uris->len; i++) {
+                        folder_watcher_add_uri
+                                        (data->folder_watcher,
+                                         g_ptr_array_index (new_uris, i));
+                }
+        }
 
         /**
          * Feed to tag reader.
          **/
-        owl_tag_reader_scan_uri (data->tag_reader, uri);
+        for (i = 0; i < (int) scan_uris->len; i++) {
+                tag_scheduler_scan_uri (data->tag_scheduler,
+                                        g_ptr_array_index (scan_uris, i));
+        }
+
+        schedule_prioritize_scans (data);
+
+        g_ptr_array_free (new_uris, TRUE);
+        g_ptr_array_free (new_titles, TRUE);
+        g_ptr_array_free (new_artists, TRUE);
+        g_ptr_array_free (scan_uris, TRUE);
 
         /**
-         * Play this song if nothing is playing.
+         * Play the first new song if nothing is playing.
          **/
-        if (!data->playing_row) {
+        if (!playlist_model_get_playing (data->model, NULL) &&
+            playlist_model_get_iter_at (data->model, &iter, n_rows)) {
                 set_playing_row (data, &iter);
                 
                 gtk_toggle_button_set_active
@@ -310,109 +660,612 @@ add_uri (AppData    *data,
 }
 
 /**
- * TagReader is done scanning an URI. Update UI.
+ * Adds the URIs collected from the playlist being loaded.
  **/
 static void
-tag_reader_uri_scanned_cb (OwlTagReader *tag_reader,
-                           const char   *uri,
-                           GError       *error,
-                           GstTagList   *tag_list,
-                           AppData      *data)
+flush_pending_uris (AppData *data)
 {
-        GtkTreeModel *tree_model;
-        GtkTreeIter iter;
-        char *title = NULL, *artist = NULL;
-        
-        if (error) {
-                g_warning (error->message);
-
-                return;
-        }
-
-        if (!tag_list)
-                return;
-
-        /**
-         * Find appropriate row(s).
-         *
-         * XXX For bigger playlists this is gonna be slow. Having a
-         * URI->iter(s) map would be faster if big playlists are a common
-         * case.
-         **/
-        tree_model = GTK_TREE_MODEL (data->list_store);
+        add_uris (data,
+                  (const char **) data->pending_uris->pdata,
+                  (const char **) data->pending_titles->pdata,
+                  (const char **) data->pending_artists->pdata,
+                  data->pending_uris->len);
 
-        if (!gtk_tree_model_get_iter_first (tree_model, &iter))
-                return;
-        
-        gst_tag_list_get_string (tag_list,
-                                 GST_TAG_TITLE,
-                                 &title);
-        gst_tag_list_get_string (tag_list,
-                                 GST_TAG_ARTIST,
-                                 &artist);
-
-        do {
-                char *this_uri;
-
-                gtk_tree_model_get (tree_model,
-                                    &iter,
-                                    COL_URI,
-                                    &this_uri,
-                                    -1);
-
-                if (!strcmp (uri, this_uri)) {
-                        /**
-                         * Found a matching row.
-                         **/
-                        if (title)
-                                gtk_list_store_set (data->list_store,
-                                                    &iter,
-                                                    COL_TITLE, title,
-                                                    -1);
-                        if (artist)
-                                gtk_list_store_set (data->list_store,
-                                                    &iter,
-                                                    COL_ARTIST, artist,
-                                                    -1);
-
-                        if (iter_is_playing_row (data, &iter)) {
-                                /**
-                                 * This is the playing row as well.
-                                 * Update window title.
-                                 **/
-                                update_title (data, title);
-                        }
-                }
-
-                g_free (this_uri);
-        } while (gtk_tree_model_iter_next (tree_model, &iter));
+        clear_pending_uris (data);
+}
 
-        g_free (title);
-        g_free (artist);
+static int
+compare_positions (const int *a,
+                   const int *b)
+{
+        return *a - *b;
 }
 
 /**
- * Window deleted. Quit app.
+ * Returns TRUE if the row at @iter is among @positions, which is
+ * sorted.
  **/
 static gboolean
-window_delete_event_cb (GtkWidget *window,
-                        GdkEvent  *event,
-                        gpointer   user_data)
+iter_is_removed (AppData     *data,
+                 GtkTreeIter *iter,
+                 GArray      *positions)
 {
-        gtk_main_quit ();
-        
-        return TRUE;
+        int position;
+
+        position = playlist_model_get_position (data->model, iter);
+
+        return bsearch (&position,
+                        positions->data,
+                        positions->len,
+                        sizeof (int),
+                        (GCompareFunc) compare_positions) != NULL;
 }
 
 /**
- * 'Play/Pause' button clicked.
+ * Removes the rows at @positions, an array of ints, in one go. @positions
+ * is sorted in the process. If the playing song goes, the next song that
+ * stays is played, starting over if repeating. URIs left without rows
+ * are taken out of the search index.
  **/
 static void
-play_pause_button_toggled_cb (GtkToggleButton *button,
-                              AppData         *data)
+remove_rows (AppData *data,
+             GArray  *positions)
 {
-        owl_audio_player_set_playing (data->audio_player, button->active);
-}
+        GtkTreeIter iter;
+        char **uris;
+        guint i;
+
+        if (positions->len == 0)
+                return;
+
+        g_array_sort (positions, (GCompareFunc) compare_positions);
+
+        if (playlist_model_get_playing (data->model, &iter) &&
+            iter_is_removed (data, &iter, positions)) {
+                gboolean found;
+                int n_left;
+
+                /**
+                 * Walk past the removed rows playing after this one.
+                 * Repeating, that comes back around; give up once as
+                 * many rows as there are were passed, as then all of
+                 * them go.
+                 **/
+                n_left = playlist_model_get_n_rows (data->model);
+
+                do {
+                        found = n_left-- > 0 &&
+                                iter_next_playing (data, &iter);
+                } while (found && iter_is_removed (data, &iter, positions));
+
+                if (found) {
+                        set_playing_row (data, &iter);
+                } else {
+                        set_playing_row (data, NULL);
+                        gtk_toggle_button_set_active
+                                (GTK_TOGGLE_BUTTON (data->play_pause_button),
+                                 FALSE);
+                }
+        }
+
+        uris = g_new (char *, positions->len);
+
+        for (i = 0; i < positions->len; i++) {
+                playlist_model_get_iter_at (data->model,
+                                            &iter,
+                                            g_array_index (positions, int, i));
+                uris[i] = g_strdup (playlist_model_get_uri (data->model,
+                                                            &iter));
+        }
+
+        if (positions->len >= BIG_BATCH) {
+                gtk_tree_view_set_model (GTK_TREE_VIEW (data->tree_view),
+                                         NULL);
+        }
+
+        playlist_model_remove_positions (data->model,
+                                         (const int *) positions->data,
+                                         positions->len);
+
+        if (positions->len >= BIG_BATCH) {
+                gtk_tree_view_set_model (GTK_TREE_VIEW (data->tree_view),
+                                         get_view_model (data));
+        }
+
+        for (i = 0; i < positions->len; i++) {
+                if (!playlist_model_find_uri (data->model, uris[i], &iter))
+                        search_index_remove (data->search_index, uris[i]);
+
+                g_free (uris[i]);
+        }
+
+        g_free (uris);
+}
+
+/**
+ * PlaylistParser found an entry. Collect it, so that the whole playlist
+ * can be added in one go.
+ **/
+static void
+playlist_entry_cb (PlaylistParser *parser,
+                   const char     *uri,
+                   const char     *title,
+                   const char     *artist,
+                   int             duration,
+                   AppData        *data)
+{
+        add_pending_uri (data, g_strdup (uri), title, artist);
+}
+
+/**
+ * PlaylistParser delivered a batch of entries. Add them.
+ **/
+static void
+playlist_progress_cb (PlaylistParser *parser,
+                      double          fraction,
+                      AppData        *data)
+{
+        flush_pending_uris (data);
+}
+
+/**
+ * We are done loading a playlist.
+ **/
+static void
+playlist_end_cb (PlaylistParser *parser,
+                 AppData        *data)
+{
+        flush_pending_uris (data);
+}
+
+/**
+ * PlaylistParser is done with @result.
+ **/
+static void
+playlist_parsed_cb (GObject      *source_object,
+                    GAsyncResult *result,
+                    AppData      *data)
+{
+        GError *error;
+
+        error = NULL;
+        if (!playlist_parser_parse_finish (PLAYLIST_PARSER (source_object),
+                                           result,
+                                           &error)) {
+                if (!g_error_matches (error,
+                                      G_IO_ERROR,
+                                      G_IO_ERROR_CANCELLED))
+                        g_warning ("%s", error->message);
+
+                g_error_free (error);
+        }
+}
+
+/**
+ * Loads the playlist at @uri in the background, cancelling the one being
+ * loaded.
+ **/
+static void
+load_playlist (AppData    *data,
+               const char *uri)
+{
+        if (data->playlist_cancellable) {
+                g_cancellable_cancel (data->playlist_cancellable);
+                g_object_unref (data->playlist_cancellable);
+        }
+
+        data->playlist_cancellable = g_cancellable_new ();
+
+        playlist_parser_parse_async (data->playlist_parser,
+                                     uri,
+                                     data->playlist_cancellable,
+                                     (GAsyncReadyCallback) playlist_parsed_cb,
+                                     data);
+}
+
+/**
+ * FolderScanner found a batch of files. Add them.
+ **/
+static void
+folder_scanner_files_found_cb (FolderScanner *scanner,
+                               const char   **uris,
+                               int            n_uris,
+                               AppData       *data)
+{
+        add_uris (data, uris, NULL, NULL, n_uris);
+}
+
+/**
+ * FolderScanner is done with @result.
+ **/
+static void
+folder_scanned_cb (GObject      *source_object,
+                   GAsyncResult *result,
+                   AppData      *data)
+{
+        GError *error;
+
+        error = NULL;
+        if (!folder_scanner_scan_finish (FOLDER_SCANNER (source_object),
+                                         result,
+                                         &error)) {
+                if (!g_error_matches (error,
+                                      G_IO_ERROR,
+                                      G_IO_ERROR_CANCELLED))
+                        g_warning ("%s", error->message);
+
+                g_error_free (error);
+        }
+}
+
+/**
+ * Adds the audio files in the folder at @uri and below it, in the
+ * background.
+ **/
+static void
+import_folder (AppData    *data,
+               const char *uri)
+{
+        folder_scanner_scan_async (data->folder_scanner,
+                                   uri,
+                                   data->folder_cancellable,
+                                   (GAsyncReadyCallback) folder_scanned_cb,
+                                   data);
+}
+
+/**
+ * Scans those of @uris that are in the playlist again.
+ **/
+static void
+rescan_uris (AppData     *data,
+             const char **uris,
+             int          n_uris)
+{
+        GtkTreeIter iter;
+        int i;
+
+        for (i = 0; i < n_uris; i++) {
+                if (playlist_model_find_uri (data->model, uris[i], &iter))
+                        tag_scheduler_scan_uri (data->tag_scheduler, uris[i]);
+        }
+
+        schedule_prioritize_scans (data);
+}
+
+/**
+ * Files in the playlist were changed. Scan them again.
+ **/
+static void
+folder_watcher_files_changed_cb (FolderWatcher *watcher,
+                                 const char   **uris,
+                                 int            n_uris,
+                                 AppData       *data)
+{
+        rescan_uris (data, uris, n_uris);
+}
+
+/**
+ * Files in the playlist were deleted or moved away. Drop their rows.
+ **/
+static void
+folder_watcher_files_deleted_cb (FolderWatcher *watcher,
+                                 const char   **uris,
+                                 int            n_uris,
+                                 AppData       *data)
+{
+        GArray *positions;
+        GtkTreeIter iter;
+        int i;
+
+        positions = g_array_new (FALSE, FALSE, sizeof (int));
+
+        for (i = 0; i < n_uris; i++) {
+                if (!playlist_model_find_uri (data->model, uris[i], &iter))
+                        continue;
+
+                do {
+                        int position;
+
+                        position = playlist_model_get_position (data->model,
+                                                                &iter);
+                        g_array_append_val (positions, position);
+                } while (playlist_model_find_uri_next (data->model, &iter));
+        }
+
+        remove_rows (data, positions);
+
+        g_array_free (positions, TRUE);
+}
+
+/**
+ * Starts or stops watching the folders of the files in the playlist.
+ **/
+static void
+set_watching (AppData *data,
+              gboolean watching)
+{
+        GtkTreeIter iter;
+
+        if (!watching) {
+                if (data->folder_watcher) {
+                        g_object_unref (data->folder_watcher);
+                        data->folder_watcher = NULL;
+                }
+
+                return;
+        }
+
+        if (data->folder_watcher)
+                return;
+
+        data->folder_watcher = folder_watcher_new ();
+
+        g_signal_connect (data->folder_watcher,
+                          "files-changed",
+                          G_CALLBACK (folder_watcher_files_changed_cb),
+                          data);
+
+        g_signal_connect (data->folder_watcher,
+                          "files-deleted",
+                          G_CALLBACK (folder_watcher_files_deleted_cb),
+                          data);
+
+        if (!playlist_model_get_iter_at (data->model, &iter, 0))
+                return;
+
+        do {
+                folder_watcher_add_uri (data->folder_watcher,
+                                        playlist_model_get_uri (data->model,
+                                                                &iter));
+        } while (gtk_tree_model_iter_next (GTK_TREE_MODEL (data->model),
+                                           &iter));
+}
+
+/**
+ * Tag scan results are applied to the playlist once per frame, taking no
+ * more than FRAME_BUDGET seconds of it.
+ **/
+#define FRAME_INTERVAL 16
+#define FRAME_BUDGET   0.004
+
+typedef struct {
+        char *uri;
+        char *title;
+        char *artist;
+} ScanResult;
+
+static void
+scan_result_free (ScanResult *result)
+{
+        g_free (result->uri);
+        g_free (result->title);
+        g_free (result->artist);
+
+        g_slice_free (ScanResult, result);
+}
+
+/**
+ * Updates the rows for @result.
+ **/
+static void
+apply_scan_result (AppData    *data,
+                   ScanResult *result)
+{
+        GtkTreeIter iter;
+
+        /**
+         * Find appropriate row(s).
+         **/
+        if (!playlist_model_find_uri (data->model, result->uri, &iter))
+                return;
+
+        search_index_set (data->search_index,
+                          result->uri,
+                          result->title,
+                          result->artist);
+
+        do {
+                playlist_model_set (data->model,
+                                    &iter,
+                                    result->title,
+                                    result->artist);
+
+                if (iter_is_playing_row (data, &iter)) {
+                        /**
+                         * This is the playing row as well.
+                         * Update window title.
+                         **/
+                        update_title (data, result->title);
+                }
+        } while (playlist_model_find_uri_next (data->model, &iter));
+}
+
+/**
+ * Applies buffered tag scan results until the frame budget is used up.
+ **/
+static gboolean
+apply_scan_results (AppData *data)
+{
+        ScanResult *result;
+        GTimer *timer;
+
+        timer = g_timer_new ();
+
+        while ((result = g_queue_pop_head (data->scan_results))) {
+                apply_scan_result (data, result);
+                scan_result_free (result);
+
+                if (g_timer_elapsed (timer, NULL) > FRAME_BUDGET)
+                        break;
+        }
+
+        g_timer_destroy (timer);
+
+        if (g_queue_is_empty (data->scan_results)) {
+                data->scan_results_id = 0;
+
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+/**
+ * TagScheduler is done scanning an URI. Remember the result, and have
+ * it show up with the next frame.
+ **/
+static void
+tag_scheduler_uri_scanned_cb (TagScheduler *tag_scheduler,
+                              const char   *uri,
+                              GError       *error,
+                              GstTagList   *tag_list,
+                              AppData      *data)
+{
+        ScanResult *result;
+        char *title = NULL, *artist = NULL, *album = NULL;
+        guint64 duration;
+        guint track_number;
+        
+        if (error) {
+                g_warning (error->message);
+
+                return;
+        }
+
+        if (!tag_list)
+                return;
+
+        gst_tag_list_get_string (tag_list,
+                                 GST_TAG_TITLE,
+                                 &title);
+        gst_tag_list_get_string (tag_list,
+                                 GST_TAG_ARTIST,
+                                 &artist);
+
+        gst_tag_list_get_string (tag_list,
+                                 GST_TAG_ALBUM,
+                                 &album);
+
+        if (!gst_tag_list_get_uint (tag_list,
+                                    GST_TAG_TRACK_NUMBER,
+                                    &track_number))
+                track_number = 0;
+
+        if (!gst_tag_list_get_uint64 (tag_list,
+                                      GST_TAG_DURATION,
+                                      &duration))
+                duration = GST_CLOCK_TIME_NONE;
+
+        /**
+         * Remember, so that we need not scan @uri again.
+         **/
+        tag_cache_store (data->tag_cache,
+                         uri,
+                         title,
+                         artist,
+                         GST_CLOCK_TIME_IS_VALID (duration) ?
+                                (int) (duration / GST_SECOND) : -1);
+
+        library_store (data->library,
+                       uri,
+                       title,
+                       artist,
+                       album,
+                       track_number,
+                       GST_CLOCK_TIME_IS_VALID (duration) ?
+                                (int) (duration / GST_SECOND) : -1);
+
+        g_free (album);
+
+        /**
+         * Buffer for the next frame.
+         **/
+        result = g_slice_new (ScanResult);
+
+        result->uri    = g_strdup (uri);
+        result->title  = title;
+        result->artist = artist;
+
+        g_queue_push_tail (data->scan_results, result);
+
+        if (!data->scan_results_id) {
+                data->scan_results_id =
+                        g_timeout_add (FRAME_INTERVAL,
+                                       (GSourceFunc) apply_scan_results,
+                                       data);
+        }
+}
+
+/**
+ * Files whose tags came from the cache changed since they were scanned.
+ * Scan them again.
+ **/
+static void
+tag_cache_entries_stale_cb (TagCache    *tag_cache,
+                            const char **uris,
+                            int          n_uris,
+                            AppData     *data)
+{
+        rescan_uris (data, uris, n_uris);
+}
+
+/**
+ * Window deleted. Quit app.
+ **/
+static gboolean
+window_delete_event_cb (GtkWidget *window,
+                        GdkEvent  *event,
+                        gpointer   user_data)
+{
+        gtk_main_quit ();
+        
+        return TRUE;
+}
+
+/**
+ * 'Play/Pause' button clicked.
+ **/
+static void
+play_pause_button_toggled_cb (GtkToggleButton *button,
+                              AppData         *data)
+{
+        audio_player_set_playing (data->audio_player, button->active);
+}
+
+/**
+ * 'Watch folders' button toggled.
+ **/
+static void
+watch_button_toggled_cb (GtkToggleButton *button,
+                         AppData         *data)
+{
+        set_watching (data, button->active);
+}
+
+/**
+ * 'Shuffle' button toggled.
+ **/
+static void
+shuffle_button_toggled_cb (GtkToggleButton *button,
+                           AppData         *data)
+{
+        playlist_model_set_shuffle (data->model,
+                                    gtk_toggle_button_get_active (button));
+
+        schedule_update_upcoming (data);
+}
+
+/**
+ * 'Repeat' button toggled.
+ **/
+static void
+repeat_button_toggled_cb (GtkToggleButton *button,
+                          AppData         *data)
+{
+        data->repeat = gtk_toggle_button_get_active (button);
+
+        schedule_update_upcoming (data);
+}
 
 /**
  * 'Previous' button clicked.
@@ -434,169 +1287,591 @@ next_button_clicked_cb (GtkButton *button,
         next (data);
 }
 
-#if 0
 /**
  * 'Open playlist' button clicked.
  **/
-static void
-open_playlist_button_clicked_cb (GtkButton *button,
-                                 AppData   *data)
+static void
+open_playlist_button_clicked_cb (GtkButton *button,
+                                 AppData   *data)
+{
+        GtkWidget *dialog;
+
+        dialog = gtk_file_chooser_dialog_new ("Open Playlist",
+                                              GTK_WINDOW (data->window),
+                                              GTK_FILE_CHOOSER_ACTION_OPEN,
+                                              GTK_STOCK_CANCEL,
+                                              GTK_RESPONSE_CANCEL,
+                                              GTK_STOCK_OPEN,
+                                              GTK_RESPONSE_ACCEPT,
+                                              NULL);
+
+        switch (gtk_dialog_run (GTK_DIALOG (dialog))) {
+        default:
+                /* Fall through */
+        case GTK_RESPONSE_CANCEL:
+                break;
+        case GTK_RESPONSE_ACCEPT:
+        {
+                char *uri;
+
+                uri = gtk_file_chooser_get_uri (GTK_FILE_CHOOSER (dialog));
+
+                load_playlist (data, uri);
+                
+                g_free (uri);
+                
+                break;
+        }
+        }
+
+        gtk_widget_destroy (dialog);
+}
+
+/**
+ * Looks up the duration of @uri for the playlist writer.
+ **/
+static int
+lookup_duration (const char *uri,
+                 AppData    *data)
+{
+        int duration;
+
+        if (!library_lookup (data->library, uri, NULL, NULL, NULL, &duration))
+                return -1;
+
+        return duration;
+}
+
+/**
+ * 'Save playlist' button clicked.
+ **/
+static void
+save_playlist_button_clicked_cb (GtkButton *button,
+                                 AppData   *data)
+{
+        GtkWidget *dialog;
+
+        dialog = gtk_file_chooser_dialog_new ("Save Playlist",
+                                              GTK_WINDOW (data->window),
+                                              GTK_FILE_CHOOSER_ACTION_SAVE,
+                                              GTK_STOCK_CANCEL,
+                                              GTK_RESPONSE_CANCEL,
+                                              GTK_STOCK_SAVE,
+                                              GTK_RESPONSE_ACCEPT,
+                                              NULL);
+
+        gtk_file_chooser_set_do_overwrite_confirmation
+                                        (GTK_FILE_CHOOSER (dialog), TRUE);
+        gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER (dialog),
+                                           "Playlist.m3u");
+
+        if (gtk_dialog_run (GTK_DIALOG (dialog)) == GTK_RESPONSE_ACCEPT) {
+                GError *error = NULL;
+                char *filename;
+
+                filename = gtk_file_chooser_get_filename
+                                                (GTK_FILE_CHOOSER (dialog));
+
+                if (!playlist_writer_save_m3u
+                                (data->model,
+                                 filename,
+                                 (PlaylistWriterDurationFunc) lookup_duration,
+                                 data,
+                                 &error)) {
+                        g_warning ("%s", error->message);
+
+                        g_error_free (error);
+                }
+
+                g_free (filename);
+        }
+
+        gtk_widget_destroy (dialog);
+}
+
+/**
+ * 'Add song' button clicked.
+ **/
+static void
+add_song_button_clicked_cb (GtkButton *button,
+                            AppData   *data)
+{
+        GtkWidget *dialog;
+        GtkFileChooser *chooser;
+
+        dialog = gtk_file_chooser_dialog_new ("Add Song",
+                                              GTK_WINDOW (data->window),
+                                              GTK_FILE_CHOOSER_ACTION_OPEN,
+                                              GTK_STOCK_CANCEL,
+                                              GTK_RESPONSE_CANCEL,
+                                              GTK_STOCK_OPEN,
+                                              GTK_RESPONSE_ACCEPT,
+                                              NULL);
+        chooser = GTK_FILE_CHOOSER (dialog);
+
+        gtk_file_chooser_set_select_multiple (chooser, TRUE);
+        
+        if (data->last_folder) {
+                gtk_file_chooser_set_current_folder_uri (chooser, data->last_folder);
+        }
+
+        switch (gtk_dialog_run (GTK_DIALOG (dialog))) {
+        default:
+                /* Fall through */
+        case GTK_RESPONSE_CANCEL:
+                break;
+        case GTK_RESPONSE_ACCEPT:
+        {
+                GSList *uris;
+
+                if (data->last_folder) {
+                        g_free (data->last_folder);
+                }
+                data->last_folder = gtk_file_chooser_get_current_folder_uri (chooser);
+                
+                uris = gtk_file_chooser_get_uris (chooser);
+                
+                while (uris) {
+                        add_pending_uri (data, uris->data, NULL, NULL);
+                        
+                        uris = g_slist_delete_link (uris, uris);
+                }
+
+                flush_pending_uris (data);
+                break;
+        }
+        }
+
+        gtk_widget_destroy (dialog);
+}
+
+/**
+ * Collects the position of a selected row.
+ **/
+static void
+collect_position (GtkTreeModel *model,
+                  GtkTreePath  *path,
+                  GtkTreeIter  *iter,
+                  GArray       *positions)
+{
+        PlaylistModel *playlist;
+        int position;
+
+        /**
+         * The iters of a SearchModel are those of its PlaylistModel.
+         **/
+        if (IS_SEARCH_MODEL (model))
+                playlist = search_model_get_model (SEARCH_MODEL (model));
+        else
+                playlist = PLAYLIST_MODEL (model);
+
+        position = playlist_model_get_position (playlist, iter);
+        g_array_append_val (positions, position);
+}
+
+/**
+ * 'Add folder' button clicked.
+ **/
+static void
+add_folder_button_clicked_cb (GtkButton *button,
+                              AppData   *data)
+{
+        GtkWidget *dialog;
+        GtkFileChooser *chooser;
+
+        dialog = gtk_file_chooser_dialog_new
+                                ("Add Folder",
+                                 GTK_WINDOW (data->window),
+                                 GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER,
+                                 GTK_STOCK_CANCEL,
+                                 GTK_RESPONSE_CANCEL,
+                                 GTK_STOCK_OPEN,
+                                 GTK_RESPONSE_ACCEPT,
+                                 NULL);
+        chooser = GTK_FILE_CHOOSER (dialog);
+
+        if (data->last_folder) {
+                gtk_file_chooser_set_current_folder_uri (chooser,
+                                                         data->last_folder);
+        }
+
+        switch (gtk_dialog_run (GTK_DIALOG (dialog))) {
+        default:
+                /* Fall through */
+        case GTK_RESPONSE_CANCEL:
+                break;
+        case GTK_RESPONSE_ACCEPT:
+        {
+                char *uri;
+
+                uri = gtk_file_chooser_get_uri (chooser);
+
+                import_folder (data, uri);
+
+                g_free (data->last_folder);
+                data->last_folder = uri;
+
+                break;
+        }
+        }
+
+        gtk_widget_destroy (dialog);
+}
+
+/**
+ * 'Remove song' button clicked.
+ **/
+static void
+remove_song_button_clicked_cb (GtkButton *button,
+                               AppData   *data)
+{
+        GtkTreeSelection *selection;
+        GArray *positions;
+        
+        selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (data->tree_view));
+
+        positions = g_array_new (FALSE, FALSE, sizeof (int));
+
+        gtk_tree_selection_selected_foreach
+                        (selection,
+                         (GtkTreeSelectionForeachFunc) collect_position,
+                         positions);
+
+        remove_rows (data, positions);
+
+        g_array_free (positions, TRUE);
+}
+
+/**
+ * Adds the tracks the library has for the album or the artist of the
+ * URI attached to @item.
+ **/
+static void
+add_library_tracks (GtkMenuItem *item,
+                    AppData     *data,
+                    gboolean     whole_artist)
+{
+        GPtrArray *uris, *titles, *artists;
+        const char *uri;
+
+        uri = g_object_get_data (G_OBJECT (item), "uri");
+
+        uris    = g_ptr_array_new ();
+        titles  = g_ptr_array_new ();
+        artists = g_ptr_array_new ();
+
+        if (whole_artist)
+                library_get_artist_tracks (data->library,
+                                           uri,
+                                           uris,
+                                           titles,
+                                           artists);
+        else
+                library_get_album_tracks (data->library,
+                                          uri,
+                                          uris,
+                                          titles,
+                                          artists);
+
+        add_uris (data,
+                  (const char **) uris->pdata,
+                  (const char **) titles->pdata,
+                  (const char **) artists->pdata,
+                  uris->len);
+
+        g_ptr_array_free (uris, TRUE);
+        g_ptr_array_free (titles, TRUE);
+        g_ptr_array_free (artists, TRUE);
+}
+
+/**
+ * 'Add Album' menu item activated.
+ **/
+static void
+add_album_item_activate_cb (GtkMenuItem *item,
+                            AppData     *data)
+{
+        add_library_tracks (item, data, FALSE);
+}
+
+/**
+ * 'Add Artist' menu item activated.
+ **/
+static void
+add_artist_item_activate_cb (GtkMenuItem *item,
+                             AppData     *data)
+{
+        add_library_tracks (item, data, TRUE);
+}
+
+/**
+ * A 'Sort by' menu item activated.
+ **/
+static void
+sort_item_activate_cb (GtkMenuItem *item,
+                       AppData     *data)
+{
+        playlist_model_sort (data->model,
+                             GPOINTER_TO_INT (g_object_get_data
+                                                (G_OBJECT (item), "column")));
+}
+
+/**
+ * Appends a 'Sort by' item for @column to @menu.
+ **/
+static void
+append_sort_item (GtkWidget           *menu,
+                  const char          *label,
+                  PlaylistModelColumn  column,
+                  AppData             *data)
+{
+        GtkWidget *item;
+
+        item = gtk_menu_item_new_with_label (label);
+        g_object_set_data (G_OBJECT (item),
+                           "column",
+                           GINT_TO_POINTER (column));
+        gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
+        g_signal_connect (item,
+                          "activate",
+                          G_CALLBACK (sort_item_activate_cb),
+                          data);
+}
+
+/**
+ * Tree view clicked. Pop up a menu on right clicks, offering to add the
+ * album or the artist of the row clicked, if the library knows it, and
+ * to sort the playlist.
+ **/
+static gboolean
+tree_view_button_press_event_cb (GtkWidget      *tree_view,
+                                 GdkEventButton *event,
+                                 AppData        *data)
+{
+        GtkWidget *menu, *item;
+        GtkTreePath *path;
+        GtkTreeIter iter;
+        const char *uri;
+        gboolean known;
+
+        if (event->type != GDK_BUTTON_PRESS || event->button != 3)
+                return FALSE;
+
+        if (!gtk_tree_view_get_path_at_pos (GTK_TREE_VIEW (tree_view),
+                                            event->x,
+                                            event->y,
+                                            &path,
+                                            NULL,
+                                            NULL,
+                                            NULL))
+                return FALSE;
+
+        gtk_tree_model_get_iter (get_view_model (data), &iter, path);
+        gtk_tree_path_free (path);
+
+        uri = playlist_model_get_uri (data->model, &iter);
+        known = library_lookup (data->library, uri, NULL, NULL, NULL, NULL);
+
+        menu = gtk_menu_new ();
+
+        item = gtk_menu_item_new_with_label ("Add Album");
+        g_object_set_data_full (G_OBJECT (item),
+                                "uri",
+                                g_strdup (uri),
+                                g_free);
+        gtk_widget_set_sensitive (item, known);
+        gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
+        g_signal_connect (item,
+                          "activate",
+                          G_CALLBACK (add_album_item_activate_cb),
+                          data);
+
+        item = gtk_menu_item_new_with_label ("Add Artist");
+        g_object_set_data_full (G_OBJECT (item),
+                                "uri",
+                                g_strdup (uri),
+                                g_free);
+        gtk_widget_set_sensitive (item, known);
+        gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
+        g_signal_connect (item,
+                          "activate",
+                          G_CALLBACK (add_artist_item_activate_cb),
+                          data);
+
+        gtk_menu_shell_append (GTK_MENU_SHELL (menu),
+                               gtk_separator_menu_item_new ());
+
+        append_sort_item (menu, "Sort by Title",
+                          PLAYLIST_MODEL_COL_TITLE, data);
+        append_sort_item (menu, "Sort by Artist",
+                          PLAYLIST_MODEL_COL_ARTIST, data);
+        append_sort_item (menu, "Sort by Path",
+                          PLAYLIST_MODEL_COL_URI, data);
+
+        gtk_widget_show_all (menu);
+
+        /**
+         * The menu goes away with its last reference once popped down.
+         **/
+        g_object_ref_sink (menu);
+        g_signal_connect (menu,
+                          "selection-done",
+                          G_CALLBACK (g_object_unref),
+                          NULL);
+
+        gtk_menu_popup (GTK_MENU (menu),
+                        NULL,
+                        NULL,
+                        NULL,
+                        NULL,
+                        event->button,
+                        event->time);
+
+        return TRUE;
+}
+
+/**
+ * Returns the positions of the rows with the URIs in @uris, an array of
+ * ints. All rows with a matching URI match.
+ **/
+static GArray *
+get_matching_positions (AppData   *data,
+                        GPtrArray *uris)
 {
-        GtkWidget *dialog;
-
-        dialog = gtk_file_chooser_dialog_new ("Open Playlist",
-                                              GTK_WINDOW (data->window),
-                                              GTK_FILE_CHOOSER_ACTION_OPEN,
-                                              GTK_STOCK_CANCEL,
-                                              GTK_RESPONSE_CANCEL,
-                                              GTK_STOCK_OPEN,
-                                              GTK_RESPONSE_ACCEPT,
-                                              NULL);
+        GArray *positions;
+        GtkTreeIter iter;
+        guint i;
 
-        switch (gtk_dialog_run (GTK_DIALOG (dialog))) {
-        default:
-                /* Fall through */
-        case GTK_RESPONSE_CANCEL:
-                break;
-        case GTK_RESPONSE_ACCEPT:
-        {
-                char *uri;
-                GError *error;
+        positions = g_array_new (FALSE, FALSE, sizeof (int));
 
-                uri = gtk_file_chooser_get_uri (GTK_FILE_CHOOSER (dialog));
+        for (i = 0; i < uris->len; i++) {
+                if (!playlist_model_find_uri (data->model,
+                                              uris->pdata[i],
+                                              &iter))
+                        continue;
 
-                error = NULL;
-                if (!playlist_parser_parse (data->playlist_parser,
-                                            uri, &error)) {
-                        g_warning (error->message);
+                do {
+                        int position;
 
-                        g_error_free (error);
-                }
-                
-                g_free (uri);
-                
-                break;
-        }
+                        position = playlist_model_get_position (data->model,
+                                                                &iter);
+                        g_array_append_val (positions, position);
+                } while (playlist_model_find_uri_next (data->model, &iter));
         }
 
-        gtk_widget_destroy (dialog);
+        return positions;
 }
-#endif
 
 /**
- * 'Add song' button clicked.
+ * The search index stopped looking before it was done. Have it look
+ * further, a batch at a time, and show the rows it finds. Until then,
+ * the search entry shows the results are not complete.
  **/
-static void
-add_song_button_clicked_cb (GtkButton *button,
-                            AppData   *data)
+static gboolean
+search_more (AppData *data)
 {
-        GtkWidget *dialog;
-        GtkFileChooser *chooser;
+        GPtrArray *uris;
+        GArray *positions;
+        gboolean complete;
 
-        dialog = gtk_file_chooser_dialog_new ("Add Song",
-                                              GTK_WINDOW (data->window),
-                                              GTK_FILE_CHOOSER_ACTION_OPEN,
-                                              GTK_STOCK_CANCEL,
-                                              GTK_RESPONSE_CANCEL,
-                                              GTK_STOCK_OPEN,
-                                              GTK_RESPONSE_ACCEPT,
-                                              NULL);
-        chooser = GTK_FILE_CHOOSER (dialog);
+        uris = g_ptr_array_new ();
+        complete = search_index_query_more (data->search_index, uris);
 
-        gtk_file_chooser_set_select_multiple (chooser, TRUE);
-        
-        if (data->last_folder) {
-                gtk_file_chooser_set_current_folder_uri (chooser, data->last_folder);
-        }
+        positions = get_matching_positions (data, uris);
 
-        switch (gtk_dialog_run (GTK_DIALOG (dialog))) {
-        default:
-                /* Fall through */
-        case GTK_RESPONSE_CANCEL:
-                break;
-        case GTK_RESPONSE_ACCEPT:
-        {
-                GSList *uris;
+        search_model_add_positions (data->search_model,
+                                    (const int *) positions->data,
+                                    positions->len);
 
-                if (data->last_folder) {
-                        g_free (data->last_folder);
-                }
-                data->last_folder = gtk_file_chooser_get_current_folder_uri (chooser);
-                
-                uris = gtk_file_chooser_get_uris (chooser);
-                
-                while (uris) {
-                        char *uri = uris->data;
-                        
-                        add_uri (data, uri);
-                        g_free (uri);
-                        
-                        uris = g_slist_delete_link (uris, uris);
-                }
-                break;
-        }
+        if (positions->len > 0)
+                schedule_prioritize_scans (data);
+
+        g_array_free (positions, TRUE);
+        g_ptr_array_free (uris, TRUE);
+
+        if (!complete) {
+                gtk_entry_progress_pulse (GTK_ENTRY (data->search_entry));
+
+                return TRUE;
         }
 
-        gtk_widget_destroy (dialog);
+        gtk_entry_set_progress_fraction (GTK_ENTRY (data->search_entry), 0.0);
+
+        data->search_more_id = 0;
+
+        return FALSE;
 }
 
 /**
- * 'Remove song' button clicked.
+ * Search entry changed. Show only the rows matching its text, or all of
+ * them if there is none.
  **/
 static void
-remove_song_button_clicked_cb (GtkButton *button,
-                               AppData   *data)
+search_entry_changed_cb (GtkEditable *editable,
+                         AppData     *data)
 {
-        GtkTreeModel *model = GTK_TREE_MODEL (data->list_store);
-        GtkTreeSelection *selection;
-        GList *rows, *l;
-        GtkTreeIter iter;
-        
-        selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (data->tree_view));
+        SearchModel *search_model = NULL;
+        const char *text;
 
-        rows = gtk_tree_selection_get_selected_rows (selection, NULL);
-        
-        if (rows == NULL)
-          return;
+        if (data->search_more_id) {
+                g_source_remove (data->search_more_id);
+                data->search_more_id = 0;
 
-        /* Convert the paths to row references */
-        for (l = rows; l; l = l->next) {
-                GtkTreePath *path = l->data;
-                GtkTreeRowReference *ref;
-                
-                ref = gtk_tree_row_reference_new (model, path);
-                gtk_tree_path_free (path);
-                l->data = ref;
+                gtk_entry_set_progress_fraction (GTK_ENTRY (editable), 0.0);
         }
-        
-        /* Remove the rows */
-        for (l = rows; l; l = l->next) {
-                GtkTreePath *path;
-                
-                path = gtk_tree_row_reference_get_path (l->data);
 
-                gtk_tree_model_get_iter (model, &iter, path);
+        text = gtk_entry_get_text (GTK_ENTRY (editable));
 
-                /* If this song was playing, try and play the next song. */
-                if (iter_is_playing_row (data, &iter)) {
-                        GtkTreeIter iter2;
-                        path = gtk_tree_path_copy (path);
-                        gtk_tree_path_next (path);
-                        if (gtk_tree_model_get_iter (model, &iter2, path)) {
-                                set_playing_row (data, &iter2);
-                        } else {
-                                set_playing_row (data, NULL);
-                                gtk_toggle_button_set_active
-                                        (GTK_TOGGLE_BUTTON (data->play_pause_button), FALSE);
-                        }
-                        gtk_tree_path_free (path);
+        while (g_ascii_isspace (*text))
+                text++;
+
+        if (*text) {
+                GPtrArray *uris;
+                GArray *positions;
+                gboolean complete;
+
+                uris = g_ptr_array_new ();
+                complete = search_index_query (data->search_index,
+                                               text,
+                                               uris);
+
+                positions = get_matching_positions (data, uris);
+
+                search_model = search_model_new (data->model,
+                                                 (const int *) positions->data,
+                                                 positions->len);
+
+                g_array_free (positions, TRUE);
+                g_ptr_array_free (uris, TRUE);
+
+                if (!complete) {
+                        gtk_entry_progress_pulse (GTK_ENTRY (editable));
+
+                        data->search_more_id =
+                                g_idle_add ((GSourceFunc) search_more, data);
                 }
+        } else if (!data->search_model)
+                return;
 
-                gtk_list_store_remove (data->list_store, &iter);
-        }
-        
-        g_list_foreach (rows, (GFunc)gtk_tree_row_reference_free, NULL);
-        g_list_free (rows);
+        if (data->search_model)
+                g_object_unref (data->search_model);
+        data->search_model = search_model;
+
+        gtk_tree_view_set_model (GTK_TREE_VIEW (data->tree_view),
+                                 get_view_model (data));
+
+        schedule_prioritize_scans (data);
+}
+
+/**
+ * Keys that were not indexed yet when searching are now. Search again,
+ * to find them too.
+ **/
+static void
+search_index_keys_built_cb (SearchIndex *search_index,
+                            AppData     *data)
+{
+        search_entry_changed_cb (GTK_EDITABLE (data->search_entry), data);
 }
 
 /**
@@ -610,7 +1885,7 @@ row_activated_cb (GtkTreeView       *tree_view,
 {
         GtkTreeIter iter;
         
-        gtk_tree_model_get_iter (GTK_TREE_MODEL (data->list_store),
+        gtk_tree_model_get_iter (get_view_model (data),
                                  &iter,
                                  path);
         
@@ -640,31 +1915,69 @@ playing_cell_func (GtkTreeViewColumn *col,
                       NULL);
 }
 
+/**
+ * Returns an attribute list making the first @length bytes bold.
+ **/
+static PangoAttrList *
+get_bold_attrs (AppData *data,
+                int      length)
+{
+        PangoAttrList *attrs;
+
+        if (length >= (int) data->bold_attrs->len)
+                g_ptr_array_set_size (data->bold_attrs, length + 1);
+
+        attrs = g_ptr_array_index (data->bold_attrs, length);
+        if (!attrs) {
+                PangoAttribute *attr;
+
+                attrs = pango_attr_list_new ();
+
+                attr = pango_attr_weight_new (PANGO_WEIGHT_BOLD);
+                attr->start_index = 0;
+                attr->end_index   = length;
+                pango_attr_list_insert (attrs, attr);
+
+                g_ptr_array_index (data->bold_attrs, length) = attrs;
+        }
+
+        return attrs;
+}
+
+static void
+free_bold_attrs (PangoAttrList *attrs)
+{
+        if (attrs)
+                pango_attr_list_unref (attrs);
+}
+
 /**
  * Text column cell data function.
+ *
+ * Rather than escaping and parsing markup for every row drawn, use the
+ * row text cached by the model with a shared attribute list.
  **/
 static void
 text_cell_func (GtkTreeViewColumn *col,
                 GtkCellRenderer   *cell,
                 GtkTreeModel      *model,
                 GtkTreeIter       *iter,
-                gpointer           data)
+                AppData           *data)
 {
-        char *title, *artist, *text;
-
-        gtk_tree_model_get (model, iter,
-                            COL_TITLE, &title,
-                            COL_ARTIST, &artist,
-                            -1);
-
-        text = g_markup_printf_escaped ("<b>%s</b>\n%s", title, artist);
+        const char *text;
+        int title_length;
 
-        g_free (artist);
-        g_free (title);
-
-        g_object_set (cell, "markup", text, NULL);
+        /**
+         * @model may be the search model; its iters are those of ours.
+         **/
+        text = playlist_model_get_text (data->model,
+                                        iter,
+                                        &title_length);
 
-        g_free (text);
+        g_object_set (cell,
+                      "text", text,
+                      "attributes", get_bold_attrs (data, title_length),
+                      NULL);
 }
 
 /**
@@ -676,11 +1989,17 @@ main (int argc, char **argv)
         AppData *data;
         GtkWidget *vbox, *hbox, *bbox, *scrolled_window;
         GtkWidget *button, *image;
-        int i;
+        GtkTreeViewColumn *column;
+        GError *error;
+        char *filename;
+        int icon_width, i;
 
         /**
          * Initialize APIs.
          **/
+        if (!g_thread_supported ())
+                g_thread_init (NULL);
+
         gst_init (&argc, &argv);
         gtk_init (&argc, &argv);
 
@@ -692,13 +2011,25 @@ main (int argc, char **argv)
         /**
          * Set up AudioPlayer.
          **/
-        data->audio_player = owl_audio_player_new ();
+        data->audio_player = audio_player_new ();
+
+        audio_player_set_gapless (data->audio_player, TRUE);
 
         g_signal_connect (data->audio_player,
                           "eos",
                           G_CALLBACK (eos_cb),
                           data);
 
+        g_signal_connect (data->audio_player,
+                          "track-changed",
+                          G_CALLBACK (track_changed_cb),
+                          data);
+
+        /**
+         * Set up Prefetcher.
+         **/
+        data->prefetcher = prefetcher_new (PREFETCH_BUDGET);
+
         /**
          * Set up PlaylistParser.
          **/
@@ -709,19 +2040,82 @@ main (int argc, char **argv)
                           G_CALLBACK (playlist_start_cb),
                           data);
 
-        g_signal_connect_swapped (data->playlist_parser,
-                                  "entry",
-                                  G_CALLBACK (add_uri),
-                                  data);
+        g_signal_connect (data->playlist_parser,
+                          "entry",
+                          G_CALLBACK (playlist_entry_cb),
+                          data);
+
+        g_signal_connect (data->playlist_parser,
+                          "progress",
+                          G_CALLBACK (playlist_progress_cb),
+                          data);
+
+        g_signal_connect (data->playlist_parser,
+                          "playlist-end",
+                          G_CALLBACK (playlist_end_cb),
+                          data);
+
+        data->pending_uris    = g_ptr_array_new ();
+        data->pending_titles  = g_ptr_array_new ();
+        data->pending_artists = g_ptr_array_new ();
         
         /**
-         * Set up TagReader.
+         * Set up TagScheduler.
          **/
-        data->tag_reader = owl_tag_reader_new ();
+        data->tag_scheduler = tag_scheduler_new (0);
 
-        g_signal_connect (data->tag_reader,
+        g_signal_connect (data->tag_scheduler,
                           "uri-scanned",
-                          G_CALLBACK (tag_reader_uri_scanned_cb),
+                          G_CALLBACK (tag_scheduler_uri_scanned_cb),
+                          data);
+
+        data->scan_results = g_queue_new ();
+
+        /**
+         * Set up FolderScanner.
+         **/
+        data->folder_scanner = folder_scanner_new ();
+
+        g_signal_connect (data->folder_scanner,
+                          "files-found",
+                          G_CALLBACK (folder_scanner_files_found_cb),
+                          data);
+
+        data->folder_cancellable = g_cancellable_new ();
+
+        /**
+         * Set up TagCache.
+         **/
+        filename = g_build_filename (g_get_user_cache_dir (),
+                                     "gaku",
+                                     "tags",
+                                     NULL);
+        data->tag_cache = tag_cache_new (filename);
+        g_free (filename);
+
+        g_signal_connect (data->tag_cache,
+                          "entries-stale",
+                          G_CALLBACK (tag_cache_entries_stale_cb),
+                          data);
+
+        /**
+         * Set up Library.
+         **/
+        filename = g_build_filename (g_get_user_data_dir (),
+                                     "gaku",
+                                     "library",
+                                     NULL);
+        data->library = library_new (filename);
+        g_free (filename);
+
+        /**
+         * Set up SearchIndex.
+         **/
+        data->search_index = search_index_new ();
+
+        g_signal_connect (data->search_index,
+                          "keys-built",
+                          G_CALLBACK (search_index_keys_built_cb),
                           data);
 
         /**
@@ -786,6 +2180,36 @@ main (int argc, char **argv)
                           G_CALLBACK (next_button_clicked_cb),
                           data);
 
+        button = gtk_toggle_button_new ();
+        image = gtk_image_new_from_icon_name ("media-playlist-shuffle",
+                                              GTK_ICON_SIZE_LARGE_TOOLBAR);
+        gtk_container_add (GTK_CONTAINER (button), image);
+        gtk_box_pack_start (GTK_BOX (hbox), button, FALSE, FALSE, 0);
+        g_signal_connect (button,
+                          "toggled",
+                          G_CALLBACK (shuffle_button_toggled_cb),
+                          data);
+
+        button = gtk_toggle_button_new ();
+        image = gtk_image_new_from_icon_name ("media-playlist-repeat",
+                                              GTK_ICON_SIZE_LARGE_TOOLBAR);
+        gtk_container_add (GTK_CONTAINER (button), image);
+        gtk_box_pack_start (GTK_BOX (hbox), button, FALSE, FALSE, 0);
+        g_signal_connect (button,
+                          "toggled",
+                          G_CALLBACK (repeat_button_toggled_cb),
+                          data);
+
+        button = gtk_toggle_button_new ();
+        image = gtk_image_new_from_stock (GTK_STOCK_REFRESH,
+                                          GTK_ICON_SIZE_LARGE_TOOLBAR);
+        gtk_container_add (GTK_CONTAINER (button), image);
+        gtk_box_pack_end (GTK_BOX (hbox), button, FALSE, FALSE, 0);
+        g_signal_connect (button,
+                          "toggled",
+                          G_CALLBACK (watch_button_toggled_cb),
+                          data);
+
         button = gtk_button_new ();
         image = gtk_image_new_from_stock (GTK_STOCK_REMOVE,
                                           GTK_ICON_SIZE_LARGE_TOOLBAR);
@@ -807,7 +2231,26 @@ main (int argc, char **argv)
                           G_CALLBACK (add_song_button_clicked_cb),
                           data);
 
-#if 0
+        button = gtk_button_new ();
+        image = gtk_image_new_from_stock (GTK_STOCK_DIRECTORY,
+                                          GTK_ICON_SIZE_LARGE_TOOLBAR);
+        gtk_container_add (GTK_CONTAINER (button), image);
+        gtk_box_pack_end (GTK_BOX (hbox), button, FALSE, FALSE, 0);
+        g_signal_connect (button,
+                          "clicked",
+                          G_CALLBACK (add_folder_button_clicked_cb),
+                          data);
+
+        button = gtk_button_new ();
+        image = gtk_image_new_from_stock (GTK_STOCK_SAVE,
+                                          GTK_ICON_SIZE_LARGE_TOOLBAR);
+        gtk_container_add (GTK_CONTAINER (button), image);
+        gtk_box_pack_end (GTK_BOX (hbox), button, FALSE, FALSE, 0);
+        g_signal_connect (button,
+                          "clicked",
+                          G_CALLBACK (save_playlist_button_clicked_cb),
+                          data);
+
         button = gtk_button_new ();
         image = gtk_image_new_from_stock (GTK_STOCK_OPEN,
                                           GTK_ICON_SIZE_LARGE_TOOLBAR);
@@ -817,7 +2260,14 @@ main (int argc, char **argv)
                           "clicked",
                           G_CALLBACK (open_playlist_button_clicked_cb),
                           data);
-#endif
+
+        data->search_entry = gtk_entry_new ();
+        gtk_box_pack_start (GTK_BOX (vbox),
+                            data->search_entry, FALSE, FALSE, 0);
+        g_signal_connect (data->search_entry,
+                          "changed",
+                          G_CALLBACK (search_entry_changed_cb),
+                          data);
 
         scrolled_window = gtk_scrolled_window_new (NULL, NULL);
         gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled_window),
@@ -831,11 +2281,22 @@ main (int argc, char **argv)
         data->tree_view = gtk_tree_view_new ();
         gtk_container_add (GTK_CONTAINER (scrolled_window), data->tree_view);
 
+        g_signal_connect (gtk_tree_view_get_vadjustment
+                                        (GTK_TREE_VIEW (data->tree_view)),
+                          "value-changed",
+                          G_CALLBACK (vadjustment_value_changed_cb),
+                          data);
+
         g_signal_connect (data->tree_view,
                           "row-activated",
                           G_CALLBACK (row_activated_cb),
                           data);
 
+        g_signal_connect (data->tree_view,
+                          "button-press-event",
+                          G_CALLBACK (tree_view_button_press_event_cb),
+                          data);
+
         gtk_tree_selection_set_mode 
           (gtk_tree_view_get_selection (GTK_TREE_VIEW (data->tree_view)),
            GTK_SELECTION_MULTIPLE);
@@ -843,6 +2304,8 @@ main (int argc, char **argv)
                                            FALSE);
         gtk_tree_view_set_rules_hint (GTK_TREE_VIEW (data->tree_view),
                                       TRUE);
+        gtk_tree_view_set_enable_search (GTK_TREE_VIEW (data->tree_view),
+                                         FALSE);
         gtk_tree_view_set_reorderable (GTK_TREE_VIEW (data->tree_view),
                                        TRUE);
 #if GTK_CHECK_VERSION (2, 10, 0)
@@ -851,15 +2314,30 @@ main (int argc, char **argv)
 #endif
 
         /**
-         * Set up list store.
+         * Set up playlist model.
+         **/
+        data->model = playlist_model_new ();
+
+        /**
+         * Any change to the rows may change what plays next.
          **/
-        data->list_store = gtk_list_store_new (3,
-                                               G_TYPE_STRING,
-                                               G_TYPE_STRING,
-                                               G_TYPE_STRING);
+        g_signal_connect_swapped (data->model,
+                                  "row-inserted",
+                                  G_CALLBACK (schedule_update_upcoming),
+                                  data);
+        g_signal_connect_swapped (data->model,
+                                  "row-deleted",
+                                  G_CALLBACK (schedule_update_upcoming),
+                                  data);
+        g_signal_connect_swapped (data->model,
+                                  "rows-reordered",
+                                  G_CALLBACK (schedule_update_upcoming),
+                                  data);
+
+        data->bold_attrs = g_ptr_array_new ();
 
         gtk_tree_view_set_model (GTK_TREE_VIEW (data->tree_view),
-                                 GTK_TREE_MODEL (data->list_store));
+                                 GTK_TREE_MODEL (data->model));
 
         gtk_tree_view_insert_column_with_data_func
                 (GTK_TREE_VIEW (data->tree_view),
@@ -871,8 +2349,27 @@ main (int argc, char **argv)
                 (GTK_TREE_VIEW (data->tree_view),
                  -1, "Song",
                  gtk_cell_renderer_text_new (),
-                 text_cell_func,
-                 NULL, NULL);
+                 (GtkTreeCellDataFunc) text_cell_func,
+                 data, NULL);
+
+        /**
+         * All rows are equally high, so let the tree view skip measuring
+         * each and every one of them. This keeps huge playlists usable.
+         **/
+        gtk_icon_size_lookup (GTK_ICON_SIZE_MENU, &icon_width, NULL);
+
+        column = gtk_tree_view_get_column (GTK_TREE_VIEW (data->tree_view),
+                                           0);
+        gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+        gtk_tree_view_column_set_fixed_width (column, icon_width + 8);
+
+        column = gtk_tree_view_get_column (GTK_TREE_VIEW (data->tree_view),
+                                           1);
+        gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+        gtk_tree_view_column_set_expand (column, TRUE);
+
+        gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (data->tree_view),
+                                             TRUE);
 
         /**
          * Nothing is playing yet.
@@ -890,18 +2387,30 @@ main (int argc, char **argv)
         for (i = 1; i < argc; i++) {
           if (strstr (argv[i], "://")) {
             /* This argument looks like a URI */
-            add_uri (data, argv[i]);
+            add_pending_uri (data, g_strdup (argv[i]), NULL, NULL);
           } else {
             /* This argument is probably a filename, convert to URI */
-            char *uri;
-            uri = g_filename_to_uri (argv[i], NULL, NULL);
-            if (uri) {
-              add_uri (data, uri);
-              g_free (uri);
+            char *filename, *uri;
+            if (g_path_is_absolute (argv[i]))
+              filename = g_strdup (argv[i]);
+            else {
+              char *dir = g_get_current_dir ();
+              filename = g_build_filename (dir, argv[i], NULL);
+              g_free (dir);
             }
+            uri = g_filename_to_uri (filename, NULL, NULL);
+            if (uri && g_file_test (filename, G_FILE_TEST_IS_DIR)) {
+              /* Import folders in the background */
+              import_folder (data, uri);
+              g_free (uri);
+            } else if (uri)
+              add_pending_uri (data, uri, NULL, NULL);
+            g_free (filename);
           }
         }
 
+        flush_pending_uris (data);
+
         /**
          * Enter main loop.
          **/
@@ -910,15 +2419,73 @@ main (int argc, char **argv)
         /**
          * Cleanup.
          **/
-        g_object_unref (data->tag_reader);
+        if (data->prioritize_scans_id)
+                g_source_remove (data->prioritize_scans_id);
+
+        if (data->update_upcoming_id)
+                g_source_remove (data->update_upcoming_id);
+
+        if (data->scan_results_id)
+                g_source_remove (data->scan_results_id);
+
+        if (data->search_more_id)
+                g_source_remove (data->search_more_id);
+
+        g_queue_foreach (data->scan_results, (GFunc) scan_result_free, NULL);
+        g_queue_free (data->scan_results);
+
+        if (data->playlist_cancellable) {
+                g_cancellable_cancel (data->playlist_cancellable);
+                g_object_unref (data->playlist_cancellable);
+        }
+
+        g_cancellable_cancel (data->folder_cancellable);
+        g_object_unref (data->folder_cancellable);
+
+        error = NULL;
+        if (!tag_cache_save (data->tag_cache, &error)) {
+                g_warning ("%s", error->message);
+
+                g_error_free (error);
+        }
+
+        g_debug ("Tag cache: %u hits, %u misses",
+                 tag_cache_get_hits (data->tag_cache),
+                 tag_cache_get_misses (data->tag_cache));
+
+        error = NULL;
+        if (!library_save (data->library, &error)) {
+                g_warning ("%s", error->message);
+
+                g_error_free (error);
+        }
+
+        g_object_unref (data->tag_cache);
+        g_object_unref (data->library);
+        g_object_unref (data->search_index);
+        g_object_unref (data->tag_scheduler);
+        g_object_unref (data->folder_scanner);
+        set_watching (data, FALSE);
         g_object_unref (data->playlist_parser);
         g_object_unref (data->audio_player);
-
-        if (data->playing_row)
-                gtk_tree_row_reference_free (data->playing_row);
+        g_object_unref (data->prefetcher);
 
         gtk_widget_destroy (data->window);
 
+        if (data->search_model)
+                g_object_unref (data->search_model);
+
+        g_object_unref (data->model);
+
+        g_ptr_array_foreach (data->bold_attrs,
+                             (GFunc) free_bold_attrs,
+                             NULL);
+        g_ptr_array_free (data->bold_attrs, TRUE);
+
+        g_ptr_array_free (data->pending_uris, TRUE);
+        g_ptr_array_free (data->pending_titles, TRUE);
+        g_ptr_array_free (data->pending_artists, TRUE);
+
         g_slice_free (AppData, data);
 
         return 0;
@@ -0,0 +1,2054 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "playlist-model.h"
+
+/**
+ * Rows live in a single array indexed by row ID. The IDs are stable for
+ * the lifetime of a row and are what our GtkTreeIters point to, so iters
+ * persist across inserts, removals and reorders. A second array maps
+ * playlist positions to row IDs, and every row remembers its position,
+ * which makes path <-> iter conversion and stepping O(1).
+ *
+ * While playlist_model_remove_positions() sweeps through the order, the
+ * part of it that was already gone over is compacted, and the part that
+ * was not yet still has its old positions. The gap between them is
+ * skipped when converting between positions and rows, so that the model
+ * is consistent whenever row-deleted is emitted.
+ *
+ * While shuffling, the play order is a random permutation of the row
+ * IDs, see shuffle_add(). Rows join it at a random spot among those not
+ * played yet and leave it without the rest being reshuffled, so keeping
+ * it up to date is O(1) per row.
+ **/
+
+#define NO_ROW G_MAXUINT
+
+typedef struct {
+        char *uri;
+        char *title;    /* NULL until first asked for, see get_title() */
+        char *artist;   /* NULL if unknown */
+        char *text;     /* Cached display text, NULL until first asked for */
+
+        /**
+         * Collation keys by column, NULL until first sorted by.
+         **/
+        char *sort_keys[PLAYLIST_MODEL_N_COLUMNS];
+
+        int   position; /* -1 if this slot is free */
+        guint next_dup; /* Next row with the same URI, or NO_ROW */
+
+        guint shuffle_index; /* Index in the shuffle, if shuffling */
+} Row;
+
+struct _PlaylistModelPrivate {
+        int stamp;
+
+        GArray *rows;     /* Row, indexed by row ID */
+        GArray *order;    /* guint row ID, indexed by position */
+        GArray *free_ids; /* guint IDs of free slots in @rows */
+
+        /**
+         * Slots in @order that are skipped, while removing rows.
+         **/
+        guint gap_start;
+        guint gap_length;
+
+        /**
+         * URI -> ID of the first row with that URI. Keys are owned by
+         * that row.
+         **/
+        GHashTable *uri_index;
+
+        /**
+         * ID of the playing row, so that checking whether a row is
+         * playing is a plain comparison.
+         **/
+        guint playing;
+
+        /**
+         * Source and copy of the last row dropped, so that the playing
+         * row survives being dragged around.
+         **/
+        guint drag_src;
+        guint drag_dest;
+
+        /**
+         * Play order while shuffling, or NULL. Rows before
+         * @shuffle_cursor were played this cycle, in the order they
+         * were played, and are holes where removed since; rows from
+         * @shuffle_cursor onwards play next, in that order. Once all
+         * were played, @shuffle_first starts the next cycle; it is
+         * picked at random when first asked for.
+         **/
+        GArray *shuffle;        /* guint row ID */
+        guint   shuffle_cursor;
+        guint   shuffle_holes;  /* Number of holes */
+        guint   shuffle_first;  /* Row ID, or NO_ROW */
+};
+
+static void
+playlist_model_tree_model_init (GtkTreeModelIface *iface);
+static void
+playlist_model_drag_source_init (GtkTreeDragSourceIface *iface);
+static void
+playlist_model_drag_dest_init (GtkTreeDragDestIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (PlaylistModel,
+                         playlist_model,
+                         G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE
+                                (GTK_TYPE_TREE_MODEL,
+                                 playlist_model_tree_model_init)
+                         G_IMPLEMENT_INTERFACE
+                                (GTK_TYPE_TREE_DRAG_SOURCE,
+                                 playlist_model_drag_source_init)
+                         G_IMPLEMENT_INTERFACE
+                                (GTK_TYPE_TREE_DRAG_DEST,
+                                 playlist_model_drag_dest_init));
+
+#define GET_PRIVATE(o) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
+                                      TYPE_PLAYLIST_MODEL, \
+                                      PlaylistModelPrivate))
+
+static inline Row *
+get_row (PlaylistModelPrivate *priv,
+         guint                 id)
+{
+        return &g_array_index (priv->rows, Row, id);
+}
+
+/**
+ * Returns the position of @row, taking a gap in the order into account.
+ **/
+static inline int
+row_get_position (PlaylistModelPrivate *priv,
+                  Row                  *row)
+{
+        if (row->position >= (int) priv->gap_start)
+                return row->position - priv->gap_length;
+
+        return row->position;
+}
+
+static inline guint
+iter_get_id (GtkTreeIter *iter)
+{
+        return GPOINTER_TO_UINT (iter->user_data);
+}
+
+static inline void
+iter_set_id (PlaylistModelPrivate *priv,
+             GtkTreeIter          *iter,
+             guint                 id)
+{
+        iter->stamp     = priv->stamp;
+        iter->user_data = GUINT_TO_POINTER (id);
+}
+
+static inline Row *
+iter_get_row (PlaylistModelPrivate *priv,
+              GtkTreeIter          *iter)
+{
+        g_return_val_if_fail (iter->stamp == priv->stamp, NULL);
+
+        return get_row (priv, iter_get_id (iter));
+}
+
+static void
+playlist_model_init (PlaylistModel *model)
+{
+        PlaylistModelPrivate *priv;
+
+        priv = model->priv = GET_PRIVATE (model);
+
+        priv->stamp = g_random_int ();
+
+        priv->rows     = g_array_new (FALSE, FALSE, sizeof (Row));
+        priv->order    = g_array_new (FALSE, FALSE, sizeof (guint));
+        priv->free_ids = g_array_new (FALSE, FALSE, sizeof (guint));
+
+        priv->uri_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+        priv->playing   = NO_ROW;
+        priv->drag_src  = NO_ROW;
+        priv->drag_dest = NO_ROW;
+}
+
+static void
+free_row (Row *row)
+{
+        int i;
+
+        g_free (row->uri);
+        g_free (row->title);
+        g_free (row->artist);
+        g_free (row->text);
+
+        for (i = 0; i < PLAYLIST_MODEL_N_COLUMNS; i++)
+                g_free (row->sort_keys[i]);
+}
+
+static void
+playlist_model_finalize (GObject *object)
+{
+        PlaylistModel *model;
+        GObjectClass *object_class;
+        guint i;
+
+        model = PLAYLIST_MODEL (object);
+
+        g_hash_table_destroy (model->priv->uri_index);
+
+        for (i = 0; i < model->priv->rows->len; i++) {
+                Row *row = get_row (model->priv, i);
+
+                if (row->position >= 0)
+                        free_row (row);
+        }
+
+        g_array_free (model->priv->rows, TRUE);
+        g_array_free (model->priv->order, TRUE);
+
+        if (model->priv->shuffle)
+                g_array_free (model->priv->shuffle, TRUE);
+        g_array_free (model->priv->free_ids, TRUE);
+
+        object_class = G_OBJECT_CLASS (playlist_model_parent_class);
+        object_class->finalize (object);
+}
+
+static void
+playlist_model_class_init (PlaylistModelClass *klass)
+{
+        GObjectClass *object_class;
+
+        object_class = G_OBJECT_CLASS (klass);
+
+        object_class->finalize = playlist_model_finalize;
+
+        g_type_class_add_private (klass, sizeof (PlaylistModelPrivate));
+}
+
+/**
+ * GtkTreeModel implementation.
+ **/
+static GtkTreeModelFlags
+playlist_model_get_flags (GtkTreeModel *tree_model)
+{
+        return GTK_TREE_MODEL_ITERS_PERSIST | GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static int
+playlist_model_get_n_columns (GtkTreeModel *tree_model)
+{
+        return PLAYLIST_MODEL_N_COLUMNS;
+}
+
+static GType
+playlist_model_get_column_type (GtkTreeModel *tree_model,
+                                int           index)
+{
+        g_return_val_if_fail (index >= 0 &&
+                              index < PLAYLIST_MODEL_N_COLUMNS,
+                              G_TYPE_INVALID);
+
+        return G_TYPE_STRING;
+}
+
+static gboolean
+playlist_model_get_iter (GtkTreeModel *tree_model,
+                         GtkTreeIter  *iter,
+                         GtkTreePath  *path)
+{
+        g_return_val_if_fail (gtk_tree_path_get_depth (path) > 0, FALSE);
+
+        return playlist_model_get_iter_at (PLAYLIST_MODEL (tree_model),
+                                           iter,
+                                           gtk_tree_path_get_indices
+                                                                (path)[0]);
+}
+
+static GtkTreePath *
+playlist_model_get_path (GtkTreeModel *tree_model,
+                         GtkTreeIter  *iter)
+{
+        PlaylistModel *model = PLAYLIST_MODEL (tree_model);
+        Row *row;
+
+        row = iter_get_row (model->priv, iter);
+        g_return_val_if_fail (row != NULL, NULL);
+
+        return gtk_tree_path_new_from_indices
+                                (row_get_position (model->priv, row), -1);
+}
+
+static void
+playlist_model_get_value (GtkTreeModel *tree_model,
+                          GtkTreeIter  *iter,
+                          int           column,
+                          GValue       *value)
+{
+        PlaylistModel *model = PLAYLIST_MODEL (tree_model);
+
+        g_value_init (value, G_TYPE_STRING);
+
+        switch (column) {
+        case PLAYLIST_MODEL_COL_TITLE:
+                g_value_set_string (value,
+                                    playlist_model_get_title (model, iter));
+                break;
+        case PLAYLIST_MODEL_COL_ARTIST:
+                g_value_set_string (value,
+                                    playlist_model_get_artist (model, iter));
+                break;
+        case PLAYLIST_MODEL_COL_URI:
+                g_value_set_string (value,
+                                    playlist_model_get_uri (model, iter));
+                break;
+        default:
+                g_assert_not_reached ();
+                break;
+        }
+}
+
+static gboolean
+playlist_model_iter_next (GtkTreeModel *tree_model,
+                          GtkTreeIter  *iter)
+{
+        PlaylistModel *model = PLAYLIST_MODEL (tree_model);
+        Row *row;
+
+        row = iter_get_row (model->priv, iter);
+        g_return_val_if_fail (row != NULL, FALSE);
+
+        return playlist_model_get_iter_at
+                        (model, iter, row_get_position (model->priv, row) + 1);
+}
+
+static gboolean
+playlist_model_iter_children (GtkTreeModel *tree_model,
+                              GtkTreeIter  *iter,
+                              GtkTreeIter  *parent)
+{
+        if (parent)
+                return FALSE;
+
+        return playlist_model_get_iter_at (PLAYLIST_MODEL (tree_model),
+                                           iter, 0);
+}
+
+static gboolean
+playlist_model_iter_has_child (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter)
+{
+        return FALSE;
+}
+
+static int
+playlist_model_iter_n_children (GtkTreeModel *tree_model,
+                                GtkTreeIter  *iter)
+{
+        if (iter)
+                return 0;
+
+        return playlist_model_get_n_rows (PLAYLIST_MODEL (tree_model));
+}
+
+static gboolean
+playlist_model_iter_nth_child (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter,
+                               GtkTreeIter  *parent,
+                               int           n)
+{
+        if (parent)
+                return FALSE;
+
+        return playlist_model_get_iter_at (PLAYLIST_MODEL (tree_model),
+                                           iter, n);
+}
+
+static gboolean
+playlist_model_iter_parent (GtkTreeModel *tree_model,
+                            GtkTreeIter  *iter,
+                            GtkTreeIter  *child)
+{
+        return FALSE;
+}
+
+static void
+playlist_model_tree_model_init (GtkTreeModelIface *iface)
+{
+        iface->get_flags       = playlist_model_get_flags;
+        iface->get_n_columns   = playlist_model_get_n_columns;
+        iface->get_column_type = playlist_model_get_column_type;
+        iface->get_iter        = playlist_model_get_iter;
+        iface->get_path        = playlist_model_get_path;
+        iface->get_value       = playlist_model_get_value;
+        iface->iter_next       = playlist_model_iter_next;
+        iface->iter_children   = playlist_model_iter_children;
+        iface->iter_has_child  = playlist_model_iter_has_child;
+        iface->iter_n_children = playlist_model_iter_n_children;
+        iface->iter_nth_child  = playlist_model_iter_nth_child;
+        iface->iter_parent     = playlist_model_iter_parent;
+}
+
+/**
+ * GtkTreeDragSource implementation. Together with the GtkTreeDragDest
+ * implementation below this lets the tree view reorder rows.
+ **/
+static gboolean
+playlist_model_row_draggable (GtkTreeDragSource *drag_source,
+                              GtkTreePath       *path)
+{
+        return TRUE;
+}
+
+static gboolean
+playlist_model_drag_data_get (GtkTreeDragSource *drag_source,
+                              GtkTreePath       *path,
+                              GtkSelectionData  *selection_data)
+{
+        return gtk_tree_set_row_drag_data (selection_data,
+                                           GTK_TREE_MODEL (drag_source),
+                                           path);
+}
+
+static gboolean
+playlist_model_drag_data_delete (GtkTreeDragSource *drag_source,
+                                 GtkTreePath       *path)
+{
+        PlaylistModel *model = PLAYLIST_MODEL (drag_source);
+        PlaylistModelPrivate *priv = model->priv;
+        GtkTreeIter iter, dest_iter;
+        gboolean playing_moved;
+
+        if (!gtk_tree_model_get_iter (GTK_TREE_MODEL (drag_source),
+                                      &iter, path))
+                return FALSE;
+
+        /**
+         * If the playing row was moved, its copy is the playing row now.
+         **/
+        playing_moved = (iter_get_id (&iter) == priv->playing &&
+                         iter_get_id (&iter) == priv->drag_src);
+        if (playing_moved)
+                iter_set_id (priv, &dest_iter, priv->drag_dest);
+
+        priv->drag_src  = NO_ROW;
+        priv->drag_dest = NO_ROW;
+
+        playlist_model_remove (model, &iter);
+
+        if (playing_moved)
+                playlist_model_set_playing (model, &dest_iter);
+
+        return TRUE;
+}
+
+static void
+playlist_model_drag_source_init (GtkTreeDragSourceIface *iface)
+{
+        iface->row_draggable    = playlist_model_row_draggable;
+        iface->drag_data_get    = playlist_model_drag_data_get;
+        iface->drag_data_delete = playlist_model_drag_data_delete;
+}
+
+/**
+ * GtkTreeDragDest implementation.
+ **/
+static gboolean
+playlist_model_row_drop_possible (GtkTreeDragDest  *drag_dest,
+                                  GtkTreePath      *dest_path,
+                                  GtkSelectionData *selection_data)
+{
+        GtkTreeModel *src_model;
+        GtkTreePath *src_path;
+        gboolean retval;
+
+        if (!gtk_tree_get_row_drag_data (selection_data,
+                                         &src_model,
+                                         &src_path))
+                return FALSE;
+
+        retval = (src_model == GTK_TREE_MODEL (drag_dest) &&
+                  gtk_tree_path_get_depth (dest_path) == 1 &&
+                  gtk_tree_path_get_indices (dest_path)[0] <=
+                        playlist_model_get_n_rows
+                                (PLAYLIST_MODEL (drag_dest)));
+
+        gtk_tree_path_free (src_path);
+
+        return retval;
+}
+
+static gboolean
+playlist_model_drag_data_received (GtkTreeDragDest  *drag_dest,
+                                   GtkTreePath      *dest_path,
+                                   GtkSelectionData *selection_data)
+{
+        PlaylistModel *model = PLAYLIST_MODEL (drag_dest);
+        GtkTreeModel *src_model;
+        GtkTreePath *src_path;
+        GtkTreeIter src_iter, dest_iter;
+        Row *row;
+        char *uri, *title, *artist;
+
+        if (!playlist_model_row_drop_possible (drag_dest,
+                                               dest_path,
+                                               selection_data))
+                return FALSE;
+
+        gtk_tree_get_row_drag_data (selection_data, &src_model, &src_path);
+
+        if (!gtk_tree_model_get_iter (src_model, &src_iter, src_path)) {
+                gtk_tree_path_free (src_path);
+
+                return FALSE;
+        }
+
+        gtk_tree_path_free (src_path);
+
+        /**
+         * Insert a copy of the source row. The tree view removes the
+         * source row afterwards. Copy the strings first, as inserting
+         * may move the row array around.
+         **/
+        row = iter_get_row (model->priv, &src_iter);
+
+        uri    = g_strdup (row->uri);
+        title  = g_strdup (row->title);
+        artist = g_strdup (row->artist);
+
+        playlist_model_insert (model,
+                               &dest_iter,
+                               gtk_tree_path_get_indices (dest_path)[0],
+                               uri, title, artist);
+
+        model->priv->drag_src  = iter_get_id (&src_iter);
+        model->priv->drag_dest = iter_get_id (&dest_iter);
+
+        g_free (uri);
+        g_free (title);
+        g_free (artist);
+
+        return TRUE;
+}
+
+static void
+playlist_model_drag_dest_init (GtkTreeDragDestIface *iface)
+{
+        iface->drag_data_received = playlist_model_drag_data_received;
+        iface->row_drop_possible  = playlist_model_row_drop_possible;
+}
+
+/**
+ * Updates the stored positions of the rows from @position onwards.
+ **/
+static void
+renumber (PlaylistModelPrivate *priv,
+          guint                 position)
+{
+        guint i;
+
+        for (i = position; i < priv->order->len; i++) {
+                guint id = g_array_index (priv->order, guint, i);
+
+                get_row (priv, id)->position = i;
+        }
+}
+
+/**
+ * Adds row @id to the URI index.
+ **/
+static void
+uri_index_add (PlaylistModelPrivate *priv,
+               guint                 id)
+{
+        Row *row;
+        gpointer head;
+
+        row = get_row (priv, id);
+
+        if (g_hash_table_lookup_extended (priv->uri_index, row->uri,
+                                          NULL, &head))
+                row->next_dup = GPOINTER_TO_UINT (head);
+        else
+                row->next_dup = NO_ROW;
+
+        /**
+         * @id is the new head; it owns the key from now on.
+         **/
+        g_hash_table_replace (priv->uri_index,
+                              row->uri,
+                              GUINT_TO_POINTER (id));
+}
+
+/**
+ * Removes row @id from the URI index.
+ **/
+static void
+uri_index_remove (PlaylistModelPrivate *priv,
+                  guint                 id)
+{
+        Row *row;
+        gpointer head;
+        guint prev;
+
+        row = get_row (priv, id);
+
+        if (!g_hash_table_lookup_extended (priv->uri_index, row->uri,
+                                           NULL, &head))
+                return;
+
+        if (GPOINTER_TO_UINT (head) == id) {
+                if (row->next_dup == NO_ROW) {
+                        g_hash_table_remove (priv->uri_index, row->uri);
+                } else {
+                        Row *next = get_row (priv, row->next_dup);
+
+                        g_hash_table_replace (priv->uri_index,
+                                              next->uri,
+                                              GUINT_TO_POINTER
+                                                        (row->next_dup));
+                }
+
+                return;
+        }
+
+        for (prev = GPOINTER_TO_UINT (head);
+             prev != NO_ROW;
+             prev = get_row (priv, prev)->next_dup) {
+                Row *prev_row = get_row (priv, prev);
+
+                if (prev_row->next_dup == id) {
+                        prev_row->next_dup = row->next_dup;
+
+                        break;
+                }
+        }
+}
+
+#define SHUFFLE_ID(priv, i) \
+        g_array_index ((priv)->shuffle, guint, (i))
+
+/**
+ * Removed played rows leave holes in the shuffle. The holes at both ends
+ * of a run of them hold the index of the hole at the other end, so that
+ * going through the shuffle skips a run in one step.
+ **/
+#define HOLE_FLAG (1u << 31)
+
+#define IS_HOLE(id)      (((id) & HOLE_FLAG) != 0)
+#define HOLE_TO(index)   ((index) | HOLE_FLAG)
+#define HOLE_OTHER_END(id) \
+        ((id) & ~HOLE_FLAG)
+
+/**
+ * Swaps entries @i and @j of the shuffle.
+ **/
+static void
+shuffle_swap (PlaylistModelPrivate *priv,
+              guint                 i,
+              guint                 j)
+{
+        guint id;
+
+        id = SHUFFLE_ID (priv, i);
+        SHUFFLE_ID (priv, i) = SHUFFLE_ID (priv, j);
+        SHUFFLE_ID (priv, j) = id;
+
+        if (!IS_HOLE (SHUFFLE_ID (priv, i)))
+                get_row (priv, SHUFFLE_ID (priv, i))->shuffle_index = i;
+        if (!IS_HOLE (SHUFFLE_ID (priv, j)))
+                get_row (priv, SHUFFLE_ID (priv, j))->shuffle_index = j;
+}
+
+/**
+ * Shuffles the entries from @start onwards, Fisher-Yates style.
+ **/
+static void
+shuffle_range (PlaylistModelPrivate *priv,
+               guint                 start)
+{
+        guint i;
+
+        for (i = priv->shuffle->len; i > start + 1; i--)
+                shuffle_swap (priv, i - 1, g_random_int_range (start, i));
+}
+
+/**
+ * Adds row @id to the shuffle, at a random spot among the rows still to
+ * be played. This is the step Fisher-Yates takes for every row, so the
+ * shuffle stays as random as if it had been made from scratch.
+ **/
+static void
+shuffle_add (PlaylistModelPrivate *priv,
+             guint                 id)
+{
+        g_array_append_val (priv->shuffle, id);
+        get_row (priv, id)->shuffle_index = priv->shuffle->len - 1;
+
+        shuffle_swap (priv,
+                      priv->shuffle->len - 1,
+                      g_random_int_range (priv->shuffle_cursor,
+                                          priv->shuffle->len));
+}
+
+/**
+ * Drops the holes left by removed rows that were played already.
+ **/
+static void
+shuffle_compact (PlaylistModelPrivate *priv)
+{
+        guint read, write, cursor;
+
+        cursor = priv->shuffle_cursor;
+
+        for (read = 0, write = 0; read < priv->shuffle->len; read++) {
+                guint id = SHUFFLE_ID (priv, read);
+
+                if (IS_HOLE (id)) {
+                        if (read < priv->shuffle_cursor)
+                                cursor--;
+
+                        continue;
+                }
+
+                SHUFFLE_ID (priv, write) = id;
+                get_row (priv, id)->shuffle_index = write;
+
+                write++;
+        }
+
+        g_array_set_size (priv->shuffle, write);
+
+        priv->shuffle_cursor = cursor;
+        priv->shuffle_holes  = 0;
+}
+
+/**
+ * Takes row @id out of the shuffle. The last row to be played takes the
+ * place of a row still to be played, which keeps the order random. A
+ * played row leaves a hole, so that the order they were played in is
+ * kept for going back; holes are dropped once there are many of them.
+ * Until then, the hole joins the runs of holes next to it.
+ **/
+static void
+shuffle_remove (PlaylistModelPrivate *priv,
+                guint                 id)
+{
+        guint index, start, end;
+
+        if (id == priv->shuffle_first)
+                priv->shuffle_first = NO_ROW;
+
+        index = get_row (priv, id)->shuffle_index;
+
+        if (index >= priv->shuffle_cursor) {
+                shuffle_swap (priv, index, priv->shuffle->len - 1);
+                g_array_set_size (priv->shuffle, priv->shuffle->len - 1);
+
+                return;
+        }
+
+        start = index;
+        if (start > 0 && IS_HOLE (SHUFFLE_ID (priv, start - 1)))
+                start = HOLE_OTHER_END (SHUFFLE_ID (priv, start - 1));
+
+        end = index;
+        if (end + 1 < priv->shuffle->len &&
+            IS_HOLE (SHUFFLE_ID (priv, end + 1)))
+                end = HOLE_OTHER_END (SHUFFLE_ID (priv, end + 1));
+
+        SHUFFLE_ID (priv, index) = HOLE_TO (index);
+        SHUFFLE_ID (priv, start) = HOLE_TO (end);
+        SHUFFLE_ID (priv, end)   = HOLE_TO (start);
+
+        priv->shuffle_holes++;
+
+        if (priv->shuffle_holes > priv->shuffle_cursor / 2)
+                shuffle_compact (priv);
+}
+
+/**
+ * Moves the shuffle on to row @id, which is about to play. Rows still to
+ * be played are moved up to be played next. Played rows are gone back
+ * to: those played after them are to be played again, in the same
+ * order. Playing the row picked to start the next cycle after all were
+ * played starts that cycle, with all rows shuffled anew.
+ **/
+static void
+shuffle_set_playing (PlaylistModelPrivate *priv,
+                     guint                 id)
+{
+        guint index;
+
+        index = get_row (priv, id)->shuffle_index;
+
+        if (index >= priv->shuffle_cursor) {
+                shuffle_swap (priv, index, priv->shuffle_cursor);
+                priv->shuffle_cursor++;
+
+                return;
+        }
+
+        /**
+         * Rows to be played leave no holes; drop them before rows
+         * become to be played again.
+         **/
+        if (priv->shuffle_holes > 0) {
+                shuffle_compact (priv);
+
+                index = get_row (priv, id)->shuffle_index;
+        }
+
+        if (priv->shuffle_cursor == priv->shuffle->len &&
+            id == priv->shuffle_first) {
+                shuffle_range (priv, 0);
+                shuffle_swap (priv, get_row (priv, id)->shuffle_index, 0);
+
+                priv->shuffle_first = NO_ROW;
+
+                index = 0;
+        }
+
+        priv->shuffle_cursor = index + 1;
+}
+
+/**
+ * Fills a free slot with a new row and returns its ID. The row is not
+ * in the playlist order yet.
+ **/
+static guint
+new_row (PlaylistModelPrivate *priv,
+         const char           *uri,
+         const char           *title,
+         const char           *artist)
+{
+        Row *row;
+        gpointer dup;
+        guint id;
+
+        if (priv->free_ids->len > 0) {
+                id = g_array_index (priv->free_ids,
+                                    guint,
+                                    priv->free_ids->len - 1);
+                g_array_set_size (priv->free_ids, priv->free_ids->len - 1);
+        } else {
+                id = priv->rows->len;
+                g_array_set_size (priv->rows, id + 1);
+        }
+
+        /**
+         * If we already have a row for @uri, start off with what we
+         * know about it.
+         **/
+        if (g_hash_table_lookup_extended (priv->uri_index, uri,
+                                          NULL, &dup)) {
+                Row *dup_row = get_row (priv, GPOINTER_TO_UINT (dup));
+
+                if (!title)
+                        title = dup_row->title;
+                if (!artist)
+                        artist = dup_row->artist;
+        }
+
+        row = get_row (priv, id);
+
+        memset (row, 0, sizeof (Row));
+
+        row->uri    = g_strdup (uri);
+        row->title  = g_strdup (title);
+        row->artist = g_strdup (artist);
+
+        uri_index_add (priv, id);
+
+        if (priv->shuffle)
+                shuffle_add (priv, id);
+
+        return id;
+}
+
+/**
+ * Emits row-inserted for row @id, and sets @iter to it if non-NULL.
+ **/
+static void
+emit_row_inserted (PlaylistModel *model,
+                   guint          id,
+                   GtkTreeIter   *iter)
+{
+        GtkTreeIter new_iter;
+        GtkTreePath *path;
+
+        iter_set_id (model->priv, &new_iter, id);
+
+        path = gtk_tree_path_new_from_indices
+                        (get_row (model->priv, id)->position, -1);
+        gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &new_iter);
+        gtk_tree_path_free (path);
+
+        if (iter)
+                *iter = new_iter;
+}
+
+/**
+ * playlist_model_new
+ *
+ * Return value: A new, empty #PlaylistModel.
+ **/
+PlaylistModel *
+playlist_model_new (void)
+{
+        return g_object_new (TYPE_PLAYLIST_MODEL, NULL);
+}
+
+/**
+ * playlist_model_insert
+ * @model: A #PlaylistModel
+ * @iter: Location to store the new row in, or NULL
+ * @position: Position to insert the row at. If this is -1 or larger than
+ * the number of rows, the row is appended.
+ * @uri: The URI of the new row
+ * @title: The title of the new row, or NULL
+ * @artist: The artist of the new row, or NULL
+ *
+ * Inserts a new row into @model.
+ **/
+void
+playlist_model_insert (PlaylistModel *model,
+                       GtkTreeIter   *iter,
+                       int            position,
+                       const char    *uri,
+                       const char    *title,
+                       const char    *artist)
+{
+        PlaylistModelPrivate *priv;
+        guint id;
+
+        g_return_if_fail (IS_PLAYLIST_MODEL (model));
+        g_return_if_fail (uri != NULL);
+
+        priv = model->priv;
+
+        if (position < 0 || position > (int) priv->order->len)
+                position = priv->order->len;
+
+        id = new_row (priv, uri, title, artist);
+
+        g_array_insert_val (priv->order, position, id);
+        renumber (priv, position);
+
+        emit_row_inserted (model, id, iter);
+}
+
+/**
+ * playlist_model_append
+ * @model: A #PlaylistModel
+ * @iter: Location to store the new row in, or NULL
+ * @uri: The URI of the new row
+ *
+ * Appends a row for @uri to @model. Until a title is set, the URI's
+ * basename is used as title.
+ **/
+void
+playlist_model_append (PlaylistModel *model,
+                       GtkTreeIter   *iter,
+                       const char    *uri)
+{
+        playlist_model_insert (model, iter, -1, uri, NULL, NULL);
+}
+
+/**
+ * playlist_model_append_uris
+ * @model: A #PlaylistModel
+ * @uris: An array of URIs
+ * @titles: An array of titles matching @uris, or NULL
+ * @artists: An array of artists matching @uris, or NULL
+ * @n_uris: The number of URIs in @uris
+ *
+ * Appends a row for each URI in @uris to @model in one go. This is a lot
+ * faster than calling playlist_model_append() for each of them, notably
+ * when no view is attached to @model. Titles and artists may be NULL
+ * where they are not known yet.
+ **/
+void
+playlist_model_append_uris (PlaylistModel *model,
+                            const char   **uris,
+                            const char   **titles,
+                            const char   **artists,
+                            int            n_uris)
+{
+        PlaylistModelPrivate *priv;
+        int i;
+
+        g_return_if_fail (IS_PLAYLIST_MODEL (model));
+        g_return_if_fail (uris != NULL || n_uris == 0);
+
+        priv = model->priv;
+
+        for (i = 0; i < n_uris; i++) {
+                guint id;
+
+                id = new_row (priv,
+                              uris[i],
+                              titles ? titles[i] : NULL,
+                              artists ? artists[i] : NULL);
+
+                /**
+                 * Grow the order one row at a time, so that the model is
+                 * consistent whenever row-inserted is emitted.
+                 **/
+                get_row (priv, id)->position = priv->order->len;
+                g_array_append_val (priv->order, id);
+
+                emit_row_inserted (model, id, NULL);
+        }
+}
+
+/**
+ * Frees row @id and gives its slot back. The row must be taken out of
+ * the order as well.
+ **/
+static void
+release_row (PlaylistModelPrivate *priv,
+             guint                 id)
+{
+        Row *row;
+
+        if (id == priv->playing)
+                priv->playing = NO_ROW;
+
+        uri_index_remove (priv, id);
+
+        if (priv->shuffle)
+                shuffle_remove (priv, id);
+
+        row = get_row (priv, id);
+
+        free_row (row);
+        memset (row, 0, sizeof (Row));
+        row->position = -1;
+
+        g_array_append_val (priv->free_ids, id);
+}
+
+/**
+ * playlist_model_remove
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter
+ *
+ * Removes the row pointed to by @iter from @model. @iter is invalid
+ * afterwards.
+ **/
+void
+playlist_model_remove (PlaylistModel *model,
+                       GtkTreeIter   *iter)
+{
+        PlaylistModelPrivate *priv;
+        GtkTreePath *path;
+        Row *row;
+        guint id;
+        int position;
+
+        g_return_if_fail (IS_PLAYLIST_MODEL (model));
+
+        priv = model->priv;
+
+        row = iter_get_row (priv, iter);
+        g_return_if_fail (row != NULL && row->position >= 0);
+
+        id = iter_get_id (iter);
+        position = row->position;
+
+        release_row (priv, id);
+
+        g_array_remove_index (priv->order, position);
+        renumber (priv, position);
+
+        /**
+         * Notify views.
+         **/
+        path = gtk_tree_path_new_from_indices (position, -1);
+        gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
+        gtk_tree_path_free (path);
+}
+
+/**
+ * playlist_model_remove_positions
+ * @model: A #PlaylistModel
+ * @positions: An array of positions
+ * @n_positions: The number of positions in @positions
+ *
+ * Removes the rows at @positions from @model in a single pass over the
+ * playlist, rather than shifting the rows after each removed row down
+ * one at a time. Positions refer to the rows before any are removed, and
+ * may come in any order. Out of range and duplicate positions are
+ * ignored. row-deleted is still emitted for every row removed; handlers
+ * may look at @model, but not change it.
+ **/
+void
+playlist_model_remove_positions (PlaylistModel *model,
+                                 const int     *positions,
+                                 int            n_positions)
+{
+        PlaylistModelPrivate *priv;
+        guint8 *remove;
+        guint n_rows, read, write;
+        int i;
+
+        g_return_if_fail (IS_PLAYLIST_MODEL (model));
+        g_return_if_fail (positions != NULL || n_positions == 0);
+
+        priv = model->priv;
+
+        n_rows = priv->order->len;
+
+        if (n_positions == 0 || n_rows == 0)
+                return;
+
+        remove = g_new0 (guint8, n_rows);
+        for (i = 0; i < n_positions; i++) {
+                if (positions[i] >= 0 && positions[i] < (int) n_rows)
+                        remove[positions[i]] = TRUE;
+        }
+
+        for (read = 0, write = 0; read < n_rows; read++) {
+                guint id = g_array_index (priv->order, guint, read);
+                GtkTreePath *path;
+
+                if (!remove[read]) {
+                        g_array_index (priv->order, guint, write) = id;
+                        get_row (priv, id)->position = write;
+
+                        write++;
+
+                        continue;
+                }
+
+                release_row (priv, id);
+
+                /**
+                 * Rows up to and including this one are done with; skip
+                 * what they left behind until the next one is.
+                 **/
+                priv->gap_start  = write;
+                priv->gap_length = read + 1 - write;
+
+                path = gtk_tree_path_new_from_indices (write, -1);
+                gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
+                gtk_tree_path_free (path);
+        }
+
+        g_array_set_size (priv->order, write);
+
+        priv->gap_start  = 0;
+        priv->gap_length = 0;
+
+        g_free (remove);
+}
+
+/**
+ * playlist_model_clear
+ * @model: A #PlaylistModel
+ *
+ * Removes all rows from @model.
+ **/
+void
+playlist_model_clear (PlaylistModel *model)
+{
+        PlaylistModelPrivate *priv;
+
+        g_return_if_fail (IS_PLAYLIST_MODEL (model));
+
+        priv = model->priv;
+
+        /**
+         * Remove from the back, so that no rows need to be renumbered.
+         **/
+        while (priv->order->len > 0) {
+                GtkTreeIter iter;
+
+                iter_set_id (priv,
+                             &iter,
+                             g_array_index (priv->order,
+                                            guint,
+                                            priv->order->len - 1));
+
+                playlist_model_remove (model, &iter);
+        }
+
+        /**
+         * Everything is free now; start over with compact arrays.
+         **/
+        g_array_set_size (priv->rows, 0);
+        g_array_set_size (priv->free_ids, 0);
+
+        if (priv->shuffle) {
+                g_array_set_size (priv->shuffle, 0);
+
+                priv->shuffle_cursor = 0;
+                priv->shuffle_holes  = 0;
+                priv->shuffle_first  = NO_ROW;
+        }
+
+        priv->drag_src  = NO_ROW;
+        priv->drag_dest = NO_ROW;
+
+        priv->stamp++;
+}
+
+/**
+ * playlist_model_set
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter
+ * @title: The new title, or NULL to leave it unchanged
+ * @artist: The new artist, or NULL to leave it unchanged
+ *
+ * Sets the title and artist of the row pointed to by @iter.
+ **/
+void
+playlist_model_set (PlaylistModel *model,
+                    GtkTreeIter   *iter,
+                    const char    *title,
+                    const char    *artist)
+{
+        GtkTreePath *path;
+        Row *row;
+
+        g_return_if_fail (IS_PLAYLIST_MODEL (model));
+
+        row = iter_get_row (model->priv, iter);
+        g_return_if_fail (row != NULL);
+
+        if (!title && !artist)
+                return;
+
+        if (title) {
+                g_free (row->title);
+                row->title = g_strdup (title);
+
+                g_free (row->sort_keys[PLAYLIST_MODEL_COL_TITLE]);
+                row->sort_keys[PLAYLIST_MODEL_COL_TITLE] = NULL;
+        }
+
+        if (artist) {
+                g_free (row->artist);
+                row->artist = g_strdup (artist);
+
+                g_free (row->sort_keys[PLAYLIST_MODEL_COL_ARTIST]);
+                row->sort_keys[PLAYLIST_MODEL_COL_ARTIST] = NULL;
+        }
+
+        g_free (row->text);
+        row->text = NULL;
+
+        path = gtk_tree_path_new_from_indices
+                                (row_get_position (model->priv, row), -1);
+        gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, iter);
+        gtk_tree_path_free (path);
+}
+
+/**
+ * playlist_model_get_uri
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter
+ *
+ * Return value: The URI of the row pointed to by @iter. Owned by @model.
+ **/
+const char *
+playlist_model_get_uri (PlaylistModel *model,
+                        GtkTreeIter   *iter)
+{
+        Row *row;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), NULL);
+
+        row = iter_get_row (model->priv, iter);
+        g_return_val_if_fail (row != NULL, NULL);
+
+        return row->uri;
+}
+
+/**
+ * playlist_model_get_title
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter
+ *
+ * Return value: The title of the row pointed to by @iter. If no title was
+ * set, this is the basename of the row's URI. Owned by @model.
+ **/
+const char *
+playlist_model_get_title (PlaylistModel *model,
+                          GtkTreeIter   *iter)
+{
+        Row *row;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), NULL);
+
+        row = iter_get_row (model->priv, iter);
+        g_return_val_if_fail (row != NULL, NULL);
+
+        if (!row->title) {
+                char *filename;
+
+                /**
+                 * Display the file's basename by default. This is only
+                 * worked out once the row is first looked at, so that
+                 * adding rows stays cheap.
+                 **/
+                filename = g_filename_from_uri (row->uri, NULL, NULL);
+                if (filename) {
+                        row->title = g_path_get_basename (filename);
+                        g_free (filename);
+                } else
+                        row->title = g_strdup (row->uri);
+        }
+
+        return row->title;
+}
+
+/**
+ * playlist_model_peek_title
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter
+ *
+ * Return value: The title of the row pointed to by @iter, or NULL if
+ * none was set or worked out yet. Unlike playlist_model_get_title(),
+ * this never allocates. Owned by @model.
+ **/
+const char *
+playlist_model_peek_title (PlaylistModel *model,
+                           GtkTreeIter   *iter)
+{
+        Row *row;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), NULL);
+
+        row = iter_get_row (model->priv, iter);
+        g_return_val_if_fail (row != NULL, NULL);
+
+        return row->title;
+}
+
+/**
+ * playlist_model_get_artist
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter
+ *
+ * Return value: The artist of the row pointed to by @iter. Owned by @model.
+ **/
+const char *
+playlist_model_get_artist (PlaylistModel *model,
+                           GtkTreeIter   *iter)
+{
+        Row *row;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), NULL);
+
+        row = iter_get_row (model->priv, iter);
+        g_return_val_if_fail (row != NULL, NULL);
+
+        return row->artist ? row->artist : "";
+}
+
+/**
+ * playlist_model_get_text
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter
+ * @title_length: Location to store the length of the title in bytes,
+ * or NULL
+ *
+ * Return value: The text to display for the row pointed to by @iter:
+ * its title and artist on separate lines. The title makes up the first
+ * @title_length bytes. Owned by @model, and only built once per row until
+ * the title or artist change, so that drawing rows does not allocate.
+ **/
+const char *
+playlist_model_get_text (PlaylistModel *model,
+                         GtkTreeIter   *iter,
+                         int           *title_length)
+{
+        Row *row;
+        const char *title;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), NULL);
+
+        row = iter_get_row (model->priv, iter);
+        g_return_val_if_fail (row != NULL, NULL);
+
+        title = playlist_model_get_title (model, iter);
+
+        if (!row->text) {
+                row->text = g_strconcat (title,
+                                         "\n",
+                                         row->artist ? row->artist : "",
+                                         NULL);
+        }
+
+        if (title_length)
+                *title_length = strlen (title);
+
+        return row->text;
+}
+
+/**
+ * playlist_model_get_n_rows
+ * @model: A #PlaylistModel
+ *
+ * Return value: The number of rows in @model.
+ **/
+int
+playlist_model_get_n_rows (PlaylistModel *model)
+{
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), 0);
+
+        return model->priv->order->len - model->priv->gap_length;
+}
+
+/**
+ * playlist_model_get_position
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter
+ *
+ * Return value: The position of the row pointed to by @iter.
+ **/
+int
+playlist_model_get_position (PlaylistModel *model,
+                             GtkTreeIter   *iter)
+{
+        Row *row;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), -1);
+
+        row = iter_get_row (model->priv, iter);
+        g_return_val_if_fail (row != NULL, -1);
+
+        return row_get_position (model->priv, row);
+}
+
+/**
+ * playlist_model_get_iter_at
+ * @model: A #PlaylistModel
+ * @iter: An uninitialized #GtkTreeIter
+ * @position: A position
+ *
+ * Sets @iter to the row at @position.
+ *
+ * Return value: TRUE if there is a row at @position.
+ **/
+gboolean
+playlist_model_get_iter_at (PlaylistModel *model,
+                            GtkTreeIter   *iter,
+                            int            position)
+{
+        PlaylistModelPrivate *priv;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), FALSE);
+
+        priv = model->priv;
+
+        if (position < 0 ||
+            position >= (int) (priv->order->len - priv->gap_length))
+                return FALSE;
+
+        if (position >= (int) priv->gap_start)
+                position += priv->gap_length;
+
+        iter_set_id (priv,
+                     iter,
+                     g_array_index (priv->order, guint, position));
+
+        return TRUE;
+}
+
+/**
+ * playlist_model_iter_prev
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter
+ *
+ * Sets @iter to the previous row.
+ *
+ * Return value: TRUE if there was a previous row.
+ **/
+gboolean
+playlist_model_iter_prev (PlaylistModel *model,
+                          GtkTreeIter   *iter)
+{
+        Row *row;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), FALSE);
+
+        row = iter_get_row (model->priv, iter);
+        g_return_val_if_fail (row != NULL, FALSE);
+
+        return playlist_model_get_iter_at
+                        (model, iter, row_get_position (model->priv, row) - 1);
+}
+
+/**
+ * playlist_model_find_uri
+ * @model: A #PlaylistModel
+ * @uri: An URI
+ * @iter: An uninitialized #GtkTreeIter
+ *
+ * Sets @iter to the first row found containing @uri. Use
+ * playlist_model_find_uri_next() to get the others.
+ *
+ * Return value: TRUE if a row containing @uri was found.
+ **/
+gboolean
+playlist_model_find_uri (PlaylistModel *model,
+                         const char    *uri,
+                         GtkTreeIter   *iter)
+{
+        gpointer id;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), FALSE);
+        g_return_val_if_fail (uri != NULL, FALSE);
+
+        if (!g_hash_table_lookup_extended (model->priv->uri_index, uri,
+                                           NULL, &id))
+                return FALSE;
+
+        iter_set_id (model->priv, iter, GPOINTER_TO_UINT (id));
+
+        return TRUE;
+}
+
+/**
+ * playlist_model_find_uri_next
+ * @model: A #PlaylistModel
+ * @iter: A #GtkTreeIter set by playlist_model_find_uri()
+ *
+ * Sets @iter to the next row containing the same URI.
+ *
+ * Return value: TRUE if there was another row containing the same URI.
+ **/
+gboolean
+playlist_model_find_uri_next (PlaylistModel *model,
+                              GtkTreeIter   *iter)
+{
+        Row *row;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), FALSE);
+
+        row = iter_get_row (model->priv, iter);
+        g_return_val_if_fail (row != NULL, FALSE);
+
+        if (row->next_dup == NO_ROW)
+                return FALSE;
+
+        iter_set_id (model->priv, iter, row->next_dup);
+
+        return TRUE;
+}
+
+/**
+ * Emits row-changed for row @id.
+ **/
+static void
+emit_row_changed (PlaylistModel *model,
+                  guint          id)
+{
+        GtkTreeIter iter;
+        GtkTreePath *path;
+
+        iter_set_id (model->priv, &iter, id);
+
+        path = gtk_tree_path_new_from_indices
+                        (get_row (model->priv, id)->position, -1);
+        gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
+        gtk_tree_path_free (path);
+}
+
+/**
+ * playlist_model_set_playing
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter, or NULL
+ *
+ * Marks the row pointed to by @iter as the playing row, or unsets the
+ * playing row if @iter is NULL. The playing row is unset automatically
+ * when it is removed. While shuffling, this moves the play order on to
+ * the row.
+ **/
+void
+playlist_model_set_playing (PlaylistModel *model,
+                            GtkTreeIter   *iter)
+{
+        PlaylistModelPrivate *priv;
+        guint old_playing;
+
+        g_return_if_fail (IS_PLAYLIST_MODEL (model));
+
+        priv = model->priv;
+
+        old_playing = priv->playing;
+
+        if (iter) {
+                g_return_if_fail (iter_get_row (priv, iter) != NULL);
+
+                priv->playing = iter_get_id (iter);
+
+                if (priv->shuffle)
+                        shuffle_set_playing (priv, priv->playing);
+        } else
+                priv->playing = NO_ROW;
+
+        /**
+         * Emit changed signals for the old and new playing rows.
+         **/
+        if (old_playing != NO_ROW)
+                emit_row_changed (model, old_playing);
+
+        if (priv->playing != NO_ROW && priv->playing != old_playing)
+                emit_row_changed (model, priv->playing);
+}
+
+/**
+ * playlist_model_get_playing
+ * @model: A #PlaylistModel
+ * @iter: An uninitialized #GtkTreeIter, or NULL
+ *
+ * Sets @iter to the playing row.
+ *
+ * Return value: TRUE if there is a playing row.
+ **/
+gboolean
+playlist_model_get_playing (PlaylistModel *model,
+                            GtkTreeIter   *iter)
+{
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), FALSE);
+
+        if (model->priv->playing == NO_ROW)
+                return FALSE;
+
+        if (iter)
+                iter_set_id (model->priv, iter, model->priv->playing);
+
+        return TRUE;
+}
+
+/**
+ * playlist_model_iter_is_playing
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter
+ *
+ * Return value: TRUE if @iter points to the playing row. This is cheap
+ * enough to be called from cell data functions.
+ **/
+gboolean
+playlist_model_iter_is_playing (PlaylistModel *model,
+                                GtkTreeIter   *iter)
+{
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), FALSE);
+
+        return (iter->stamp == model->priv->stamp &&
+                iter_get_id (iter) == model->priv->playing);
+}
+
+/**
+ * playlist_model_set_shuffle
+ * @model: A #PlaylistModel
+ * @shuffle: TRUE to shuffle
+ *
+ * Sets whether the rows of @model play in random order. Turning
+ * shuffling on shuffles all rows once; the playing row, if any, counts
+ * as played. From then on, every row plays once per cycle, see
+ * playlist_model_next_in_order().
+ **/
+void
+playlist_model_set_shuffle (PlaylistModel *model,
+                            gboolean       shuffle)
+{
+        PlaylistModelPrivate *priv;
+        guint i;
+
+        g_return_if_fail (IS_PLAYLIST_MODEL (model));
+
+        priv = model->priv;
+
+        if (shuffle == (priv->shuffle != NULL))
+                return;
+
+        if (!shuffle) {
+                g_array_free (priv->shuffle, TRUE);
+                priv->shuffle = NULL;
+
+                return;
+        }
+
+        priv->shuffle = g_array_sized_new (FALSE,
+                                           FALSE,
+                                           sizeof (guint),
+                                           priv->order->len);
+        g_array_append_vals (priv->shuffle,
+                             priv->order->data,
+                             priv->order->len);
+
+        for (i = 0; i < priv->shuffle->len; i++)
+                get_row (priv, SHUFFLE_ID (priv, i))->shuffle_index = i;
+
+        priv->shuffle_cursor = 0;
+        priv->shuffle_holes  = 0;
+        priv->shuffle_first  = NO_ROW;
+
+        shuffle_range (priv, 0);
+
+        if (priv->playing != NO_ROW)
+                shuffle_set_playing (priv, priv->playing);
+}
+
+/**
+ * playlist_model_get_shuffle
+ * @model: A #PlaylistModel
+ *
+ * Return value: TRUE if the rows of @model play in random order.
+ **/
+gboolean
+playlist_model_get_shuffle (PlaylistModel *model)
+{
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), FALSE);
+
+        return model->priv->shuffle != NULL;
+}
+
+/**
+ * playlist_model_next_in_order
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter
+ *
+ * Sets @iter to the row that plays after it: the next row, or while
+ * shuffling, the next row in the shuffled order. Takes O(1): runs of
+ * removed rows in the shuffled order are skipped in one step.
+ *
+ * Return value: TRUE if a row plays after @iter. When FALSE is returned
+ * after the playing row while shuffling, all rows were played.
+ **/
+gboolean
+playlist_model_next_in_order (PlaylistModel *model,
+                              GtkTreeIter   *iter)
+{
+        PlaylistModelPrivate *priv;
+        Row *row;
+        guint i;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), FALSE);
+
+        priv = model->priv;
+
+        row = iter_get_row (priv, iter);
+        g_return_val_if_fail (row != NULL, FALSE);
+
+        if (!priv->shuffle) {
+                return playlist_model_get_iter_at
+                        (model, iter, row_get_position (priv, row) + 1);
+        }
+
+        /**
+         * Only played rows leave holes behind.
+         **/
+        i = row->shuffle_index + 1;
+        if (i < priv->shuffle->len && IS_HOLE (SHUFFLE_ID (priv, i)))
+                i = HOLE_OTHER_END (SHUFFLE_ID (priv, i)) + 1;
+
+        if (i >= priv->shuffle->len)
+                return FALSE;
+
+        iter_set_id (priv, iter, SHUFFLE_ID (priv, i));
+
+        return TRUE;
+}
+
+/**
+ * playlist_model_prev_in_order
+ * @model: A #PlaylistModel
+ * @iter: A valid #GtkTreeIter
+ *
+ * Sets @iter to the row that plays before it: the previous row, or
+ * while shuffling, the row played before it. Takes O(1), like
+ * playlist_model_next_in_order().
+ *
+ * Return value: TRUE if a row plays before @iter.
+ **/
+gboolean
+playlist_model_prev_in_order (PlaylistModel *model,
+                              GtkTreeIter   *iter)
+{
+        PlaylistModelPrivate *priv;
+        Row *row;
+        guint i;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), FALSE);
+
+        priv = model->priv;
+
+        row = iter_get_row (priv, iter);
+        g_return_val_if_fail (row != NULL, FALSE);
+
+        if (!priv->shuffle) {
+                return playlist_model_get_iter_at
+                        (model, iter, row_get_position (priv, row) - 1);
+        }
+
+        i = row->shuffle_index;
+        if (i > 0 && IS_HOLE (SHUFFLE_ID (priv, i - 1)))
+                i = HOLE_OTHER_END (SHUFFLE_ID (priv, i - 1));
+
+        if (i == 0)
+                return FALSE;
+
+        iter_set_id (priv, iter, SHUFFLE_ID (priv, i - 1));
+
+        return TRUE;
+}
+
+/**
+ * playlist_model_first_in_order
+ * @model: A #PlaylistModel
+ * @iter: An uninitialized #GtkTreeIter
+ *
+ * Sets @iter to the row that plays first: the first row, or while
+ * shuffling, the first row played this cycle. Once all rows were
+ * played, it is a row picked at random instead, and playing it starts
+ * a new cycle.
+ *
+ * Return value: TRUE if @model has rows.
+ **/
+gboolean
+playlist_model_first_in_order (PlaylistModel *model,
+                               GtkTreeIter   *iter)
+{
+        PlaylistModelPrivate *priv;
+        guint i;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), FALSE);
+
+        priv = model->priv;
+
+        if (!priv->shuffle)
+                return playlist_model_get_iter_at (model, iter, 0);
+
+        if (priv->shuffle_cursor == priv->shuffle->len &&
+            priv->shuffle->len > priv->shuffle_holes) {
+                if (priv->shuffle_first == NO_ROW) {
+                        if (priv->shuffle_holes > 0)
+                                shuffle_compact (priv);
+
+                        i = g_random_int_range (0, priv->shuffle->len);
+
+                        priv->shuffle_first = SHUFFLE_ID (priv, i);
+                }
+
+                iter_set_id (priv, iter, priv->shuffle_first);
+
+                return TRUE;
+        }
+
+        i = 0;
+        if (i < priv->shuffle->len && IS_HOLE (SHUFFLE_ID (priv, i)))
+                i = HOLE_OTHER_END (SHUFFLE_ID (priv, i)) + 1;
+
+        if (i >= priv->shuffle->len)
+                return FALSE;
+
+        iter_set_id (priv, iter, SHUFFLE_ID (priv, i));
+
+        return TRUE;
+}
+
+/**
+ * Returns the collation key of row @id for @column, working it out if
+ * not known yet.
+ **/
+static const char *
+get_sort_key (PlaylistModel       *model,
+              guint                id,
+              PlaylistModelColumn  column)
+{
+        GtkTreeIter iter;
+        Row *row;
+        char *path;
+
+        row = get_row (model->priv, id);
+
+        if (row->sort_keys[column])
+                return row->sort_keys[column];
+
+        switch (column) {
+        case PLAYLIST_MODEL_COL_TITLE:
+                iter_set_id (model->priv, &iter, id);
+
+                row->sort_keys[column] =
+                        g_utf8_collate_key (playlist_model_get_title (model,
+                                                                      &iter),
+                                            -1);
+                break;
+        case PLAYLIST_MODEL_COL_ARTIST:
+                row->sort_keys[column] =
+                        g_utf8_collate_key (row->artist ? row->artist : "",
+                                            -1);
+                break;
+        case PLAYLIST_MODEL_COL_URI:
+                path = g_uri_unescape_string (row->uri, NULL);
+
+                row->sort_keys[column] =
+                        g_utf8_collate_key_for_filename (path ? path
+                                                              : row->uri,
+                                                         -1);
+
+                g_free (path);
+                break;
+        default:
+                g_assert_not_reached ();
+                break;
+        }
+
+        return row->sort_keys[column];
+}
+
+typedef struct {
+        const char **keys;      /* By position */
+        const char **next_keys; /* By position, or NULL */
+} SortData;
+
+/**
+ * Compares the rows at two positions by their keys, and their positions
+ * if those are equal, so that the sort is stable.
+ **/
+static int
+compare_positions (gconstpointer a,
+                   gconstpointer b,
+                   gpointer      user_data)
+{
+        SortData *sort_data = user_data;
+        int position_a = *(const int *) a;
+        int position_b = *(const int *) b;
+        int ret;
+
+        ret = strcmp (sort_data->keys[position_a],
+                      sort_data->keys[position_b]);
+        if (ret != 0)
+                return ret;
+
+        if (sort_data->next_keys) {
+                ret = strcmp (sort_data->next_keys[position_a],
+                              sort_data->next_keys[position_b]);
+                if (ret != 0)
+                        return ret;
+        }
+
+        return position_a - position_b;
+}
+
+/**
+ * playlist_model_sort
+ * @model: A #PlaylistModel
+ * @column: The column to sort by
+ *
+ * Sorts the rows of @model by @column, in the user's locale. Rows by
+ * the same artist are sorted by title. Rows that compare equal keep
+ * their order. Iters stay valid, so the playing row stays the playing
+ * row.
+ *
+ * Collation keys are worked out once per row and column, and again
+ * only when the row's tags change; the sort itself only compares them.
+ **/
+void
+playlist_model_sort (PlaylistModel       *model,
+                     PlaylistModelColumn  column)
+{
+        PlaylistModelPrivate *priv;
+        SortData sort_data;
+        GtkTreePath *path;
+        GArray *order;
+        int *new_order;
+        guint i;
+
+        g_return_if_fail (IS_PLAYLIST_MODEL (model));
+        g_return_if_fail (column >= 0 && column < PLAYLIST_MODEL_N_COLUMNS);
+
+        priv = model->priv;
+
+        if (priv->order->len < 2)
+                return;
+
+        sort_data.keys = g_new (const char *, priv->order->len);
+        sort_data.next_keys = NULL;
+
+        if (column == PLAYLIST_MODEL_COL_ARTIST)
+                sort_data.next_keys = g_new (const char *, priv->order->len);
+
+        new_order = g_new (int, priv->order->len);
+
+        for (i = 0; i < priv->order->len; i++) {
+                guint id = g_array_index (priv->order, guint, i);
+
+                sort_data.keys[i] = get_sort_key (model, id, column);
+
+                if (sort_data.next_keys) {
+                        sort_data.next_keys[i] =
+                                get_sort_key (model,
+                                              id,
+                                              PLAYLIST_MODEL_COL_TITLE);
+                }
+
+                new_order[i] = i;
+        }
+
+        /**
+         * Sort positions rather than rows; the row array stays as is.
+         **/
+        g_qsort_with_data (new_order,
+                           priv->order->len,
+                           sizeof (int),
+                           compare_positions,
+                           &sort_data);
+
+        order = g_array_sized_new (FALSE,
+                                   FALSE,
+                                   sizeof (guint),
+                                   priv->order->len);
+
+        for (i = 0; i < priv->order->len; i++) {
+                g_array_append_val (order,
+                                    g_array_index (priv->order,
+                                                   guint,
+                                                   new_order[i]));
+        }
+
+        g_array_free (priv->order, TRUE);
+        priv->order = order;
+
+        renumber (priv, 0);
+
+        path = gtk_tree_path_new ();
+        gtk_tree_model_rows_reordered (GTK_TREE_MODEL (model),
+                                       path,
+                                       NULL,
+                                       new_order);
+        gtk_tree_path_free (path);
+
+        g_free (new_order);
+        g_free (sort_data.keys);
+        g_free (sort_data.next_keys);
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PLAYLIST_MODEL_H__
+#define __PLAYLIST_MODEL_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+        PLAYLIST_MODEL_COL_TITLE,
+        PLAYLIST_MODEL_COL_ARTIST,
+        PLAYLIST_MODEL_COL_URI,
+        PLAYLIST_MODEL_N_COLUMNS
+} PlaylistModelColumn;
+
+#define TYPE_PLAYLIST_MODEL \
+                (playlist_model_get_type ())
+#define PLAYLIST_MODEL(obj) \
+                (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                 TYPE_PLAYLIST_MODEL, \
+                 PlaylistModel))
+#define PLAYLIST_MODEL_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_CAST ((klass), \
+                 TYPE_PLAYLIST_MODEL, \
+                 PlaylistModelClass))
+#define IS_PLAYLIST_MODEL(obj) \
+                (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                 TYPE_PLAYLIST_MODEL))
+#define IS_PLAYLIST_MODEL_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                 TYPE_PLAYLIST_MODEL))
+#define PLAYLIST_MODEL_GET_CLASS(obj) \
+                (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+                 TYPE_PLAYLIST_MODEL, \
+                 PlaylistModelClass))
+
+typedef struct _PlaylistModelPrivate PlaylistModelPrivate;
+
+typedef struct {
+        GObject parent;
+
+        PlaylistModelPrivate *priv;
+} PlaylistModel;
+
+typedef struct {
+        GObjectClass parent_class;
+
+        /* Future padding */
+        void (* _reserved1) (void);
+        void (* _reserved2) (void);
+        void (* _reserved3) (void);
+        void (* _reserved4) (void);
+} PlaylistModelClass;
+
+GType
+playlist_model_get_type         (void) G_GNUC_CONST;
+
+PlaylistModel *
+playlist_model_new              (void);
+
+void
+playlist_model_insert           (PlaylistModel *model,
+                                 GtkTreeIter   *iter,
+                                 int            position,
+                                 const char    *uri,
+                                 const char    *title,
+                                 const char    *artist);
+
+void
+playlist_model_append           (PlaylistModel *model,
+                                 GtkTreeIter   *iter,
+                                 const char    *uri);
+
+void
+playlist_model_append_uris      (PlaylistModel *model,
+                                 const char   **uris,
+                                 const char   **titles,
+                                 const char   **artists,
+                                 int            n_uris);
+
+void
+playlist_model_remove           (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+void
+playlist_model_remove_positions (PlaylistModel *model,
+                                 const int     *positions,
+                                 int            n_positions);
+
+void
+playlist_model_clear            (PlaylistModel *model);
+
+void
+playlist_model_sort             (PlaylistModel       *model,
+                                 PlaylistModelColumn  column);
+
+void
+playlist_model_set              (PlaylistModel *model,
+                                 GtkTreeIter   *iter,
+                                 const char    *title,
+                                 const char    *artist);
+
+const char *
+playlist_model_get_uri          (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+const char *
+playlist_model_get_title        (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+const char *
+playlist_model_peek_title       (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+const char *
+playlist_model_get_artist       (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+const char *
+playlist_model_get_text         (PlaylistModel *model,
+                                 GtkTreeIter   *iter,
+                                 int           *title_length);
+
+int
+playlist_model_get_n_rows       (PlaylistModel *model);
+
+int
+playlist_model_get_position     (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+gboolean
+playlist_model_get_iter_at      (PlaylistModel *model,
+                                 GtkTreeIter   *iter,
+                                 int            position);
+
+gboolean
+playlist_model_iter_prev        (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+gboolean
+playlist_model_find_uri         (PlaylistModel *model,
+                                 const char    *uri,
+                                 GtkTreeIter   *iter);
+
+gboolean
+playlist_model_find_uri_next    (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+void
+playlist_model_set_playing      (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+gboolean
+playlist_model_get_playing      (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+gboolean
+playlist_model_iter_is_playing  (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+void
+playlist_model_set_shuffle      (PlaylistModel *model,
+                                 gboolean       shuffle);
+
+gboolean
+playlist_model_get_shuffle      (PlaylistModel *model);
+
+gboolean
+playlist_model_next_in_order    (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+gboolean
+playlist_model_prev_in_order    (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+gboolean
+playlist_model_first_in_order   (PlaylistModel *model,
+                                 GtkTreeIter   *iter);
+
+G_END_DECLS
+
+#endif /* __PLAYLIST_MODEL_H__ */
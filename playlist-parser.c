@@ -20,9 +20,21 @@
  */
 
 #include <gst/gst.h>
+#include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined (__AVX2__)
+#include <immintrin.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "playlist-parser.h"
+#include "marshal.h"
 
 G_DEFINE_TYPE (PlaylistParser,
                playlist_parser,
@@ -32,14 +44,51 @@ enum {
         SIGNAL_PLAYLIST_START,
         SIGNAL_PLAYLIST_END,
         SIGNAL_ENTRY,
+        SIGNAL_PROGRESS,
         SIGNAL_LAST
 };
 
 static guint signals[SIGNAL_LAST];
 
+struct _PlaylistParserPrivate {
+        /**
+         * Thread pool for parsing big playlists in parallel, or NULL if
+         * we only have one CPU.
+         **/
+        GThreadPool *pool;
+
+        GMutex *chunk_mutex;
+        GCond  *chunk_cond;
+};
+
+#define GET_PRIVATE(o) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
+                                      TYPE_PLAYLIST_PARSER, \
+                                      PlaylistParserPrivate))
+
+static void
+parse_chunk (gpointer chunk,
+             gpointer parser);
+
 static void
 playlist_parser_init (PlaylistParser *parser)
 {
+        PlaylistParserPrivate *priv;
+        long n_cpus;
+
+        priv = parser->priv = GET_PRIVATE (parser);
+
+        n_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+        if (n_cpus > 1) {
+                priv->pool = g_thread_pool_new (parse_chunk,
+                                                parser,
+                                                n_cpus,
+                                                FALSE,
+                                                NULL);
+        }
+
+        priv->chunk_mutex = g_mutex_new ();
+        priv->chunk_cond  = g_cond_new ();
 }
 
 static void
@@ -50,6 +99,11 @@ playlist_parser_dispose (GObject *object)
 
         parser = PLAYLIST_PARSER (object);
 
+        if (parser->priv->pool) {
+                g_thread_pool_free (parser->priv->pool, FALSE, TRUE);
+                parser->priv->pool = NULL;
+        }
+
         object_class = G_OBJECT_CLASS (playlist_parser_parent_class);
         object_class->dispose (object);
 }
@@ -62,6 +116,9 @@ playlist_parser_finalize (GObject *object)
 
         parser = PLAYLIST_PARSER (object);
 
+        g_mutex_free (parser->priv->chunk_mutex);
+        g_cond_free (parser->priv->chunk_cond);
+
         object_class = G_OBJECT_CLASS (playlist_parser_parent_class);
         object_class->finalize (object);
 }
@@ -76,6 +133,8 @@ playlist_parser_class_init (PlaylistParserClass *klass)
 	object_class->dispose  = playlist_parser_dispose;
 	object_class->finalize = playlist_parser_finalize;
 
+        g_type_class_add_private (klass, sizeof (PlaylistParserPrivate));
+
         signals[SIGNAL_PLAYLIST_START] =
                 g_signal_new ("playlist-start",
                               TYPE_PLAYLIST_PARSER,
@@ -108,10 +167,26 @@ playlist_parser_class_init (PlaylistParserClass *klass)
                                                entry),
                               NULL,
                               NULL,
-                              g_cclosure_marshal_VOID__STRING,
+                              gaku_marshal_VOID__STRING_STRING_STRING_INT,
+                              G_TYPE_NONE,
+                              4,
+                              G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                              G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                              G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                              G_TYPE_INT);
+
+        signals[SIGNAL_PROGRESS] =
+                g_signal_new ("progress",
+                              TYPE_PLAYLIST_PARSER,
+                              G_SIGNAL_RUN_LAST,
+                              G_STRUCT_OFFSET (PlaylistParserClass,
+                                               progress),
+                              NULL,
+                              NULL,
+                              g_cclosure_marshal_VOID__DOUBLE,
                               G_TYPE_NONE,
                               1,
-                              G_TYPE_STRING);
+                              G_TYPE_DOUBLE);
 }
 
 /**
@@ -126,38 +201,432 @@ playlist_parser_new (void)
 }
 
 /**
- * Emit the 'entry' signal for @path after converting it to an URI.
+ * Flags describing what scan_line() found in a line.
+ **/
+enum {
+        LINE_HAS_BACKSLASH = 1 << 0,
+        LINE_HAS_COLON     = 1 << 1,
+        LINE_IS_DIRECTIVE  = 1 << 2
+};
+
+/**
+ * Returns TRUE if the line from @line to @eol is an extended M3U
+ * directive rather than a plain comment.
+ **/
+static inline gboolean
+is_directive (const char *line,
+              const char *eol)
+{
+        return (eol - line >= 4 && !memcmp (line, "#EXT", 4));
+}
+
+/**
+ * Classifies the byte at @p for scan_line(). Returns TRUE if it ends the
+ * line.
+ **/
+static inline gboolean
+scan_byte (const char  *p,
+           const char **cr,
+           guint       *flags)
+{
+        switch (*p) {
+        case '\n':
+                return TRUE;
+        case '\r':
+                if (!*cr)
+                        *cr = p;
+                break;
+        case '\\':
+                *flags |= LINE_HAS_BACKSLASH;
+                break;
+        case ':':
+                *flags |= LINE_HAS_COLON;
+                break;
+        default:
+                break;
+        }
+
+        return FALSE;
+}
+
+#if defined (__AVX2__) || defined (__SSE2__)
+
+#if defined (__AVX2__)
+typedef __m256i Vector;
+#define VECTOR_SIZE 32
+#define vector_load(p)        _mm256_loadu_si256 ((const __m256i *) (p))
+#define vector_splat(c)       _mm256_set1_epi8 (c)
+#define vector_eq(a, b)       _mm256_cmpeq_epi8 (a, b)
+#define vector_or(a, b)       _mm256_or_si256 (a, b)
+#define vector_mask(a)        ((guint32) _mm256_movemask_epi8 (a))
+#else
+typedef __m128i Vector;
+#define VECTOR_SIZE 16
+#define vector_load(p)        _mm_loadu_si128 ((const __m128i *) (p))
+#define vector_splat(c)       _mm_set1_epi8 (c)
+#define vector_eq(a, b)       _mm_cmpeq_epi8 (a, b)
+#define vector_or(a, b)       _mm_or_si128 (a, b)
+#define vector_mask(a)        ((guint32) _mm_movemask_epi8 (a))
+#endif
+
+/**
+ * Returns the end of the line starting at @p: the newline, or @end.
+ * @cr is set to the first carriage return in the line, if any, and
+ * @flags to what else of interest the line contains.
+ *
+ * This compares VECTOR_SIZE bytes at a time against all the bytes we
+ * care about, and only looks at individual bytes that matched.
+ **/
+static const char *
+scan_line (const char  *p,
+           const char  *end,
+           const char **cr,
+           guint       *flags)
+{
+        const Vector nl        = vector_splat ('\n');
+        const Vector cr_char   = vector_splat ('\r');
+        const Vector backslash = vector_splat ('\\');
+        const Vector colon     = vector_splat (':');
+
+        *cr = NULL;
+        *flags = 0;
+
+        while (end - p >= VECTOR_SIZE) {
+                Vector v;
+                guint32 mask;
+
+                v = vector_load (p);
+
+                mask = vector_mask (vector_or
+                                (vector_or (vector_eq (v, nl),
+                                            vector_eq (v, cr_char)),
+                                 vector_or (vector_eq (v, backslash),
+                                            vector_eq (v, colon))));
+
+                while (mask) {
+                        const char *match = p + __builtin_ctz (mask);
+
+                        if (scan_byte (match, cr, flags))
+                                return match;
+
+                        mask &= mask - 1;
+                }
+
+                p += VECTOR_SIZE;
+        }
+
+        for (; p < end; p++) {
+                if (scan_byte (p, cr, flags))
+                        return p;
+        }
+
+        return end;
+}
+
+#else
+
+/**
+ * Returns the end of the line starting at @p: the newline, or @end.
+ * @cr is set to the first carriage return in the line, if any, and
+ * @flags to what else of interest the line contains.
+ **/
+static const char *
+scan_line (const char  *p,
+           const char  *end,
+           const char **cr,
+           guint       *flags)
+{
+        *cr = NULL;
+        *flags = 0;
+
+        for (; p < end; p++) {
+                if (scan_byte (p, cr, flags))
+                        return p;
+        }
+
+        return end;
+}
+
+#endif
+
+/**
+ * Turns DOS path separators in @line into forward slashes.
+ **/
+static void
+convert_backslashes (char *line)
+{
+        for (; *line != '\0'; line++) {
+                if (*line == '\\')
+                        *line = '/';
+        }
+}
+
+/**
+ * Resolves the de-DOSed playlist line @line to an URI, converting DOS
+ * path separators in place. Returns @line itself if it already is an
+ * URI, a newly allocated URI otherwise, or NULL if @line is empty or
+ * cannot be converted.
+ **/
+static char *
+resolve_line (char       *line,
+              guint       flags,
+              const char *dirname)
+{
+        char *absolute, *uri;
+
+        if (line[0] == '\0') {
+                /**
+                 * Ignore empty lines.
+                 **/
+                return NULL;
+        }
+
+        if (flags & LINE_HAS_BACKSLASH)
+                convert_backslashes (line);
+
+        if ((flags & LINE_HAS_COLON) && strstr (line, "://")) {
+                /**
+                 * This already is an URI.
+                 **/
+                return line;
+        } else if (g_path_is_absolute (line)) {
+                /**
+                 * This is an absolute path.
+                 **/
+                return g_filename_to_uri (line, NULL, NULL);
+        }
+
+        /**
+         * This is a relative path.
+         **/
+        absolute = g_build_filename (dirname, line, NULL);
+        uri = g_filename_to_uri (absolute, NULL, NULL);
+        g_free (absolute);
+
+        return uri;
+}
+
+typedef gboolean (* LineFunc) (char    *line,
+                               guint    flags,
+                               gpointer user_data);
+
+/**
+ * Splits the M3U data between @start and @end into lines, terminates and
+ * de-DOSes them in place and calls @func for each line that is not a
+ * plain comment, until @func returns FALSE. @end must be the end of the data or
+ * directly follow a newline.
+ *
+ * Returns a copy of the last line if it was not terminated, as there is no
+ * room to terminate it in place. Lines passed to @func may point into it,
+ * so free it only when done with those.
+ **/
+static char *
+split_lines (char     *start,
+             char     *end,
+             LineFunc  func,
+             gpointer  user_data)
+{
+        const char *p;
+        char *last_line = NULL;
+
+        p = start;
+
+        while (p < end) {
+                const char *eol, *cr;
+                char *line;
+                guint flags;
+
+                eol = scan_line (p, end, &cr, &flags);
+
+                line = (char *) p;
+                p = (eol < end) ? eol + 1 : end;
+
+                if (line[0] == '#') {
+                        /**
+                         * Ignore comments, but not extended M3U
+                         * directives.
+                         **/
+                        if (!is_directive (line, eol))
+                                continue;
+
+                        flags |= LINE_IS_DIRECTIVE;
+                }
+
+                if (cr)
+                        eol = cr;
+
+                if (eol < end) {
+                        line[eol - line] = '\0';
+                } else {
+                        /**
+                         * The last line is not terminated, and we cannot
+                         * write past the end of the data.
+                         **/
+                        line = last_line = g_strndup (line, eol - line);
+                }
+
+                if (!func (line, flags, user_data))
+                        break;
+        }
+
+        return last_line;
+}
+
+/**
+ * What extended M3U directives told us about the next entry. Strings
+ * point into the directive lines.
+ **/
+typedef struct {
+        const char *title;
+        const char *artist;
+        int         duration; /* In seconds, -1 if unknown */
+} ExtInfo;
+
+static void
+ext_info_clear (ExtInfo *info)
+{
+        info->title    = NULL;
+        info->artist   = NULL;
+        info->duration = -1;
+}
+
+/**
+ * Returns @str if it is a non-empty, valid UTF-8 string, NULL otherwise.
+ **/
+static const char *
+valid_or_null (const char *str)
+{
+        if (!str || str[0] == '\0' || !g_utf8_validate (str, -1, NULL))
+                return NULL;
+
+        return str;
+}
+
+/**
+ * Parses the extended M3U directive @line into @info. The line is split
+ * up in place.
  **/
 static void
-got_absolute_path (PlaylistParser *parser,
-                   const char     *path)
+parse_directive (char    *line,
+                 ExtInfo *info)
+{
+        char *p, *sep;
+
+        if (!strncmp (line, "#EXTINF:", 8)) {
+                long duration;
+
+                /**
+                 * #EXTINF:duration,Artist - Title
+                 **/
+                duration = strtol (line + 8, &p, 10);
+                if (p > line + 8 && duration >= 0 && duration <= G_MAXINT)
+                        info->duration = duration;
+
+                p = strchr (p, ',');
+                if (!p)
+                        return;
+
+                p++;
+
+                sep = strstr (p, " - ");
+                if (sep) {
+                        *sep = '\0';
+
+                        info->artist = valid_or_null (p);
+                        p = sep + 3;
+                }
+
+                info->title = valid_or_null (p);
+        } else if (!strncmp (line, "#EXTART:", 8)) {
+                info->artist = valid_or_null (line + 8);
+        }
+}
+
+typedef struct _Sink Sink;
+
+/**
+ * Where the parsing functions deliver what they find. The sync API emits
+ * signals right away, the async API collects batches for the main loop.
+ **/
+struct _Sink {
+        void     (* start) (Sink       *sink);
+        gboolean (* entry) (Sink          *sink,
+                            const char    *uri,
+                            const ExtInfo *info);
+        void     (* end)   (Sink       *sink);
+
+        GCancellable *cancellable;
+
+        const char   *dirname;
+        ExtInfo       info;
+
+        /**
+         * Progress: @offset out of @total bytes are parsed. @base is the
+         * start of the data when parsing in place.
+         **/
+        const char   *base;
+        gsize         offset;
+        gsize         total;
+};
+
+/**
+ * Passes the URI for the de-DOSed M3U line @line on to @sink, along with
+ * what preceding directives said about it. Returns FALSE if parsing
+ * should stop.
+ **/
+static gboolean
+sink_line (char  *line,
+           guint  flags,
+           Sink  *sink)
 {
         char *uri;
+        gboolean ret;
 
-        uri = g_filename_to_uri (path, NULL, NULL);
-        if (!uri)
-                return;
-        
-        g_signal_emit (parser, signals[SIGNAL_ENTRY], 0, uri);
+        if (sink->base &&
+            line >= sink->base && line < sink->base + sink->total)
+                sink->offset = line - sink->base;
+
+        if (flags & LINE_IS_DIRECTIVE) {
+                parse_directive (line, &sink->info);
+
+                return TRUE;
+        }
+
+        if (line[0] == '\0')
+                return TRUE;
+
+        uri = resolve_line (line, flags, sink->dirname);
+        if (uri) {
+                ret = sink->entry (sink, uri, &sink->info);
+
+                if (uri != line)
+                        g_free (uri);
+        } else
+                ret = TRUE;
 
-        g_free (uri);
+        /**
+         * Directives only apply to the entry that follows them.
+         **/
+        ext_info_clear (&sink->info);
+
+        return ret;
 }
 
 /**
  * Parse @channel contents as M3U.
  **/
 static void
-parse_m3u (PlaylistParser *parser,
-           GIOChannel     *channel,
-           const char     *dirname)
+parse_m3u (GIOChannel *channel,
+           Sink       *sink)
 {
-        char *line, *p;
+        GSList *directives = NULL;
+        char *line;
         gsize length;
 
         /**
          * Signal start of playlist.
          **/
-        g_signal_emit (parser, signals[SIGNAL_PLAYLIST_START], 0);
+        sink->start (sink);
 
         /**
          * Parse @channel line by line.
@@ -167,149 +636,1500 @@ parse_m3u (PlaylistParser *parser,
                                        &length, 
                                        NULL,
                                        NULL) == G_IO_STATUS_NORMAL) {
+                const char *eol, *cr;
+                guint flags;
+                gboolean ret;
+
+                sink->offset += length;
+
+                eol = scan_line (line, line + length, &cr, &flags);
+
                 if (line[0] == '#') {
                         /**
-                         * Ignore comments.
+                         * Ignore comments, but not extended M3U
+                         * directives.
                          **/
-                        g_free (line);
+                        if (!is_directive (line, eol)) {
+                                g_free (line);
+
+                                continue;
+                        }
 
-                        continue;
+                        flags |= LINE_IS_DIRECTIVE;
                 }
 
                 /**
-                 * This is a normal line. First we de-DOS...
+                 * First we de-DOS...
                  **/
-                for (p = line; *p != '\0'; p++) {
-                        switch (*p) {
-                        case '\\':
-                                *p = '/';
-                                break;
-                        case '\r':
-                                *p = '\0';
-                                break;
-                        case '\n':
-                                *p = '\0';
-                                break;
-                        default:
-                                break;
-                        }
-                }
+                line[(cr ? cr : eol) - line] = '\0';
 
                 /**
                  * Now we process it.
                  **/
-                if (strstr (line, "://")) {
-                        /**
-                         * This already is an URI.
-                         **/
-                        g_signal_emit (parser, signals[SIGNAL_ENTRY], 0, line);
-                } else if (g_path_is_absolute (line)) {
-                        /**
-                         * This is an absolute path.
-                         **/
-                        got_absolute_path (parser, line);
+                ret = sink_line (line, flags, sink);
+
+                /**
+                 * Directive lines are pointed to by @sink until the next
+                 * entry.
+                 **/
+                if (flags & LINE_IS_DIRECTIVE) {
+                        directives = g_slist_prepend (directives, line);
                 } else {
-                        char *absolute;
+                        if (line[0] != '\0') {
+                                g_slist_foreach (directives,
+                                                 (GFunc) g_free,
+                                                 NULL);
+                                g_slist_free (directives);
+                                directives = NULL;
+                        }
 
-                        /**
-                         * This is a relative path.
-                         **/
-                        absolute = g_build_filename (dirname, line, NULL);
-                        got_absolute_path (parser, absolute);
-                        g_free (absolute);
+                        g_free (line);
                 }
 
-                g_free (line);
+                if (!ret)
+                        break;
         }
+
+        ext_info_clear (&sink->info);
+
+        g_slist_foreach (directives, (GFunc) g_free, NULL);
+        g_slist_free (directives);
         
         /**
          * Signal end of playlist.
          **/
-        g_signal_emit (parser, signals[SIGNAL_PLAYLIST_END], 0);
+        sink->end (sink);
 }
 
 /**
- * playlist_parser_scan_uri
- * @parser: A #PlaylistParser
- * @uri: An URI
- * @error: Location where to store a #GError if an error occurs.
- *
- * Parse @uri.
- *
- * Return value: TRUE on success, FALSE if an error occured in which case
- * @error is set as well.
+ * Playlists at least this big are split into chunks of CHUNK_SIZE bytes
+ * that are parsed in parallel.
  **/
-gboolean
-playlist_parser_parse (PlaylistParser *parser,
-                       const char     *uri,
-                       GError        **error)
-{
-        char *ext, *filename, *dirname;
-        GIOChannel *channel;
-        
-        g_return_val_if_fail (IS_PLAYLIST_PARSER (parser), FALSE);
-        g_return_val_if_fail (uri != NULL, FALSE);
+#define PARALLEL_MIN_SIZE (4 * 1024 * 1024)
+#define CHUNK_SIZE        (1024 * 1024)
 
-        /**
-         * Does @uri point to a M3U file?
-         **/
-        ext = strrchr (uri, '.');
-        if (!ext || g_ascii_strcasecmp (ext, ".m3u")) {
-                g_set_error (error,
-                             PLAYLIST_PARSER_ERROR,
-                             PLAYLIST_PARSER_ERROR_UNKNOWN_TYPE,
-                             "Unknown type");
+typedef struct {
+        char         *start;
+        char         *end;
+        const char   *dirname;
+        GCancellable *cancellable;
 
-                return FALSE;
-        }
+        GArray       *entries;   /* Entries found, in order */
+        GPtrArray    *allocated; /* URIs in @entries that need to be freed */
+        char         *last_line;
+        ExtInfo       info;
 
-        /**
-         * Does @uri point to a local file?
-         **/
-        if (g_ascii_strncasecmp (uri, "file:", 5)) {
-                g_set_error (error,
-                             PLAYLIST_PARSER_ERROR,
-                             PLAYLIST_PARSER_ERROR_UNSUPPORTED_SCHEME,
-                             "Unsupported scheme in URI '%s'",
-                             uri);
+        gboolean      done;
+} Chunk;
 
-                return FALSE;
-        }
+typedef struct {
+        const char *uri;
+        ExtInfo     info;
+} Entry;
 
-        /**
-         * Convert @uri to a filename.
-         **/
-        filename = g_filename_from_uri (uri, NULL, error);
-        if (!filename)
-                return FALSE;
+/**
+ * Stores the entry for the de-DOSed M3U line @line in @chunk.
+ **/
+static gboolean
+collect_line (char  *line,
+              guint  flags,
+              Chunk *chunk)
+{
+        Entry entry;
+        char *uri;
 
-        /**
-         * Open @filename for reading.
-         **/
-        channel = g_io_channel_new_file (filename, "r", error);
-        if (!channel) {
-                g_free (filename);
+        if (flags & LINE_IS_DIRECTIVE) {
+                parse_directive (line, &chunk->info);
 
-                return FALSE;
+                return TRUE;
         }
 
-        /**
-         * Pass channel to parser.
-         **/
-        dirname = g_path_get_dirname (filename);
-        parse_m3u (parser, channel, dirname);
-        g_free (dirname);
+        if (line[0] == '\0')
+                return TRUE;
 
-        /**
+        uri = resolve_line (line, flags, chunk->dirname);
+        if (uri) {
+                entry.uri  = uri;
+                entry.info = chunk->info;
+                g_array_append_val (chunk->entries, entry);
+
+                if (uri != line)
+                        g_ptr_array_add (chunk->allocated, uri);
+        }
+
+        ext_info_clear (&chunk->info);
+
+        return !g_cancellable_is_cancelled (chunk->cancellable);
+}
+
+/**
+ * Parses @chunk. Runs in a thread pool thread.
+ **/
+static void
+parse_chunk (gpointer data,
+             gpointer user_data)
+{
+        Chunk *chunk = data;
+        PlaylistParser *parser = user_data;
+        PlaylistParserPrivate *priv = parser->priv;
+
+        chunk->last_line = split_lines (chunk->start,
+                                        chunk->end,
+                                        (LineFunc) collect_line,
+                                        chunk);
+
+        g_mutex_lock (priv->chunk_mutex);
+
+        chunk->done = TRUE;
+        g_cond_broadcast (priv->chunk_cond);
+
+        g_mutex_unlock (priv->chunk_mutex);
+}
+
+/**
+ * Hands @chunk to the thread pool.
+ **/
+static void
+push_chunk (PlaylistParserPrivate *priv,
+            Chunk                 *chunk)
+{
+        chunk->entries   = g_array_new (FALSE, FALSE, sizeof (Entry));
+        chunk->allocated = g_ptr_array_new ();
+
+        ext_info_clear (&chunk->info);
+
+        g_thread_pool_push (priv->pool, chunk, NULL);
+}
+
+/**
+ * Parses the M3U data of @length bytes at @data using all CPUs. The data
+ * is split into chunks at line boundaries, which are parsed and resolved
+ * on the thread pool. We then pass the entries on chunk by chunk, in
+ * order, as soon as each chunk is done, pushing the next chunk in its
+ * place.
+ **/
+static void
+parse_m3u_parallel (PlaylistParser *parser,
+                    char           *data,
+                    gsize           length,
+                    Sink           *sink)
+{
+        PlaylistParserPrivate *priv = parser->priv;
+        Chunk *chunks;
+        char *start, *end;
+        gboolean stop;
+        int n_chunks, n_pushed, i;
+
+        chunks = g_new0 (Chunk, length / CHUNK_SIZE + 1);
+
+        start = data;
+        end = data + length;
+
+        for (n_chunks = 0; start < end; n_chunks++) {
+                Chunk *chunk = &chunks[n_chunks];
+                char *chunk_end, *line;
+                gboolean after_comment;
+
+                /**
+                 * Chunks end right after a newline, and not between
+                 * directives and the entry they apply to: a chunk
+                 * whose last line is a directive or a comment takes
+                 * the next line as well.
+                 **/
+                if (end - start > CHUNK_SIZE) {
+                        line = start + CHUNK_SIZE;
+                        while (line > start && line[-1] != '\n')
+                                line--;
+
+                        do {
+                                after_comment = *line == '#';
+
+                                chunk_end = memchr (line, '\n', end - line);
+                                chunk_end = chunk_end ? chunk_end + 1 : end;
+
+                                line = chunk_end;
+                        } while (chunk_end < end && after_comment);
+                } else
+                        chunk_end = end;
+
+                chunk->start       = start;
+                chunk->end         = chunk_end;
+                chunk->dirname     = sink->dirname;
+                chunk->cancellable = sink->cancellable;
+
+                start = chunk_end;
+        }
+
+        /**
+         * Only have as many chunks in flight as there are threads, so
+         * that no more than those are held in memory at once, and a
+         * sink that blocks holds up parsing.
+         **/
+        n_pushed = MIN (g_thread_pool_get_max_threads (priv->pool),
+                        n_chunks);
+        for (i = 0; i < n_pushed; i++)
+                push_chunk (priv, &chunks[i]);
+
+        stop = FALSE;
+
+        for (i = 0; i < n_pushed; i++) {
+                Chunk *chunk = &chunks[i];
+                guint j;
+
+                /**
+                 * Even when stopping, wait for every chunk pushed, as
+                 * they all point into @data.
+                 **/
+                g_mutex_lock (priv->chunk_mutex);
+                while (!chunk->done)
+                        g_cond_wait (priv->chunk_cond, priv->chunk_mutex);
+                g_mutex_unlock (priv->chunk_mutex);
+
+                sink->offset = chunk->start - data;
+
+                for (j = 0; j < chunk->entries->len && !stop; j++) {
+                        Entry *entry;
+
+                        entry = &g_array_index (chunk->entries, Entry, j);
+                        stop = !sink->entry (sink, entry->uri, &entry->info);
+                }
+
+                g_ptr_array_foreach (chunk->allocated, (GFunc) g_free, NULL);
+                g_ptr_array_free (chunk->allocated, TRUE);
+                g_array_free (chunk->entries, TRUE);
+                g_free (chunk->last_line);
+
+                if (!stop && n_pushed < n_chunks)
+                        push_chunk (priv, &chunks[n_pushed++]);
+        }
+
+        g_free (chunks);
+}
+
+/**
+ * Parse the M3U playlist of @length bytes at @data in place. @data
+ * must be writable. Lines are terminated and de-DOSed where they are,
+ * so that no line needs to be copied.
+ **/
+static void
+parse_m3u_data (PlaylistParser *parser,
+                char           *data,
+                gsize           length,
+                Sink           *sink)
+{
+        /**
+         * Signal start of playlist.
+         **/
+        sink->start (sink);
+
+        sink->base  = data;
+        sink->total = length;
+
+        if (length >= PARALLEL_MIN_SIZE && parser->priv->pool) {
+                parse_m3u_parallel (parser, data, length, sink);
+        } else {
+                char *last_line;
+
+                last_line = split_lines (data,
+                                         data + length,
+                                         (LineFunc) sink_line,
+                                         sink);
+                g_free (last_line);
+        }
+        
+        sink->base   = NULL;
+        sink->offset = length;
+
+        ext_info_clear (&sink->info);
+
+        /**
+         * Signal end of playlist.
+         **/
+        sink->end (sink);
+}
+
+/**
+ * Where a PLS entry is being collected. PLS files list File, Title and
+ * Length keys numbered per entry; we pass an entry on as soon as a key
+ * for another number comes along, so that nothing but the current entry
+ * is kept in memory.
+ **/
+typedef struct {
+        Sink  *sink;
+
+        int    index;
+        char  *uri;
+        char  *title;
+        int    duration;
+} PlsState;
+
+/**
+ * Passes the entry collected in @state on to its sink. Returns FALSE if
+ * parsing should stop.
+ **/
+static gboolean
+pls_flush (PlsState *state)
+{
+        Sink *sink = state->sink;
+        gboolean ret = TRUE;
+
+        if (state->uri) {
+                ExtInfo info;
+
+                info.title    = state->title;
+                info.artist   = NULL;
+                info.duration = state->duration;
+
+                ret = sink->entry (sink, state->uri, &info);
+        }
+
+        g_free (state->uri);
+        state->uri = NULL;
+
+        g_free (state->title);
+        state->title = NULL;
+
+        state->duration = -1;
+
+        return ret;
+}
+
+/**
+ * Processes the de-DOSed PLS line @line.
+ **/
+static gboolean
+pls_line (char     *line,
+          guint     flags,
+          PlsState *state)
+{
+        char *value, *p;
+        int key_length, index;
+
+        if (state->sink->base &&
+            line >= state->sink->base &&
+            line < state->sink->base + state->sink->total)
+                state->sink->offset = line - state->sink->base;
+
+        value = strchr (line, '=');
+        if (!value)
+                return TRUE;
+
+        /**
+         * Split "KeyN=value".
+         **/
+        for (p = value; p > line && g_ascii_isdigit (p[-1]); p--)
+                ;
+
+        if (p == value)
+                return TRUE;
+
+        key_length = p - line;
+        index = atoi (p);
+        value++;
+
+        if (index != state->index) {
+                if (!pls_flush (state))
+                        return FALSE;
+
+                state->index = index;
+        }
+
+        if (key_length == 4 && !g_ascii_strncasecmp (line, "File", 4)) {
+                char *uri;
+
+                uri = resolve_line (value, flags, state->sink->dirname);
+                if (uri == value)
+                        uri = g_strdup (uri);
+
+                g_free (state->uri);
+                state->uri = uri;
+        } else if (key_length == 5 &&
+                   !g_ascii_strncasecmp (line, "Title", 5)) {
+                g_free (state->title);
+                state->title = g_strdup (valid_or_null (value));
+        } else if (key_length == 6 &&
+                   !g_ascii_strncasecmp (line, "Length", 6)) {
+                state->duration = atoi (value);
+                if (state->duration < 0)
+                        state->duration = -1;
+        }
+
+        return !g_cancellable_is_cancelled (state->sink->cancellable);
+}
+
+/**
+ * Parse the PLS playlist from either @channel, or the @length bytes at
+ * @data if @channel is NULL. @data is modified in place.
+ **/
+static void
+parse_pls (GIOChannel *channel,
+           char       *data,
+           gsize       length,
+           Sink       *sink)
+{
+        PlsState state;
+
+        sink->start (sink);
+
+        state.sink     = sink;
+        state.index    = 0;
+        state.uri      = NULL;
+        state.title    = NULL;
+        state.duration = -1;
+
+        if (channel) {
+                char *line;
+                gsize line_length;
+
+                while (g_io_channel_read_line (channel,
+                                               &line,
+                                               &line_length,
+                                               NULL,
+                                               NULL) == G_IO_STATUS_NORMAL) {
+                        const char *eol, *cr;
+                        guint flags;
+                        gboolean ret;
+
+                        sink->offset += line_length;
+
+                        eol = scan_line (line, line + line_length,
+                                         &cr, &flags);
+                        line[(cr ? cr : eol) - line] = '\0';
+
+                        ret = pls_line (line, flags, &state);
+
+                        g_free (line);
+
+                        if (!ret)
+                                break;
+                }
+        } else {
+                char *last_line;
+
+                sink->base  = data;
+                sink->total = length;
+
+                last_line = split_lines (data,
+                                         data + length,
+                                         (LineFunc) pls_line,
+                                         &state);
+                g_free (last_line);
+
+                sink->base   = NULL;
+                sink->offset = length;
+        }
+
+        if (!g_cancellable_is_cancelled (sink->cancellable))
+                pls_flush (&state);
+
+        g_free (state.uri);
+        g_free (state.title);
+
+        sink->end (sink);
+}
+
+/**
+ * XSPF is fed to the markup parser in blocks of this size, so that
+ * memory use does not depend on the size of the playlist.
+ **/
+#define XSPF_BLOCK_SIZE (64 * 1024)
+
+typedef enum {
+        XSPF_FIELD_NONE,
+        XSPF_FIELD_LOCATION,
+        XSPF_FIELD_TITLE,
+        XSPF_FIELD_CREATOR,
+        XSPF_FIELD_DURATION
+} XspfField;
+
+typedef struct {
+        Sink      *sink;
+
+        int        depth;
+        int        track_depth; /* Depth of the open <track>, or 0 */
+        XspfField  field;       /* Track field whose text we collect */
+        GString   *text;
+
+        char      *location;
+        char      *title;
+        char      *creator;
+        int        duration;
+} XspfState;
+
+/**
+ * Returns @name without any namespace prefix.
+ **/
+static const char *
+local_name (const char *name)
+{
+        const char *colon;
+
+        colon = strrchr (name, ':');
+
+        return colon ? colon + 1 : name;
+}
+
+static void
+xspf_start_element (GMarkupParseContext *context,
+                    const char          *element_name,
+                    const char         **attribute_names,
+                    const char         **attribute_values,
+                    gpointer             user_data,
+                    GError             **error)
+{
+        XspfState *state = user_data;
+        const char *name;
+
+        state->depth++;
+
+        name = local_name (element_name);
+
+        if (!state->track_depth) {
+                if (!strcmp (name, "track"))
+                        state->track_depth = state->depth;
+
+                return;
+        }
+
+        if (state->depth != state->track_depth + 1)
+                return;
+
+        if (!strcmp (name, "location") && !state->location)
+                state->field = XSPF_FIELD_LOCATION;
+        else if (!strcmp (name, "title"))
+                state->field = XSPF_FIELD_TITLE;
+        else if (!strcmp (name, "creator"))
+                state->field = XSPF_FIELD_CREATOR;
+        else if (!strcmp (name, "duration"))
+                state->field = XSPF_FIELD_DURATION;
+
+        g_string_truncate (state->text, 0);
+}
+
+/**
+ * Resolves the XSPF location @location, which should be an URI, but may
+ * be relative to the playlist.
+ **/
+static char *
+resolve_location (const char *location,
+                  const char *dirname)
+{
+        char *path, *uri;
+
+        if (strstr (location, "://"))
+                return g_strdup (location);
+
+        path = g_uri_unescape_string (location, NULL);
+        if (!path)
+                return NULL;
+
+        uri = resolve_line (path, LINE_HAS_COLON, dirname);
+        if (uri != path)
+                g_free (path);
+
+        return uri;
+}
+
+static void
+xspf_end_element (GMarkupParseContext *context,
+                  const char          *element_name,
+                  gpointer             user_data,
+                  GError             **error)
+{
+        XspfState *state = user_data;
+        Sink *sink = state->sink;
+
+        if (state->field != XSPF_FIELD_NONE) {
+                char *text;
+
+                text = g_strstrip (state->text->str);
+
+                switch (state->field) {
+                case XSPF_FIELD_LOCATION:
+                        state->location = resolve_location (text,
+                                                            sink->dirname);
+                        break;
+                case XSPF_FIELD_TITLE:
+                        g_free (state->title);
+                        state->title = g_strdup (valid_or_null (text));
+                        break;
+                case XSPF_FIELD_CREATOR:
+                        g_free (state->creator);
+                        state->creator = g_strdup (valid_or_null (text));
+                        break;
+                case XSPF_FIELD_DURATION:
+                        /**
+                         * In milliseconds.
+                         **/
+                        state->duration = atoi (text) / 1000;
+                        if (state->duration < 0)
+                                state->duration = -1;
+                        break;
+                default:
+                        break;
+                }
+
+                state->field = XSPF_FIELD_NONE;
+        } else if (state->depth == state->track_depth) {
+                gboolean ret = TRUE;
+
+                if (state->location) {
+                        ExtInfo info;
+
+                        info.title    = state->title;
+                        info.artist   = state->creator;
+                        info.duration = state->duration;
+
+                        ret = sink->entry (sink, state->location, &info);
+                }
+
+                g_free (state->location);
+                state->location = NULL;
+
+                g_free (state->title);
+                state->title = NULL;
+
+                g_free (state->creator);
+                state->creator = NULL;
+
+                state->duration = -1;
+                state->track_depth = 0;
+
+                if (!ret) {
+                        g_set_error (error,
+                                     G_IO_ERROR,
+                                     G_IO_ERROR_CANCELLED,
+                                     "Operation was cancelled");
+                }
+        }
+
+        state->depth--;
+}
+
+static void
+xspf_text (GMarkupParseContext *context,
+           const char          *text,
+           gsize                text_len,
+           gpointer             user_data,
+           GError             **error)
+{
+        XspfState *state = user_data;
+
+        if (state->field != XSPF_FIELD_NONE)
+                g_string_append_len (state->text, text, text_len);
+}
+
+static const GMarkupParser xspf_parser = {
+        xspf_start_element,
+        xspf_end_element,
+        xspf_text,
+        NULL,
+        NULL
+};
+
+/**
+ * Parse the XSPF playlist from either @channel, or the @length bytes at
+ * @data if @channel is NULL, without building a document tree.
+ **/
+static gboolean
+parse_xspf (GIOChannel *channel,
+            const char *data,
+            gsize       length,
+            Sink       *sink,
+            GError    **error)
+{
+        GMarkupParseContext *context;
+        XspfState state;
+        gboolean ret;
+
+        sink->start (sink);
+
+        memset (&state, 0, sizeof (XspfState));
+
+        state.sink     = sink;
+        state.text     = g_string_new (NULL);
+        state.duration = -1;
+
+        context = g_markup_parse_context_new (&xspf_parser, 0, &state, NULL);
+
+        ret = TRUE;
+
+        if (channel) {
+                char *buffer;
+                gsize n_read;
+
+                buffer = g_malloc (XSPF_BLOCK_SIZE);
+
+                while (ret &&
+                       g_io_channel_read_chars (channel,
+                                                buffer,
+                                                XSPF_BLOCK_SIZE,
+                                                &n_read,
+                                                error) == G_IO_STATUS_NORMAL) {
+                        sink->offset += n_read;
+
+                        ret = g_markup_parse_context_parse (context,
+                                                            buffer,
+                                                            n_read,
+                                                            error);
+                }
+
+                if (error && *error)
+                        ret = FALSE;
+
+                g_free (buffer);
+        } else {
+                gsize offset;
+
+                sink->total = length;
+
+                for (offset = 0; ret && offset < length;
+                     offset += XSPF_BLOCK_SIZE) {
+                        sink->offset = offset;
+
+                        ret = g_markup_parse_context_parse
+                                        (context,
+                                         data + offset,
+                                         MIN (XSPF_BLOCK_SIZE,
+                                              length - offset),
+                                         error);
+                }
+
+                sink->offset = length;
+        }
+
+        if (ret)
+                ret = g_markup_parse_context_end_parse (context, error);
+
+        g_markup_parse_context_free (context);
+
+        g_string_free (state.text, TRUE);
+        g_free (state.location);
+        g_free (state.title);
+        g_free (state.creator);
+
+        sink->end (sink);
+
+        return ret;
+}
+
+typedef enum {
+        FORMAT_UNKNOWN,
+        FORMAT_M3U,
+        FORMAT_PLS,
+        FORMAT_XSPF
+} Format;
+
+/**
+ * How much of a playlist we look at to recognize its format.
+ **/
+#define SNIFF_SIZE 512
+
+/**
+ * Recognizes the playlist format by the @length bytes at @data, which
+ * are the start of the playlist, and failing that, by the extension
+ * of @uri.
+ **/
+static Format
+detect_format (const char *uri,
+               const char *data,
+               gsize       length)
+{
+        const char *p, *end, *ext;
+
+        p = data;
+        end = data + MIN (length, SNIFF_SIZE);
+
+        /**
+         * Skip byte order mark and white space.
+         **/
+        if (end - p >= 3 && !memcmp (p, "\xef\xbb\xbf", 3))
+                p += 3;
+
+        while (p < end && g_ascii_isspace (*p))
+                p++;
+
+        if (end - p >= 10 && !g_ascii_strncasecmp (p, "[playlist]", 10))
+                return FORMAT_PLS;
+        else if (end - p >= 7 && !memcmp (p, "#EXTM3U", 7))
+                return FORMAT_M3U;
+        else if (p < end && *p == '<' &&
+                 g_strstr_len (p, end - p, "<playlist"))
+                return FORMAT_XSPF;
+
+        ext = strrchr (uri, '.');
+        if (!ext)
+                return FORMAT_UNKNOWN;
+
+        if (!g_ascii_strcasecmp (ext, ".m3u") ||
+            !g_ascii_strcasecmp (ext, ".m3u8"))
+                return FORMAT_M3U;
+        else if (!g_ascii_strcasecmp (ext, ".pls"))
+                return FORMAT_PLS;
+        else if (!g_ascii_strcasecmp (ext, ".xspf"))
+                return FORMAT_XSPF;
+
+        return FORMAT_UNKNOWN;
+}
+
+static void
+set_unknown_type_error (GError **error)
+{
+        g_set_error (error,
+                     PLAYLIST_PARSER_ERROR,
+                     PLAYLIST_PARSER_ERROR_UNKNOWN_TYPE,
+                     "Unknown type");
+}
+
+/**
+ * Maps @filename into memory, copy-on-write, so that it can be parsed in
+ * place without the changes ending up on disk. Empty files are not
+ * mapped, in which case @data is set to NULL.
+ *
+ * Returns FALSE if @filename could not be mapped.
+ **/
+static gboolean
+map_file (const char *filename,
+          char      **data,
+          gsize      *length)
+{
+        struct stat st;
+        void *map;
+        int fd;
+
+        fd = open (filename, O_RDONLY);
+        if (fd < 0)
+                return FALSE;
+
+        if (fstat (fd, &st) < 0) {
+                close (fd);
+
+                return FALSE;
+        }
+
+        if (st.st_size == 0) {
+                close (fd);
+
+                *data = NULL;
+                *length = 0;
+
+                return TRUE;
+        }
+
+        map = mmap (NULL,
+                    st.st_size,
+                    PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE,
+                    fd,
+                    0);
+
+        close (fd);
+
+        if (map == MAP_FAILED)
+                return FALSE;
+
+        madvise (map, st.st_size, MADV_SEQUENTIAL);
+
+        *data = map;
+        *length = st.st_size;
+
+        return TRUE;
+}
+
+/**
+ * Parse @uri, passing what is found on to @sink. Returns FALSE and sets
+ * @error if @uri could not be parsed or parsing was cancelled.
+ **/
+static gboolean
+parse (PlaylistParser *parser,
+       const char     *uri,
+       Sink           *sink,
+       GError        **error)
+{
+        char *filename, *dirname, *data;
+        char head[SNIFF_SIZE];
+        gsize length, head_length;
+        GIOChannel *channel;
+        struct stat st;
+        gboolean ret;
+        
+        /**
+         * Does @uri point to a local file?
+         **/
+        if (g_ascii_strncasecmp (uri, "file:", 5)) {
+                g_set_error (error,
+                             PLAYLIST_PARSER_ERROR,
+                             PLAYLIST_PARSER_ERROR_UNSUPPORTED_SCHEME,
+                             "Unsupported scheme in URI '%s'",
+                             uri);
+
+                return FALSE;
+        }
+
+        /**
+         * Convert @uri to a filename.
+         **/
+        filename = g_filename_from_uri (uri, NULL, error);
+        if (!filename)
+                return FALSE;
+
+        dirname = g_path_get_dirname (filename);
+        sink->dirname = dirname;
+
+        /**
+         * Map @filename into memory, and parse it there.
+         **/
+        if (map_file (filename, &data, &length)) {
+                switch (detect_format (uri, data, length)) {
+                case FORMAT_M3U:
+                        parse_m3u_data (parser, data, length, sink);
+                        ret = TRUE;
+                        break;
+                case FORMAT_PLS:
+                        parse_pls (NULL, data, length, sink);
+                        ret = TRUE;
+                        break;
+                case FORMAT_XSPF:
+                        ret = parse_xspf (NULL, data, length, sink, error);
+                        break;
+                default:
+                        set_unknown_type_error (error);
+                        ret = FALSE;
+                        break;
+                }
+
+                if (data)
+                        munmap (data, length);
+
+                g_free (dirname);
+                g_free (filename);
+
+                if (ret) {
+                        ret = !g_cancellable_set_error_if_cancelled
+                                                (sink->cancellable, error);
+                }
+
+                return ret;
+        }
+
+        /**
+         * Could not map @filename. Open @filename for reading instead.
+         **/
+        channel = g_io_channel_new_file (filename, "r", error);
+        if (!channel) {
+                g_free (dirname);
+                g_free (filename);
+
+                return FALSE;
+        }
+
+        g_io_channel_set_encoding (channel, NULL, NULL);
+
+        if (stat (filename, &st) == 0)
+                sink->total = st.st_size;
+
+        /**
+         * Sniff the format and rewind.
+         **/
+        head_length = 0;
+        g_io_channel_read_chars (channel,
+                                 head,
+                                 SNIFF_SIZE,
+                                 &head_length,
+                                 NULL);
+        g_io_channel_seek_position (channel, 0, G_SEEK_SET, NULL);
+
+        /**
+         * Pass channel to parser.
+         **/
+        switch (detect_format (uri, head, head_length)) {
+        case FORMAT_M3U:
+                parse_m3u (channel, sink);
+                ret = TRUE;
+                break;
+        case FORMAT_PLS:
+                parse_pls (channel, NULL, 0, sink);
+                ret = TRUE;
+                break;
+        case FORMAT_XSPF:
+                ret = parse_xspf (channel, NULL, 0, sink, error);
+                break;
+        default:
+                set_unknown_type_error (error);
+                ret = FALSE;
+                break;
+        }
+
+        g_free (dirname);
+
+        /**
          * Cleanup.
          **/
         g_io_channel_unref (channel);
 
         g_free (filename);
 
+        if (ret) {
+                ret = !g_cancellable_set_error_if_cancelled
+                                                (sink->cancellable, error);
+        }
+
+        return ret;
+}
+
+typedef struct {
+        Sink sink;
+
+        PlaylistParser *parser;
+} EmitSink;
+
+static void
+emit_start (Sink *sink)
+{
+        g_signal_emit (((EmitSink *) sink)->parser,
+                       signals[SIGNAL_PLAYLIST_START], 0);
+}
+
+static gboolean
+emit_entry (Sink          *sink,
+            const char    *uri,
+            const ExtInfo *info)
+{
+        g_signal_emit (((EmitSink *) sink)->parser,
+                       signals[SIGNAL_ENTRY], 0,
+                       uri, info->title, info->artist, info->duration);
+
         return TRUE;
 }
 
+static void
+emit_end (Sink *sink)
+{
+        g_signal_emit (((EmitSink *) sink)->parser,
+                       signals[SIGNAL_PLAYLIST_END], 0);
+}
+
+/**
+ * playlist_parser_parse
+ * @parser: A #PlaylistParser
+ * @uri: An URI
+ * @error: Location where to store a #GError if an error occurs.
+ *
+ * Parse @uri. All signals are emitted before this function returns.
+ *
+ * Return value: TRUE on success, FALSE if an error occured in which case
+ * @error is set as well.
+ **/
+gboolean
+playlist_parser_parse (PlaylistParser *parser,
+                       const char     *uri,
+                       GError        **error)
+{
+        EmitSink emit_sink;
+
+        g_return_val_if_fail (IS_PLAYLIST_PARSER (parser), FALSE);
+        g_return_val_if_fail (uri != NULL, FALSE);
+
+        memset (&emit_sink, 0, sizeof (EmitSink));
+
+        emit_sink.sink.start = emit_start;
+        emit_sink.sink.entry = emit_entry;
+        emit_sink.sink.end   = emit_end;
+        emit_sink.parser     = parser;
+
+        ext_info_clear (&emit_sink.sink.info);
+
+        return parse (parser, uri, &emit_sink.sink, error);
+}
+
+/**
+ * Entries found by the parsing thread are delivered to the main loop in
+ * batches of at most BATCH_SIZE, one batch per main loop iteration. The
+ * parsing thread waits while MAX_QUEUED_BATCHES are not delivered yet.
+ **/
+#define BATCH_SIZE         256
+#define MAX_QUEUED_BATCHES 16
+
+typedef struct {
+        GArray *entries; /* Entries owning their strings */
+        double  progress;
+} Batch;
+
+typedef struct {
+        Sink sink;
+
+        PlaylistParser     *parser;
+        GSimpleAsyncResult *result;
+        GCancellable       *cancellable;
+        char               *uri;
+
+        /**
+         * Owned by the parsing thread.
+         **/
+        GArray             *batch;
+
+        /**
+         * Protected by @mutex.
+         **/
+        GMutex             *mutex;
+        GCond              *cond;
+        GQueue             *batches;
+        gboolean            finished;
+        GError             *error;
+        guint               idle_id;
+
+        /**
+         * Owned by the main thread.
+         **/
+        gboolean            started;
+} ParseJob;
+
+static GArray *
+entries_new (void)
+{
+        return g_array_sized_new (FALSE, FALSE, sizeof (Entry), BATCH_SIZE);
+}
+
+static void
+entries_free (GArray *entries)
+{
+        guint i;
+
+        for (i = 0; i < entries->len; i++) {
+                Entry *entry = &g_array_index (entries, Entry, i);
+
+                g_free ((char *) entry->uri);
+                g_free ((char *) entry->info.title);
+                g_free ((char *) entry->info.artist);
+        }
+
+        g_array_free (entries, TRUE);
+}
+
+static void
+batch_free (Batch *batch)
+{
+        entries_free (batch->entries);
+
+        g_slice_free (Batch, batch);
+}
+
+static void
+parse_job_free (ParseJob *job)
+{
+        g_queue_foreach (job->batches, (GFunc) batch_free, NULL);
+        g_queue_free (job->batches);
+
+        entries_free (job->batch);
+
+        if (job->error)
+                g_error_free (job->error);
+
+        g_mutex_free (job->mutex);
+        g_cond_free (job->cond);
+
+        if (job->cancellable)
+                g_object_unref (job->cancellable);
+
+        g_object_unref (job->result);
+        g_object_unref (job->parser);
+
+        g_free (job->uri);
+
+        g_slice_free (ParseJob, job);
+}
+
+static gboolean
+deliver_batch (ParseJob *job);
+
+/**
+ * Makes sure deliver_batch() runs. Call with @job's mutex held.
+ **/
+static void
+schedule_delivery (ParseJob *job)
+{
+        if (!job->idle_id)
+                job->idle_id = g_idle_add ((GSourceFunc) deliver_batch, job);
+}
+
+/**
+ * Hands the current batch over to the main loop. Runs in the parsing
+ * thread.
+ **/
+static void
+queue_batch (ParseJob *job)
+{
+        Batch *batch;
+
+        batch = g_slice_new (Batch);
+        batch->entries = job->batch;
+        batch->progress = job->sink.total ?
+                          (double) job->sink.offset / job->sink.total : 0.0;
+
+        job->batch = entries_new ();
+
+        g_mutex_lock (job->mutex);
+
+        while (job->batches->length >= MAX_QUEUED_BATCHES &&
+               !g_cancellable_is_cancelled (job->cancellable))
+                g_cond_wait (job->cond, job->mutex);
+
+        g_queue_push_tail (job->batches, batch);
+        schedule_delivery (job);
+
+        g_mutex_unlock (job->mutex);
+}
+
+static void
+job_start (Sink *sink)
+{
+}
+
+static gboolean
+job_entry (Sink          *sink,
+           const char    *uri,
+           const ExtInfo *info)
+{
+        ParseJob *job = (ParseJob *) sink;
+        Entry entry;
+
+        entry.uri = g_strdup (uri);
+        entry.info.title    = g_strdup (info->title);
+        entry.info.artist   = g_strdup (info->artist);
+        entry.info.duration = info->duration;
+        g_array_append_val (job->batch, entry);
+
+        if (job->batch->len >= BATCH_SIZE)
+                queue_batch (job);
+
+        return !g_cancellable_is_cancelled (job->cancellable);
+}
+
+static void
+job_end (Sink *sink)
+{
+        ParseJob *job = (ParseJob *) sink;
+
+        if (job->batch->len > 0)
+                queue_batch (job);
+}
+
+/**
+ * Parses @job's URI. Runs in its own thread.
+ **/
+static gpointer
+parse_thread (ParseJob *job)
+{
+        GError *error = NULL;
+
+        parse (job->parser, job->uri, &job->sink, &error);
+
+        g_mutex_lock (job->mutex);
+
+        job->finished = TRUE;
+        job->error = error;
+        schedule_delivery (job);
+
+        g_mutex_unlock (job->mutex);
+
+        return NULL;
+}
+
+/**
+ * Emits the signals for the next batch of @job, or completes @job if
+ * the parsing thread is done and everything was delivered.
+ **/
+static gboolean
+deliver_batch (ParseJob *job)
+{
+        Batch *batch;
+        gboolean cancelled, finished;
+        guint i;
+
+        g_mutex_lock (job->mutex);
+
+        cancelled = g_cancellable_is_cancelled (job->cancellable);
+        if (cancelled) {
+                /**
+                 * Drop what is left, and wake up the parsing thread so
+                 * that it notices.
+                 **/
+                g_queue_foreach (job->batches, (GFunc) batch_free, NULL);
+                g_queue_clear (job->batches);
+        }
+
+        batch = g_queue_pop_head (job->batches);
+        finished = job->finished && g_queue_is_empty (job->batches);
+
+        if (!batch && !finished)
+                job->idle_id = 0;
+
+        g_cond_broadcast (job->cond);
+
+        g_mutex_unlock (job->mutex);
+
+        if (batch) {
+                if (!job->started) {
+                        job->started = TRUE;
+
+                        g_signal_emit (job->parser,
+                                       signals[SIGNAL_PLAYLIST_START], 0);
+                }
+
+                for (i = 0; i < batch->entries->len; i++) {
+                        Entry *entry;
+
+                        /**
+                         * A signal handler might have cancelled us.
+                         **/
+                        if (g_cancellable_is_cancelled (job->cancellable))
+                                break;
+
+                        entry = &g_array_index (batch->entries, Entry, i);
+
+                        g_signal_emit (job->parser,
+                                       signals[SIGNAL_ENTRY],
+                                       0,
+                                       entry->uri,
+                                       entry->info.title,
+                                       entry->info.artist,
+                                       entry->info.duration);
+                }
+
+                if (i == batch->entries->len) {
+                        g_signal_emit (job->parser,
+                                       signals[SIGNAL_PROGRESS],
+                                       0,
+                                       batch->progress);
+                }
+
+                batch_free (batch);
+
+                return TRUE;
+        }
+
+        if (!finished)
+                return FALSE;
+
+        /**
+         * All done.
+         **/
+        if (job->error) {
+                g_simple_async_result_set_from_error (job->result,
+                                                      job->error);
+        } else if (cancelled) {
+                g_simple_async_result_set_error (job->result,
+                                                 G_IO_ERROR,
+                                                 G_IO_ERROR_CANCELLED,
+                                                 "Operation was cancelled");
+        } else {
+                if (!job->started) {
+                        g_signal_emit (job->parser,
+                                       signals[SIGNAL_PLAYLIST_START], 0);
+                }
+
+                g_signal_emit (job->parser,
+                               signals[SIGNAL_PLAYLIST_END], 0);
+        }
+
+        g_simple_async_result_complete (job->result);
+
+        parse_job_free (job);
+
+        return FALSE;
+}
+
+/**
+ * playlist_parser_parse_async
+ * @parser: A #PlaylistParser
+ * @uri: An URI
+ * @cancellable: Optional #GCancellable, or NULL
+ * @callback: A #GAsyncReadyCallback to call when done
+ * @user_data: The data to pass to @callback
+ *
+ * Parse @uri in a separate thread. The signals are emitted from the main
+ * loop as the playlist is parsed, entries in batches of a bounded size,
+ * each followed by 'progress'. Once @cancellable is cancelled no more
+ * signals are emitted.
+ *
+ * When done, @callback is called, which should call
+ * playlist_parser_parse_finish().
+ **/
+void
+playlist_parser_parse_async (PlaylistParser     *parser,
+                             const char         *uri,
+                             GCancellable       *cancellable,
+                             GAsyncReadyCallback callback,
+                             gpointer            user_data)
+{
+        ParseJob *job;
+        GError *error;
+
+        g_return_if_fail (IS_PLAYLIST_PARSER (parser));
+        g_return_if_fail (uri != NULL);
+
+        job = g_slice_new0 (ParseJob);
+
+        job->sink.start       = job_start;
+        job->sink.entry       = job_entry;
+        job->sink.end         = job_end;
+        job->sink.cancellable = cancellable;
+
+        ext_info_clear (&job->sink.info);
+
+        job->parser = g_object_ref (parser);
+        job->result = g_simple_async_result_new (G_OBJECT (parser),
+                                                 callback,
+                                                 user_data,
+                                                 playlist_parser_parse_async);
+        job->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+        job->uri = g_strdup (uri);
+
+        job->batch   = entries_new ();
+        job->mutex   = g_mutex_new ();
+        job->cond    = g_cond_new ();
+        job->batches = g_queue_new ();
+
+        error = NULL;
+        if (!g_thread_create ((GThreadFunc) parse_thread, job, FALSE, &error)) {
+                g_simple_async_result_set_from_error (job->result, error);
+                g_simple_async_result_complete_in_idle (job->result);
+
+                g_error_free (error);
+
+                parse_job_free (job);
+        }
+}
+
+/**
+ * playlist_parser_parse_finish
+ * @parser: A #PlaylistParser
+ * @result: The #GAsyncResult passed to the callback
+ * @error: Location where to store a #GError if an error occurs.
+ *
+ * Finishes an operation started with playlist_parser_parse_async().
+ *
+ * Return value: TRUE on success, FALSE if an error occured or the
+ * operation was cancelled, in which case @error is set as well.
+ **/
+gboolean
+playlist_parser_parse_finish (PlaylistParser *parser,
+                              GAsyncResult   *result,
+                              GError        **error)
+{
+        GSimpleAsyncResult *simple;
+
+        g_return_val_if_fail (IS_PLAYLIST_PARSER (parser), FALSE);
+        g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (result), FALSE);
+
+        simple = G_SIMPLE_ASYNC_RESULT (result);
+
+        g_return_val_if_fail (g_simple_async_result_get_source_tag (simple) ==
+                              playlist_parser_parse_async, FALSE);
+
+        return !g_simple_async_result_propagate_error (simple, error);
+}
+
 /**
  * Returns the playlist parser error quark.
  **/
@@ -23,6 +23,7 @@
 #define __PLAYLIST_PARSER_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -57,10 +58,12 @@ GQuark playlist_parser_error_quark (void);
                  TYPE_PLAYLIST_PARSER, \
                  PlaylistParserClass))
 
+typedef struct _PlaylistParserPrivate PlaylistParserPrivate;
+
 typedef struct {
         GObject parent;
 
-        gpointer _reserved;
+        PlaylistParserPrivate *priv;
 } PlaylistParser;
 
 typedef struct {
@@ -70,7 +73,12 @@ typedef struct {
         void (* playlist_start) (PlaylistParser *parser);
         void (* playlist_end)   (PlaylistParser *parser);
         void (* entry)          (PlaylistParser *parser,
-                                 const char     *uri);
+                                 const char     *uri,
+                                 const char     *title,
+                                 const char     *artist,
+                                 int             duration);
+        void (* progress)       (PlaylistParser *parser,
+                                 double          fraction);
 
         /* Future padding */
         void (* _reserved1) (void);
@@ -90,6 +98,20 @@ playlist_parser_parse    (PlaylistParser *parser,
                           const char     *uri,
                           GError        **error);
 
+void
+playlist_parser_parse_async
+                         (PlaylistParser     *parser,
+                          const char         *uri,
+                          GCancellable       *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer            user_data);
+
+gboolean
+playlist_parser_parse_finish
+                         (PlaylistParser *parser,
+                          GAsyncResult   *result,
+                          GError        **error);
+
 G_END_DECLS
 
 #endif /* __PLAYLIST_PARSER_H__ */
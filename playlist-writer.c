@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "playlist-writer.h"
+
+/**
+ * Rows are formatted straight into a fixed buffer, which is written out
+ * whenever it fills up. Nothing is allocated per row, and memory use does
+ * not depend on the size of the playlist.
+ *
+ * The playlist is written to a temporary file next to the destination,
+ * which is renamed over it once complete, so that the destination is
+ * never left half written.
+ **/
+
+#define BUFFER_SIZE (256 * 1024)
+
+typedef struct {
+        int         fd;
+        const char *filename; /* For error messages */
+
+        char       *buffer;
+        gsize       length;
+
+        GError     *error;
+} Writer;
+
+static void
+set_errno_error (Writer     *writer,
+                 const char *what)
+{
+        int saved_errno = errno;
+
+        if (writer->error)
+                return;
+
+        g_set_error (&writer->error,
+                     G_FILE_ERROR,
+                     g_file_error_from_errno (saved_errno),
+                     "Failed to %s '%s': %s",
+                     what,
+                     writer->filename,
+                     g_strerror (saved_errno));
+}
+
+/**
+ * Writes out the buffer. Returns FALSE on error.
+ **/
+static gboolean
+flush (Writer *writer)
+{
+        gsize written = 0;
+
+        if (writer->error)
+                return FALSE;
+
+        while (written < writer->length) {
+                gssize ret;
+
+                ret = write (writer->fd,
+                             writer->buffer + written,
+                             writer->length - written);
+                if (ret < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        set_errno_error (writer, "write to");
+
+                        return FALSE;
+                }
+
+                written += ret;
+        }
+
+        writer->length = 0;
+
+        return TRUE;
+}
+
+/**
+ * Appends @length bytes of @str. If @one_line, line breaks are replaced
+ * by spaces.
+ **/
+static void
+append (Writer     *writer,
+        const char *str,
+        gsize       length,
+        gboolean    one_line)
+{
+        while (length > 0) {
+                gsize chunk, i;
+
+                if (writer->length == BUFFER_SIZE && !flush (writer))
+                        return;
+
+                chunk = MIN (length, BUFFER_SIZE - writer->length);
+
+                memcpy (writer->buffer + writer->length, str, chunk);
+
+                if (one_line) {
+                        for (i = writer->length;
+                             i < writer->length + chunk;
+                             i++) {
+                                if (writer->buffer[i] == '\n' ||
+                                    writer->buffer[i] == '\r')
+                                        writer->buffer[i] = ' ';
+                        }
+                }
+
+                writer->length += chunk;
+
+                str    += chunk;
+                length -= chunk;
+        }
+}
+
+static void
+append_string (Writer     *writer,
+               const char *str)
+{
+        append (writer, str, strlen (str), FALSE);
+}
+
+/**
+ * Appends tag @str, which has to stay on its line.
+ **/
+static void
+append_tag (Writer     *writer,
+            const char *str)
+{
+        append (writer, str, strlen (str), TRUE);
+}
+
+static void
+append_int (Writer *writer,
+            int     value)
+{
+        char digits[16];
+        int i = sizeof (digits);
+        gboolean negative = value < 0;
+        unsigned int n;
+
+        n = negative ? -(unsigned int) value : (unsigned int) value;
+
+        do {
+                digits[--i] = '0' + n % 10;
+                n /= 10;
+        } while (n > 0);
+
+        if (negative)
+                digits[--i] = '-';
+
+        append (writer, digits + i, sizeof (digits) - i, FALSE);
+}
+
+/**
+ * Appends the lines for the row at @iter: an #EXTINF line if anything is
+ * known about it, and its URI.
+ **/
+static void
+append_row (Writer                    *writer,
+            PlaylistModel             *model,
+            GtkTreeIter               *iter,
+            PlaylistWriterDurationFunc duration_func,
+            gpointer                   user_data)
+{
+        const char *uri, *title, *artist;
+        gboolean artist_has_sep;
+        int duration;
+
+        uri    = playlist_model_get_uri (model, iter);
+        title  = playlist_model_peek_title (model, iter);
+        artist = playlist_model_get_artist (model, iter);
+
+        duration = duration_func ? duration_func (uri, user_data) : -1;
+
+        if (title || artist || duration >= 0) {
+                /**
+                 * #EXTINF:duration,Artist - Title
+                 *
+                 * Readers split at the first " - ". Artists containing
+                 * one go on an #EXTART line instead, and titles
+                 * containing one get an empty artist.
+                 **/
+                artist_has_sep = artist && strstr (artist, " - ");
+
+                append_string (writer, "#EXTINF:");
+                append_int (writer, duration >= 0 ? duration : -1);
+                append_string (writer, ",");
+
+                if (artist && !artist_has_sep) {
+                        append_tag (writer, artist);
+                        append_string (writer, " - ");
+                } else if (title && strstr (title, " - "))
+                        append_string (writer, " - ");
+
+                if (title)
+                        append_tag (writer, title);
+
+                append_string (writer, "\n");
+
+                if (artist_has_sep) {
+                        append_string (writer, "#EXTART:");
+                        append_tag (writer, artist);
+                        append_string (writer, "\n");
+                }
+        }
+
+        append_string (writer, uri);
+        append_string (writer, "\n");
+}
+
+/**
+ * playlist_writer_save_m3u
+ * @model: A #PlaylistModel
+ * @filename: Where to save the playlist
+ * @duration_func: Function looking up durations, or NULL
+ * @user_data: User data for @duration_func
+ * @error: Location where to store a #GError if an error occurs.
+ *
+ * Saves the rows of @model to @filename as an extended M3U playlist,
+ * with the titles and artists known and the durations @duration_func
+ * returns. @filename is replaced atomically: on failure, it is left as it
+ * was.
+ *
+ * Return value: TRUE on success, FALSE if an error occured in which case
+ * @error is set as well.
+ **/
+gboolean
+playlist_writer_save_m3u (PlaylistModel             *model,
+                          const char                *filename,
+                          PlaylistWriterDurationFunc duration_func,
+                          gpointer                   user_data,
+                          GError                   **error)
+{
+        Writer writer;
+        GtkTreeIter iter;
+        char *tmp_filename;
+        gboolean valid;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), FALSE);
+        g_return_val_if_fail (filename != NULL, FALSE);
+
+        writer.filename = filename;
+        writer.error    = NULL;
+        writer.length   = 0;
+
+        tmp_filename = g_strconcat (filename, ".XXXXXX", NULL);
+
+        writer.fd = g_mkstemp (tmp_filename);
+        if (writer.fd < 0) {
+                set_errno_error (&writer, "create a file next to");
+                g_propagate_error (error, writer.error);
+
+                g_free (tmp_filename);
+
+                return FALSE;
+        }
+
+        fchmod (writer.fd, 0644);
+
+        writer.buffer = g_malloc (BUFFER_SIZE);
+
+        append_string (&writer, "#EXTM3U\n");
+
+        for (valid = playlist_model_get_iter_at (model, &iter, 0);
+             valid && !writer.error;
+             valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (model),
+                                               &iter)) {
+                append_row (&writer, model, &iter, duration_func, user_data);
+        }
+
+        /**
+         * Only replace @filename once everything is on disk.
+         **/
+        if (flush (&writer) && fsync (writer.fd) < 0)
+                set_errno_error (&writer, "write to");
+
+        if (close (writer.fd) < 0)
+                set_errno_error (&writer, "write to");
+
+        if (!writer.error && g_rename (tmp_filename, filename) < 0)
+                set_errno_error (&writer, "replace");
+
+        if (writer.error) {
+                g_unlink (tmp_filename);
+                g_propagate_error (error, writer.error);
+        }
+
+        g_free (writer.buffer);
+        g_free (tmp_filename);
+
+        return !writer.error;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PLAYLIST_WRITER_H__
+#define __PLAYLIST_WRITER_H__
+
+#include "playlist-model.h"
+
+G_BEGIN_DECLS
+
+/**
+ * Returns the duration of @uri in seconds, or -1 if unknown.
+ **/
+typedef int (* PlaylistWriterDurationFunc) (const char *uri,
+                                            gpointer    user_data);
+
+gboolean
+playlist_writer_save_m3u (PlaylistModel             *model,
+                          const char                *filename,
+                          PlaylistWriterDurationFunc duration_func,
+                          gpointer                   user_data,
+                          GError                   **error);
+
+G_END_DECLS
+
+#endif /* __PLAYLIST_WRITER_H__ */
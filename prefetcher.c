@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "prefetcher.h"
+
+/**
+ * Prefetcher warms the files of the rows about to play into the page
+ * cache, so that switching to them does not wait on slow storage. A
+ * thread of its own works through the files in order, until the byte
+ * budget is used up. Whenever a new set of URIs is given, work on the
+ * old set stops at the next chunk.
+ **/
+
+#define CHUNK_SIZE     (256 * 1024)
+#define DEFAULT_BUDGET (16 * 1024 * 1024)
+
+G_DEFINE_TYPE (Prefetcher,
+               prefetcher,
+               G_TYPE_OBJECT);
+
+struct _PrefetcherPrivate {
+        GThread *thread;
+
+        /**
+         * Shared with the thread, protected by @lock.
+         **/
+        GMutex  *lock;
+        GCond   *cond;
+
+        char   **uris;
+        char   **filenames;      /* For @uris, local files only */
+        gsize    budget;
+        gboolean quit;
+
+        int      generation;     /* Bumped for every new set of URIs */
+        int      done_generation;
+};
+
+#define GET_PRIVATE(o) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
+                                      TYPE_PREFETCHER, \
+                                      PrefetcherPrivate))
+
+/**
+ * Reads up to *@budget bytes of @filename into the page cache, a chunk
+ * at a time, and takes what was read off *@budget. Stops early if the
+ * set of URIs moves past @generation.
+ **/
+static void
+warm_file (PrefetcherPrivate *priv,
+           const char        *filename,
+           int                generation,
+           gsize             *budget)
+{
+#if !defined (HAVE_READAHEAD) && !defined (HAVE_POSIX_FADVISE)
+        static char buffer[CHUNK_SIZE];
+#endif
+        struct stat st;
+        gsize length, offset;
+        int fd;
+
+        fd = open (filename, O_RDONLY);
+        if (fd < 0)
+                return;
+
+        if (fstat (fd, &st) < 0) {
+                close (fd);
+
+                return;
+        }
+
+        length = MIN ((gsize) st.st_size, *budget);
+
+        for (offset = 0; offset < length; offset += CHUNK_SIZE) {
+                gsize n;
+
+                if (g_atomic_int_get (&priv->generation) != generation)
+                        break;
+
+                n = MIN (CHUNK_SIZE, length - offset);
+
+#if defined (HAVE_READAHEAD)
+                readahead (fd, offset, n);
+#elif defined (HAVE_POSIX_FADVISE)
+                posix_fadvise (fd, offset, n, POSIX_FADV_WILLNEED);
+#else
+                if (pread (fd, buffer, n, offset) <= 0)
+                        break;
+#endif
+        }
+
+        *budget -= MIN (offset, length);
+
+        close (fd);
+}
+
+/**
+ * Waits for new sets of files, and warms them.
+ **/
+static gpointer
+prefetch_thread (PrefetcherPrivate *priv)
+{
+        g_mutex_lock (priv->lock);
+
+        while (!priv->quit) {
+                char **filenames;
+                gsize budget;
+                int generation, i;
+
+                if (priv->done_generation == priv->generation) {
+                        g_cond_wait (priv->cond, priv->lock);
+
+                        continue;
+                }
+
+                generation = priv->generation;
+                filenames  = g_strdupv (priv->filenames);
+                budget     = priv->budget;
+
+                g_mutex_unlock (priv->lock);
+
+                for (i = 0; filenames && filenames[i] && budget > 0; i++)
+                        warm_file (priv, filenames[i], generation, &budget);
+
+                g_strfreev (filenames);
+
+                g_mutex_lock (priv->lock);
+
+                priv->done_generation = generation;
+        }
+
+        g_mutex_unlock (priv->lock);
+
+        return NULL;
+}
+
+static void
+prefetcher_init (Prefetcher *prefetcher)
+{
+        PrefetcherPrivate *priv;
+
+        priv = prefetcher->priv = GET_PRIVATE (prefetcher);
+
+        priv->lock = g_mutex_new ();
+        priv->cond = g_cond_new ();
+
+        priv->budget = DEFAULT_BUDGET;
+
+        priv->thread = g_thread_create ((GThreadFunc) prefetch_thread,
+                                        priv,
+                                        TRUE,
+                                        NULL);
+}
+
+static void
+prefetcher_finalize (GObject *object)
+{
+        Prefetcher *prefetcher;
+        PrefetcherPrivate *priv;
+        GObjectClass *object_class;
+
+        prefetcher = PREFETCHER (object);
+        priv = prefetcher->priv;
+
+        g_mutex_lock (priv->lock);
+
+        priv->quit = TRUE;
+        g_atomic_int_inc (&priv->generation);
+
+        g_cond_signal (priv->cond);
+
+        g_mutex_unlock (priv->lock);
+
+        if (priv->thread)
+                g_thread_join (priv->thread);
+
+        g_cond_free (priv->cond);
+        g_mutex_free (priv->lock);
+
+        g_strfreev (priv->uris);
+        g_strfreev (priv->filenames);
+
+        object_class = G_OBJECT_CLASS (prefetcher_parent_class);
+        object_class->finalize (object);
+}
+
+static void
+prefetcher_class_init (PrefetcherClass *klass)
+{
+        GObjectClass *object_class;
+
+        object_class = G_OBJECT_CLASS (klass);
+
+        object_class->finalize = prefetcher_finalize;
+
+        g_type_class_add_private (klass, sizeof (PrefetcherPrivate));
+}
+
+/**
+ * prefetcher_new
+ * @budget: The number of bytes to read ahead, or 0 for the default
+ *
+ * Return value: A new #Prefetcher.
+ **/
+Prefetcher *
+prefetcher_new (gsize budget)
+{
+        Prefetcher *prefetcher;
+
+        prefetcher = g_object_new (TYPE_PREFETCHER, NULL);
+
+        if (budget > 0)
+                prefetcher_set_budget (prefetcher, budget);
+
+        return prefetcher;
+}
+
+/**
+ * Returns TRUE if @uris holds the @n_uris URIs in @other, in order.
+ **/
+static gboolean
+uris_equal (char       **uris,
+            const char **other,
+            int          n_uris)
+{
+        int i;
+
+        if (!uris)
+                return n_uris == 0;
+
+        for (i = 0; i < n_uris; i++) {
+                if (!uris[i] || strcmp (uris[i], other[i]))
+                        return FALSE;
+        }
+
+        return uris[i] == NULL;
+}
+
+/**
+ * prefetcher_set_uris
+ * @prefetcher: A #Prefetcher
+ * @uris: An array of URIs, most urgent first
+ * @n_uris: The number of URIs in @uris
+ *
+ * Starts reading @uris into the page cache in the background, within
+ * the budget, and stops reading the URIs set before. Only local files
+ * are read. Setting the same URIs again does nothing.
+ **/
+void
+prefetcher_set_uris (Prefetcher  *prefetcher,
+                     const char **uris,
+                     int          n_uris)
+{
+        PrefetcherPrivate *priv;
+        int i, n_filenames;
+
+        g_return_if_fail (IS_PREFETCHER (prefetcher));
+        g_return_if_fail (uris != NULL || n_uris == 0);
+
+        priv = prefetcher->priv;
+
+        g_mutex_lock (priv->lock);
+
+        if (uris_equal (priv->uris, uris, n_uris)) {
+                g_mutex_unlock (priv->lock);
+
+                return;
+        }
+
+        g_strfreev (priv->uris);
+        g_strfreev (priv->filenames);
+
+        priv->uris = g_new (char *, n_uris + 1);
+        priv->filenames = g_new (char *, n_uris + 1);
+
+        n_filenames = 0;
+        for (i = 0; i < n_uris; i++) {
+                char *filename;
+
+                priv->uris[i] = g_strdup (uris[i]);
+
+                filename = g_filename_from_uri (uris[i], NULL, NULL);
+                if (filename)
+                        priv->filenames[n_filenames++] = filename;
+        }
+
+        priv->uris[n_uris] = NULL;
+        priv->filenames[n_filenames] = NULL;
+
+        g_atomic_int_inc (&priv->generation);
+
+        g_cond_signal (priv->cond);
+
+        g_mutex_unlock (priv->lock);
+}
+
+/**
+ * prefetcher_cancel
+ * @prefetcher: A #Prefetcher
+ *
+ * Stops reading ahead.
+ **/
+void
+prefetcher_cancel (Prefetcher *prefetcher)
+{
+        g_return_if_fail (IS_PREFETCHER (prefetcher));
+
+        prefetcher_set_uris (prefetcher, NULL, 0);
+}
+
+/**
+ * prefetcher_set_budget
+ * @prefetcher: A #Prefetcher
+ * @budget: The number of bytes to read ahead
+ *
+ * Sets how many bytes are read ahead for each set of URIs, in total.
+ * Takes effect with the next set of URIs.
+ **/
+void
+prefetcher_set_budget (Prefetcher *prefetcher,
+                       gsize       budget)
+{
+        g_return_if_fail (IS_PREFETCHER (prefetcher));
+
+        g_mutex_lock (prefetcher->priv->lock);
+        prefetcher->priv->budget = budget;
+        g_mutex_unlock (prefetcher->priv->lock);
+}
+
+/**
+ * prefetcher_get_budget
+ * @prefetcher: A #Prefetcher
+ *
+ * Return value: The number of bytes read ahead for each set of URIs.
+ **/
+gsize
+prefetcher_get_budget (Prefetcher *prefetcher)
+{
+        gsize budget;
+
+        g_return_val_if_fail (IS_PREFETCHER (prefetcher), 0);
+
+        g_mutex_lock (prefetcher->priv->lock);
+        budget = prefetcher->priv->budget;
+        g_mutex_unlock (prefetcher->priv->lock);
+
+        return budget;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PREFETCHER_H__
+#define __PREFETCHER_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_PREFETCHER \
+                (prefetcher_get_type ())
+#define PREFETCHER(obj) \
+                (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                 TYPE_PREFETCHER, \
+                 Prefetcher))
+#define PREFETCHER_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_CAST ((klass), \
+                 TYPE_PREFETCHER, \
+                 PrefetcherClass))
+#define IS_PREFETCHER(obj) \
+                (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                 TYPE_PREFETCHER))
+#define IS_PREFETCHER_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                 TYPE_PREFETCHER))
+#define PREFETCHER_GET_CLASS(obj) \
+                (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+                 TYPE_PREFETCHER, \
+                 PrefetcherClass))
+
+typedef struct _PrefetcherPrivate PrefetcherPrivate;
+
+typedef struct {
+        GObject parent;
+
+        PrefetcherPrivate *priv;
+} Prefetcher;
+
+typedef struct {
+        GObjectClass parent_class;
+
+        /* Future padding */
+        void (* _reserved1) (void);
+        void (* _reserved2) (void);
+        void (* _reserved3) (void);
+        void (* _reserved4) (void);
+} PrefetcherClass;
+
+GType
+prefetcher_get_type   (void) G_GNUC_CONST;
+
+Prefetcher *
+prefetcher_new        (gsize        budget);
+
+void
+prefetcher_set_uris   (Prefetcher  *prefetcher,
+                       const char **uris,
+                       int          n_uris);
+
+void
+prefetcher_cancel     (Prefetcher  *prefetcher);
+
+void
+prefetcher_set_budget (Prefetcher  *prefetcher,
+                       gsize        budget);
+
+gsize
+prefetcher_get_budget (Prefetcher  *prefetcher);
+
+G_END_DECLS
+
+#endif /* __PREFETCHER_H__ */
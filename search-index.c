@@ -0,0 +1,975 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "search-index.h"
+
+/**
+ * SearchIndex finds URIs by title, artist and file name. Each URI gets a
+ * key: those three, normalized, case folded and separated by newlines.
+ * Every three byte sequence of a key, a trigram, has a list of the URIs
+ * with keys containing it. So do the first one and two bytes of every
+ * word, for query words too short to have a trigram; those only match
+ * at the start of words. A query only looks at the URIs on the shortest
+ * list among those of its grams, and checks their keys, MAX_CANDIDATES
+ * of them at a time: search_index_query_more() goes on where the last
+ * query stopped.
+ *
+ * Keys are built in the background, a few at a time, so that adding or
+ * updating many URIs stays cheap. A query catches up with those still
+ * waiting for no longer than QUERY_BUDGET; if it could not, 'keys-built'
+ * tells when querying again would find more. Lists are appended to as
+ * keys are built. When a key changes or its URI is removed, its URI
+ * stays on the lists of its old grams, which only count it as stale;
+ * once half of a list is stale, the list is weeded out by checking the
+ * keys of the URIs on it. IDs of removed URIs are reused.
+ **/
+
+G_DEFINE_TYPE (SearchIndex,
+               search_index,
+               G_TYPE_OBJECT);
+
+enum {
+        SIGNAL_KEYS_BUILT,
+        SIGNAL_LAST
+};
+
+static guint signals[SIGNAL_LAST];
+
+/**
+ * The URIs with keys containing a gram, in no particular order. Some
+ * might not anymore: @n_stale of them at most.
+ **/
+typedef struct {
+        GArray *ids;     /* guint URI ID */
+        guint   n_stale;
+        guint   serial;  /* Of the last key counted stale here */
+} Posting;
+
+struct _SearchIndexPrivate {
+        GPtrArray  *uris;      /* char *, indexed by URI ID, or NULL */
+        GHashTable *uri_index; /* URI -> URI ID + 1 */
+        GArray     *free_ids;  /* guint, IDs of removed URIs */
+
+        GPtrArray  *keys;      /* char *, NULL while pending */
+
+        /**
+         * Titles and artists of the URIs whose keys need to be built,
+         * in order of arrival, and the idle source building them, or 0.
+         **/
+        GPtrArray  *raw_titles;
+        GPtrArray  *raw_artists;
+        GArray     *pending;   /* guint URI ID */
+        guint       build_keys_id;
+        gboolean    queried;   /* While keys were pending */
+
+        GHashTable *grams;     /* Gram -> Posting */
+
+        /**
+         * The last query or weeding each URI was seen by, so that URIs
+         * listed more than once are only seen once.
+         **/
+        GArray     *serials;   /* guint */
+        guint       serial;
+
+        /**
+         * The words of the last query if it stopped before the end of
+         * the list of @query_gram, at @query_offset, or NULL.
+         **/
+        char      **query_words;
+        guint       query_gram;
+        guint       query_offset;
+        guint       query_serial;
+};
+
+#define GET_PRIVATE(o) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
+                                      TYPE_SEARCH_INDEX, \
+                                      SearchIndexPrivate))
+
+/**
+ * Seconds spent building keys per idle iteration, and per query.
+ **/
+#define BUILD_BUDGET 0.004
+#define QUERY_BUDGET 0.004
+
+/**
+ * The most URIs whose keys a query checks at a time.
+ **/
+#define MAX_CANDIDATES 50000
+
+/**
+ * Grams are up to three bytes, with their length in the top byte for
+ * the one and two byte ones.
+ **/
+#define TRIGRAM(s) \
+        ((guint) (guchar) (s)[0] | \
+         (guint) (guchar) (s)[1] << 8 | \
+         (guint) (guchar) (s)[2] << 16)
+#define PREFIX1(s) \
+        ((guint) (guchar) (s)[0] | \
+         1 << 24)
+#define PREFIX2(s) \
+        ((guint) (guchar) (s)[0] | \
+         (guint) (guchar) (s)[1] << 8 | \
+         2 << 24)
+
+static void
+free_posting (Posting *posting)
+{
+        g_array_free (posting->ids, TRUE);
+
+        g_slice_free (Posting, posting);
+}
+
+static void
+search_index_init (SearchIndex *index)
+{
+        SearchIndexPrivate *priv;
+
+        priv = index->priv = GET_PRIVATE (index);
+
+        priv->uris      = g_ptr_array_new ();
+        priv->uri_index = g_hash_table_new (g_str_hash, g_str_equal);
+        priv->free_ids  = g_array_new (FALSE, FALSE, sizeof (guint));
+
+        priv->keys = g_ptr_array_new ();
+
+        priv->raw_titles  = g_ptr_array_new ();
+        priv->raw_artists = g_ptr_array_new ();
+        priv->pending     = g_array_new (FALSE, FALSE, sizeof (guint));
+
+        priv->grams = g_hash_table_new_full (g_direct_hash,
+                                                g_direct_equal,
+                                                NULL,
+                                                (GDestroyNotify) free_posting);
+
+        priv->serials = g_array_new (FALSE, TRUE, sizeof (guint));
+}
+
+/**
+ * Frees the strings for every URI.
+ **/
+static void
+free_uris (SearchIndexPrivate *priv)
+{
+        guint i;
+
+        for (i = 0; i < priv->uris->len; i++) {
+                g_free (priv->uris->pdata[i]);
+                g_free (priv->keys->pdata[i]);
+                g_free (priv->raw_titles->pdata[i]);
+                g_free (priv->raw_artists->pdata[i]);
+        }
+}
+
+static void
+search_index_finalize (GObject *object)
+{
+        SearchIndex *index;
+        SearchIndexPrivate *priv;
+        GObjectClass *object_class;
+
+        index = SEARCH_INDEX (object);
+        priv = index->priv;
+
+        if (priv->build_keys_id)
+                g_source_remove (priv->build_keys_id);
+
+        free_uris (priv);
+
+        g_ptr_array_free (priv->uris, TRUE);
+        g_array_free (priv->free_ids, TRUE);
+        g_ptr_array_free (priv->keys, TRUE);
+        g_ptr_array_free (priv->raw_titles, TRUE);
+        g_ptr_array_free (priv->raw_artists, TRUE);
+        g_array_free (priv->pending, TRUE);
+        g_array_free (priv->serials, TRUE);
+
+        g_hash_table_destroy (priv->uri_index);
+        g_hash_table_destroy (priv->grams);
+
+        g_strfreev (priv->query_words);
+
+        object_class = G_OBJECT_CLASS (search_index_parent_class);
+        object_class->finalize (object);
+}
+
+static void
+search_index_class_init (SearchIndexClass *klass)
+{
+        GObjectClass *object_class;
+
+        object_class = G_OBJECT_CLASS (klass);
+
+        object_class->finalize = search_index_finalize;
+
+        g_type_class_add_private (klass, sizeof (SearchIndexPrivate));
+
+        signals[SIGNAL_KEYS_BUILT] =
+                g_signal_new ("keys-built",
+                              TYPE_SEARCH_INDEX,
+                              G_SIGNAL_RUN_LAST,
+                              G_STRUCT_OFFSET (SearchIndexClass,
+                                               keys_built),
+                              NULL,
+                              NULL,
+                              g_cclosure_marshal_VOID__VOID,
+                              G_TYPE_NONE,
+                              0);
+}
+
+/**
+ * Returns @str normalized and case folded, so that it matches
+ * regardless of case and of how accented characters are encoded.
+ **/
+static char *
+fold (const char *str)
+{
+        char *normalized, *folded;
+
+        normalized = g_utf8_normalize (str, -1, G_NORMALIZE_ALL);
+        if (!normalized)
+                return g_ascii_strdown (str, -1);
+
+        folded = g_utf8_casefold (normalized, -1);
+        g_free (normalized);
+
+        return folded;
+}
+
+/**
+ * Returns the unescaped file name part of @uri.
+ **/
+static char *
+get_basename (const char *uri)
+{
+        const char *slash;
+        char *basename;
+
+        slash = strrchr (uri, '/');
+        if (slash)
+                uri = slash + 1;
+
+        basename = g_uri_unescape_string (uri, NULL);
+        if (!basename)
+                basename = g_strdup (uri);
+
+        return basename;
+}
+
+/**
+ * Returns TRUE if @c, in @key, starts a word.
+ **/
+static gboolean
+is_word_start (const char *key,
+               const char *c)
+{
+        if (g_ascii_isspace (*c))
+                return FALSE;
+
+        return c == key || (!(c[-1] & 0x80) && !g_ascii_isalnum (c[-1]));
+}
+
+/**
+ * Stores the grams starting at @c, in @key, in @grams, and returns how
+ * many there are.
+ **/
+static int
+get_grams (const char *key,
+           const char *c,
+           guint       grams[3])
+{
+        int n_grams = 0;
+
+        if (c[0] == '\n')
+                return 0;
+
+        if (is_word_start (key, c)) {
+                grams[n_grams++] = PREFIX1 (c);
+
+                if (c[1] && c[1] != '\n')
+                        grams[n_grams++] = PREFIX2 (c);
+        }
+
+        if (c[1] && c[1] != '\n' && c[2] && c[2] != '\n')
+                grams[n_grams++] = TRIGRAM (c);
+
+        return n_grams;
+}
+
+/**
+ * Returns TRUE if @key contains @word, at the start of a word if it is
+ * too short to have a trigram.
+ **/
+static gboolean
+key_has_word (const char *key,
+              const char *word)
+{
+        const char *c;
+
+        if (word[0] && word[1] && word[2])
+                return strstr (key, word) != NULL;
+
+        for (c = strstr (key, word); c; c = strstr (c + 1, word)) {
+                if (is_word_start (key, c))
+                        return TRUE;
+        }
+
+        return FALSE;
+}
+
+/**
+ * Builds the key for URI @id and lists it under each of its grams,
+ * unless it was built already or @id was removed.
+ **/
+static void
+build_key (SearchIndexPrivate *priv,
+           guint               id)
+{
+        char *text, *basename, *key, *c;
+
+        if (!priv->uris->pdata[id] || priv->keys->pdata[id])
+                return;
+
+        basename = get_basename (priv->uris->pdata[id]);
+        text = g_strconcat (priv->raw_titles->pdata[id] ?
+                                priv->raw_titles->pdata[id] : "",
+                            "\n",
+                            priv->raw_artists->pdata[id] ?
+                                priv->raw_artists->pdata[id] : "",
+                            "\n",
+                            basename,
+                            NULL);
+        g_free (basename);
+
+        key = fold (text);
+        g_free (text);
+
+        g_free (priv->raw_titles->pdata[id]);
+        priv->raw_titles->pdata[id] = NULL;
+        g_free (priv->raw_artists->pdata[id]);
+        priv->raw_artists->pdata[id] = NULL;
+
+        priv->keys->pdata[id] = key;
+
+        /**
+         * Repeated trigrams of this key end up next to each other on
+         * their list; only list the URI once.
+         **/
+        for (c = key; *c; c++) {
+                guint grams[3];
+                int n_grams, i;
+
+                n_grams = get_grams (key, c, grams);
+
+                for (i = 0; i < n_grams; i++) {
+                        Posting *posting;
+
+                        posting = g_hash_table_lookup
+                                        (priv->grams,
+                                         GUINT_TO_POINTER (grams[i]));
+                        if (!posting) {
+                                posting = g_slice_new0 (Posting);
+                                posting->ids =
+                                        g_array_sized_new (FALSE,
+                                                           FALSE,
+                                                           sizeof (guint),
+                                                           4);
+                                g_hash_table_insert
+                                        (priv->grams,
+                                         GUINT_TO_POINTER (grams[i]),
+                                         posting);
+                        } else if (posting->ids->len > 0 &&
+                                   g_array_index (posting->ids,
+                                                  guint,
+                                                  posting->ids->len - 1) ==
+                                   id)
+                                continue;
+
+                        g_array_append_val (posting->ids, id);
+                }
+        }
+}
+
+/**
+ * Drops the URIs from @posting, the list of @gram, whose keys do not
+ * contain it anymore, and those listed twice. A query going through the
+ * list goes on from the same URI.
+ **/
+static void
+weed_posting (SearchIndexPrivate *priv,
+              guint               gram,
+              Posting            *posting)
+{
+        char word[4];
+        guint i, j, serial;
+        gboolean queried;
+
+        /**
+         * Spell the gram out again.
+         **/
+        word[0] = gram & 0xff;
+        word[1] = (gram >> 8) & 0xff;
+        word[2] = (gram >> 24) ? '\0' : (gram >> 16) & 0xff;
+        word[3] = '\0';
+
+        serial = ++priv->serial;
+
+        queried = priv->query_words && priv->query_gram == gram;
+
+        for (i = 0, j = 0; i < posting->ids->len; i++) {
+                guint id = g_array_index (posting->ids, guint, i);
+
+                if (queried && priv->query_offset == i)
+                        priv->query_offset = j;
+
+                if (g_array_index (priv->serials, guint, id) == serial ||
+                    !priv->keys->pdata[id] ||
+                    !key_has_word (priv->keys->pdata[id], word))
+                        continue;
+
+                g_array_index (priv->serials, guint, id) = serial;
+                g_array_index (posting->ids, guint, j++) = id;
+        }
+
+        if (queried && priv->query_offset >= posting->ids->len)
+                priv->query_offset = j;
+
+        g_array_set_size (posting->ids, j);
+        posting->n_stale = 0;
+}
+
+/**
+ * Forgets the key of URI @id. It is counted as stale on the lists of
+ * its grams, which are weeded once half stale.
+ **/
+static void
+drop_key (SearchIndexPrivate *priv,
+          guint               id)
+{
+        char *key, *c;
+        guint serial;
+
+        key = priv->keys->pdata[id];
+        if (!key)
+                return;
+
+        priv->keys->pdata[id] = NULL;
+
+        serial = ++priv->serial;
+
+        for (c = key; *c; c++) {
+                guint grams[3];
+                int n_grams, i;
+
+                n_grams = get_grams (key, c, grams);
+
+                for (i = 0; i < n_grams; i++) {
+                        Posting *posting;
+
+                        posting = g_hash_table_lookup
+                                        (priv->grams,
+                                         GUINT_TO_POINTER (grams[i]));
+                        if (!posting || posting->serial == serial)
+                                continue;
+
+                        posting->serial = serial;
+                        posting->n_stale++;
+
+                        if (posting->n_stale * 2 < posting->ids->len)
+                                continue;
+
+                        weed_posting (priv, grams[i], posting);
+
+                        if (posting->ids->len == 0) {
+                                g_hash_table_remove
+                                        (priv->grams,
+                                         GUINT_TO_POINTER (grams[i]));
+                        }
+                }
+        }
+
+        g_free (key);
+}
+
+/**
+ * Builds pending keys for at most @budget seconds, or all of them if
+ * @budget is negative. Returns TRUE if keys are left to build.
+ **/
+static gboolean
+build_keys (SearchIndexPrivate *priv,
+            double              budget)
+{
+        GTimer *timer;
+        guint i;
+
+        timer = g_timer_new ();
+
+        for (i = 0; i < priv->pending->len; i++) {
+                build_key (priv, g_array_index (priv->pending, guint, i));
+
+                if (budget >= 0 &&
+                    (i & 63) == 63 &&
+                    g_timer_elapsed (timer, NULL) > budget) {
+                        i++;
+
+                        break;
+                }
+        }
+
+        g_array_remove_range (priv->pending, 0, i);
+
+        g_timer_destroy (timer);
+
+        return priv->pending->len > 0;
+}
+
+static gboolean
+build_keys_idle (SearchIndex *index)
+{
+        if (build_keys (index->priv, BUILD_BUDGET))
+                return TRUE;
+
+        index->priv->build_keys_id = 0;
+
+        if (index->priv->queried) {
+                index->priv->queried = FALSE;
+
+                g_signal_emit (index, signals[SIGNAL_KEYS_BUILT], 0);
+        }
+
+        return FALSE;
+}
+
+/**
+ * search_index_new
+ *
+ * Return value: A new, empty #SearchIndex.
+ **/
+SearchIndex *
+search_index_new (void)
+{
+        return g_object_new (TYPE_SEARCH_INDEX, NULL);
+}
+
+/**
+ * search_index_set
+ * @index: A #SearchIndex
+ * @uri: An URI
+ * @title: The title of @uri, or NULL
+ * @artist: The artist of @uri, or NULL
+ *
+ * Adds @uri to @index, or updates it. @uri is found by @title, @artist
+ * and its file name.
+ **/
+void
+search_index_set (SearchIndex *index,
+                  const char  *uri,
+                  const char  *title,
+                  const char  *artist)
+{
+        SearchIndexPrivate *priv;
+        guint id;
+
+        g_return_if_fail (IS_SEARCH_INDEX (index));
+        g_return_if_fail (uri != NULL);
+
+        priv = index->priv;
+
+        id = GPOINTER_TO_UINT (g_hash_table_lookup (priv->uri_index, uri));
+        if (id == 0) {
+                if (priv->free_ids->len > 0) {
+                        id = g_array_index (priv->free_ids,
+                                            guint,
+                                            priv->free_ids->len - 1);
+                        g_array_set_size (priv->free_ids,
+                                          priv->free_ids->len - 1);
+
+                        priv->uris->pdata[id] = g_strdup (uri);
+
+                        /**
+                         * Not seen by any query yet.
+                         **/
+                        g_array_index (priv->serials, guint, id) = 0;
+                } else {
+                        id = priv->uris->len;
+
+                        g_ptr_array_add (priv->uris, g_strdup (uri));
+                        g_ptr_array_add (priv->keys, NULL);
+                        g_ptr_array_add (priv->raw_titles, NULL);
+                        g_ptr_array_add (priv->raw_artists, NULL);
+                        g_array_set_size (priv->serials, priv->uris->len);
+                }
+
+                g_hash_table_insert (priv->uri_index,
+                                     priv->uris->pdata[id],
+                                     GUINT_TO_POINTER (id + 1));
+        } else {
+                id--;
+
+                /**
+                 * Still pending; the key will be built from these.
+                 **/
+                if (priv->keys->pdata[id] == NULL) {
+                        g_free (priv->raw_titles->pdata[id]);
+                        g_free (priv->raw_artists->pdata[id]);
+
+                        priv->raw_titles->pdata[id]  = g_strdup (title);
+                        priv->raw_artists->pdata[id] = g_strdup (artist);
+
+                        return;
+                }
+
+                drop_key (priv, id);
+        }
+
+        priv->raw_titles->pdata[id]  = g_strdup (title);
+        priv->raw_artists->pdata[id] = g_strdup (artist);
+
+        g_array_append_val (priv->pending, id);
+
+        if (!priv->build_keys_id) {
+                priv->build_keys_id =
+                        g_idle_add_full (G_PRIORITY_LOW,
+                                         (GSourceFunc) build_keys_idle,
+                                         index,
+                                         NULL);
+        }
+}
+
+/**
+ * search_index_remove
+ * @index: A #SearchIndex
+ * @uri: An URI
+ *
+ * Removes @uri from @index, if there.
+ **/
+void
+search_index_remove (SearchIndex *index,
+                     const char  *uri)
+{
+        SearchIndexPrivate *priv;
+        guint id;
+
+        g_return_if_fail (IS_SEARCH_INDEX (index));
+        g_return_if_fail (uri != NULL);
+
+        priv = index->priv;
+
+        id = GPOINTER_TO_UINT (g_hash_table_lookup (priv->uri_index, uri));
+        if (id == 0)
+                return;
+
+        id--;
+
+        g_hash_table_remove (priv->uri_index, uri);
+
+        drop_key (priv, id);
+
+        g_free (priv->raw_titles->pdata[id]);
+        priv->raw_titles->pdata[id] = NULL;
+        g_free (priv->raw_artists->pdata[id]);
+        priv->raw_artists->pdata[id] = NULL;
+
+        /**
+         * Might still be pending; build_key() skips removed URIs.
+         **/
+        g_free (priv->uris->pdata[id]);
+        priv->uris->pdata[id] = NULL;
+
+        g_array_append_val (priv->free_ids, id);
+}
+
+/**
+ * search_index_clear
+ * @index: A #SearchIndex
+ *
+ * Removes all URIs from @index.
+ **/
+void
+search_index_clear (SearchIndex *index)
+{
+        SearchIndexPrivate *priv;
+
+        g_return_if_fail (IS_SEARCH_INDEX (index));
+
+        priv = index->priv;
+
+        if (priv->build_keys_id) {
+                g_source_remove (priv->build_keys_id);
+                priv->build_keys_id = 0;
+        }
+
+        free_uris (priv);
+
+        g_ptr_array_set_size (priv->uris, 0);
+        g_ptr_array_set_size (priv->keys, 0);
+        g_ptr_array_set_size (priv->raw_titles, 0);
+        g_ptr_array_set_size (priv->raw_artists, 0);
+        g_array_set_size (priv->free_ids, 0);
+        g_array_set_size (priv->pending, 0);
+        g_array_set_size (priv->serials, 0);
+
+        g_hash_table_remove_all (priv->uri_index);
+        g_hash_table_remove_all (priv->grams);
+
+        g_strfreev (priv->query_words);
+        priv->query_words = NULL;
+
+        priv->queried = FALSE;
+}
+
+/**
+ * Returns TRUE if @key contains all of @words.
+ **/
+static gboolean
+key_matches (const char  *key,
+             char       **words)
+{
+        int i;
+
+        for (i = 0; words[i]; i++) {
+                if (!key_has_word (key, words[i]))
+                        return FALSE;
+        }
+
+        return TRUE;
+}
+
+/**
+ * Makes *@shortest the list of @gram, and *@shortest_gram @gram, if that
+ * list is shorter. Returns FALSE if no URI has @gram.
+ **/
+static gboolean
+pick_shorter (SearchIndexPrivate *priv,
+              guint               gram,
+              Posting           **shortest,
+              guint              *shortest_gram)
+{
+        Posting *posting;
+
+        posting = g_hash_table_lookup (priv->grams, GUINT_TO_POINTER (gram));
+        if (!posting)
+                return FALSE;
+
+        if (!*shortest || posting->ids->len < (*shortest)->ids->len) {
+                *shortest      = posting;
+                *shortest_gram = gram;
+        }
+
+        return TRUE;
+}
+
+/**
+ * Goes on with the last query, appending the URIs matching it among the
+ * next MAX_CANDIDATES on the list it goes through to @uris. Returns TRUE
+ * if it got to the end of the list.
+ **/
+static gboolean
+check_candidates (SearchIndexPrivate *priv,
+                  GPtrArray          *uris)
+{
+        Posting *posting;
+        guint i, n;
+
+        if (!priv->query_words)
+                return TRUE;
+
+        /**
+         * Every URI on the list might have been removed since.
+         **/
+        posting = g_hash_table_lookup (priv->grams,
+                                       GUINT_TO_POINTER (priv->query_gram));
+
+        n = posting ? posting->ids->len : 0;
+        if (n - MIN (n, priv->query_offset) > MAX_CANDIDATES)
+                n = priv->query_offset + MAX_CANDIDATES;
+
+        for (i = priv->query_offset; i < n; i++) {
+                guint id = g_array_index (posting->ids, guint, i);
+
+                if (g_array_index (priv->serials, guint, id) ==
+                    priv->query_serial)
+                        continue;
+
+                g_array_index (priv->serials, guint, id) = priv->query_serial;
+
+                if (priv->keys->pdata[id] &&
+                    key_matches (priv->keys->pdata[id], priv->query_words))
+                        g_ptr_array_add (uris, priv->uris->pdata[id]);
+        }
+
+        priv->query_offset = n;
+
+        if (posting && n < posting->ids->len)
+                return FALSE;
+
+        g_strfreev (priv->query_words);
+        priv->query_words = NULL;
+
+        return TRUE;
+}
+
+/**
+ * search_index_query
+ * @index: A #SearchIndex
+ * @query: What to look for
+ * @uris: A #GPtrArray to append the matching URIs to
+ *
+ * Appends the URIs whose title, artist or file name contain each of the
+ * words in @query, ignoring case, in no particular order. Words shorter
+ * than three bytes only match at the start of words. The URIs are owned
+ * by @index.
+ *
+ * Queries take little time whatever the size of @index: they look at
+ * MAX_CANDIDATES URIs at most, and only spend QUERY_BUDGET on URIs
+ * still to be indexed. If there are more URIs to look at,
+ * search_index_query_more() finds the rest of the matches, a batch at
+ * a time. If URIs were still to be indexed, 'keys-built' is emitted
+ * once they are; query again then.
+ *
+ * Return value: TRUE if all of @index was searched, FALSE if some URIs
+ * might have been missed.
+ **/
+gboolean
+search_index_query (SearchIndex *index,
+                    const char  *query,
+                    GPtrArray   *uris)
+{
+        SearchIndexPrivate *priv;
+        Posting *shortest = NULL;
+        char *folded, **words;
+        gboolean complete, none = FALSE;
+        guint i, shortest_gram = 0;
+        int j;
+
+        g_return_val_if_fail (IS_SEARCH_INDEX (index), FALSE);
+        g_return_val_if_fail (query != NULL, FALSE);
+        g_return_val_if_fail (uris != NULL, FALSE);
+
+        priv = index->priv;
+
+        g_strfreev (priv->query_words);
+        priv->query_words = NULL;
+
+        complete = !build_keys (priv, QUERY_BUDGET);
+        if (!complete)
+                priv->queried = TRUE;
+
+        folded = fold (query);
+        words = g_strsplit_set (folded, " \t\n", -1);
+        g_free (folded);
+
+        /**
+         * Drop empty words, left by repeated spaces.
+         **/
+        for (i = 0, j = 0; words[j]; j++) {
+                if (words[j][0] == '\0')
+                        g_free (words[j]);
+                else
+                        words[i++] = words[j];
+        }
+        words[i] = NULL;
+
+        if (!words[0]) {
+                g_strfreev (words);
+
+                return complete;
+        }
+
+        /**
+         * Find the shortest list among the grams of all words. A gram
+         * nobody has means no matches.
+         **/
+        for (j = 0; words[j] && !none; j++) {
+                const char *c = words[j];
+
+                if (!c[1])
+                        none = !pick_shorter (priv,
+                                              PREFIX1 (c),
+                                              &shortest,
+                                              &shortest_gram);
+                else if (!c[2])
+                        none = !pick_shorter (priv,
+                                              PREFIX2 (c),
+                                              &shortest,
+                                              &shortest_gram);
+
+                for (; c[0] && c[1] && c[2] && !none; c++)
+                        none = !pick_shorter (priv,
+                                              TRIGRAM (c),
+                                              &shortest,
+                                              &shortest_gram);
+        }
+
+        if (none) {
+                g_strfreev (words);
+
+                return complete;
+        }
+
+        priv->query_words  = words;
+        priv->query_gram   = shortest_gram;
+        priv->query_offset = 0;
+        priv->query_serial = ++priv->serial;
+
+        if (!check_candidates (priv, uris))
+                complete = FALSE;
+
+        return complete;
+}
+
+/**
+ * search_index_query_more
+ * @index: A #SearchIndex
+ * @uris: A #GPtrArray to append the matching URIs to
+ *
+ * Goes on with the last search_index_query() on @index where it
+ * stopped, looking at as many URIs again at most, and appends those
+ * found to match to @uris. If @index changed meanwhile, a few might have
+ * been appended before.
+ *
+ * Return value: TRUE if the last query has looked at all URIs now,
+ * FALSE if search_index_query_more() has more to look at.
+ **/
+gboolean
+search_index_query_more (SearchIndex *index,
+                         GPtrArray   *uris)
+{
+        g_return_val_if_fail (IS_SEARCH_INDEX (index), TRUE);
+        g_return_val_if_fail (uris != NULL, TRUE);
+
+        return check_candidates (index->priv, uris);
+}
+
+/**
+ * search_index_get_n_uris
+ * @index: A #SearchIndex
+ *
+ * Return value: The number of URIs in @index.
+ **/
+guint
+search_index_get_n_uris (SearchIndex *index)
+{
+        g_return_val_if_fail (IS_SEARCH_INDEX (index), 0);
+
+        return index->priv->uris->len - index->priv->free_ids->len;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SEARCH_INDEX_H__
+#define __SEARCH_INDEX_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_SEARCH_INDEX \
+                (search_index_get_type ())
+#define SEARCH_INDEX(obj) \
+                (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                 TYPE_SEARCH_INDEX, \
+                 SearchIndex))
+#define SEARCH_INDEX_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_CAST ((klass), \
+                 TYPE_SEARCH_INDEX, \
+                 SearchIndexClass))
+#define IS_SEARCH_INDEX(obj) \
+                (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                 TYPE_SEARCH_INDEX))
+#define IS_SEARCH_INDEX_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                 TYPE_SEARCH_INDEX))
+#define SEARCH_INDEX_GET_CLASS(obj) \
+                (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+                 TYPE_SEARCH_INDEX, \
+                 SearchIndexClass))
+
+typedef struct _SearchIndexPrivate SearchIndexPrivate;
+
+typedef struct {
+        GObject parent;
+
+        SearchIndexPrivate *priv;
+} SearchIndex;
+
+typedef struct {
+        GObjectClass parent_class;
+
+        /* Signals */
+        void (* keys_built) (SearchIndex *index);
+
+        /* Future padding */
+        void (* _reserved1) (void);
+        void (* _reserved2) (void);
+        void (* _reserved3) (void);
+        void (* _reserved4) (void);
+} SearchIndexClass;
+
+GType
+search_index_get_type   (void) G_GNUC_CONST;
+
+SearchIndex *
+search_index_new        (void);
+
+void
+search_index_set        (SearchIndex *index,
+                         const char  *uri,
+                         const char  *title,
+                         const char  *artist);
+
+void
+search_index_remove     (SearchIndex *index,
+                         const char  *uri);
+
+void
+search_index_clear      (SearchIndex *index);
+
+gboolean
+search_index_query      (SearchIndex *index,
+                         const char  *query,
+                         GPtrArray   *uris);
+
+gboolean
+search_index_query_more (SearchIndex *index,
+                         GPtrArray   *uris);
+
+guint
+search_index_get_n_uris (SearchIndex *index);
+
+G_END_DECLS
+
+#endif /* __SEARCH_INDEX_H__ */
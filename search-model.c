@@ -0,0 +1,726 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "search-model.h"
+
+/**
+ * SearchModel shows some of the rows of a PlaylistModel, in playlist
+ * order. It only remembers their positions; its iters are those of the
+ * PlaylistModel, so anything that works on an iter of one works on an
+ * iter of the other. Changes to the PlaylistModel are followed: rows
+ * shown stay shown until removed, new rows are not shown unless added
+ * with search_model_add_positions().
+ *
+ * Rows inserted or removed move the positions after them. PlaylistModel
+ * signals batches of those in ascending order, so the positions are not
+ * moved right away, which would make a batch take time proportional to
+ * its size times ours. Instead, the positions before the last change
+ * are up to date, and those after it are off by @shift; in between is a
+ * gap left by the rows removed. Each change only brings the positions
+ * it passes up to date, so a batch takes one pass over ours.
+ **/
+
+static void
+search_model_tree_model_init (GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (SearchModel,
+                         search_model,
+                         G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE
+                                (GTK_TYPE_TREE_MODEL,
+                                 search_model_tree_model_init));
+
+struct _SearchModelPrivate {
+        PlaylistModel *model;
+
+        GArray        *positions; /* int, ascending */
+
+        guint          gap_start;
+        guint          gap_length;
+        int            shift;     /* Of the positions after the gap */
+        int            last_change;
+};
+
+#define GET_PRIVATE(o) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
+                                      TYPE_SEARCH_MODEL, \
+                                      SearchModelPrivate))
+
+#define POSITION(priv, i) \
+        g_array_index ((priv)->positions, int, (i))
+
+static guint
+get_n_rows (SearchModelPrivate *priv)
+{
+        return priv->positions->len - priv->gap_length;
+}
+
+/**
+ * Returns the playlist position of our row @index.
+ **/
+static int
+get_position (SearchModelPrivate *priv,
+              guint               index)
+{
+        if (index < priv->gap_start)
+                return POSITION (priv, index);
+
+        return POSITION (priv, index + priv->gap_length) - priv->shift;
+}
+
+static gboolean
+is_settled (SearchModelPrivate *priv)
+{
+        return priv->gap_length == 0 && priv->shift == 0;
+}
+
+/**
+ * Brings all positions up to date, and closes the gap.
+ **/
+static void
+settle (SearchModelPrivate *priv)
+{
+        guint n_rows, i;
+
+        if (is_settled (priv))
+                return;
+
+        n_rows = get_n_rows (priv);
+
+        for (i = priv->gap_start; i < n_rows; i++)
+                POSITION (priv, i) = get_position (priv, i);
+
+        g_array_set_size (priv->positions, n_rows);
+
+        priv->gap_start  = 0;
+        priv->gap_length = 0;
+        priv->shift      = 0;
+}
+
+/**
+ * Returns the index of the first of our rows at or after playlist
+ * position @position.
+ **/
+static guint
+lower_bound (SearchModelPrivate *priv,
+             int                 position)
+{
+        guint low, high;
+
+        low  = 0;
+        high = get_n_rows (priv);
+
+        while (low < high) {
+                guint middle = (low + high) / 2;
+
+                if (get_position (priv, middle) < position)
+                        low = middle + 1;
+                else
+                        high = middle;
+        }
+
+        return low;
+}
+
+/**
+ * Returns the index of the row at playlist position @position, or -1 if
+ * it is not shown.
+ **/
+static int
+find_position (SearchModelPrivate *priv,
+               int                 position)
+{
+        guint i;
+
+        i = lower_bound (priv, position);
+        if (i < get_n_rows (priv) && get_position (priv, i) == position)
+                return i;
+
+        return -1;
+}
+
+static int
+find_iter (SearchModelPrivate *priv,
+           GtkTreeIter        *iter)
+{
+        return find_position (priv,
+                              playlist_model_get_position (priv->model,
+                                                           iter));
+}
+
+static gboolean
+get_iter_at (SearchModelPrivate *priv,
+             GtkTreeIter        *iter,
+             int                 index)
+{
+        if (index < 0 || index >= (int) get_n_rows (priv))
+                return FALSE;
+
+        return playlist_model_get_iter_at (priv->model,
+                                           iter,
+                                           get_position (priv, index));
+}
+
+/**
+ * Rows at and after playlist position @position move by @delta, after
+ * the row at @position is removed if @remove is TRUE. Returns our index
+ * of that row if it was shown, or -1.
+ **/
+static int
+move_rows (SearchModelPrivate *priv,
+           int                 position,
+           int                 delta,
+           gboolean            remove)
+{
+        guint n_rows;
+        int index = -1;
+
+        /**
+         * Changes before the last one would move positions that are
+         * up to date already.
+         **/
+        if (!is_settled (priv) && position < priv->last_change)
+                settle (priv);
+
+        n_rows = get_n_rows (priv);
+
+        if (is_settled (priv))
+                priv->gap_start = lower_bound (priv, position);
+        else {
+                while (priv->gap_start < n_rows &&
+                       get_position (priv, priv->gap_start) < position) {
+                        POSITION (priv, priv->gap_start) =
+                                get_position (priv, priv->gap_start);
+                        priv->gap_start++;
+                }
+        }
+
+        if (remove &&
+            priv->gap_start < n_rows &&
+            get_position (priv, priv->gap_start) == position) {
+                index = priv->gap_start;
+                priv->gap_length++;
+        }
+
+        priv->shift -= delta;
+        priv->last_change = position;
+
+        return index;
+}
+
+/**
+ * PlaylistModel signal handlers.
+ **/
+static void
+model_row_changed_cb (GtkTreeModel *tree_model,
+                      GtkTreePath  *path,
+                      GtkTreeIter  *iter,
+                      SearchModel  *search_model)
+{
+        GtkTreePath *our_path;
+        int index;
+
+        index = find_position (search_model->priv,
+                               gtk_tree_path_get_indices (path)[0]);
+        if (index < 0)
+                return;
+
+        our_path = gtk_tree_path_new_from_indices (index, -1);
+        gtk_tree_model_row_changed (GTK_TREE_MODEL (search_model),
+                                    our_path,
+                                    iter);
+        gtk_tree_path_free (our_path);
+}
+
+static void
+model_row_inserted_cb (GtkTreeModel *tree_model,
+                       GtkTreePath  *path,
+                       GtkTreeIter  *iter,
+                       SearchModel  *search_model)
+{
+        move_rows (search_model->priv,
+                   gtk_tree_path_get_indices (path)[0],
+                   1,
+                   FALSE);
+}
+
+static void
+model_row_deleted_cb (GtkTreeModel *tree_model,
+                      GtkTreePath  *path,
+                      SearchModel  *search_model)
+{
+        GtkTreePath *our_path;
+        int index;
+
+        index = move_rows (search_model->priv,
+                           gtk_tree_path_get_indices (path)[0],
+                           -1,
+                           TRUE);
+        if (index < 0)
+                return;
+
+        our_path = gtk_tree_path_new_from_indices (index, -1);
+        gtk_tree_model_row_deleted (GTK_TREE_MODEL (search_model), our_path);
+        gtk_tree_path_free (our_path);
+}
+
+static int
+compare_ints (const int *a,
+              const int *b)
+{
+        return *a - *b;
+}
+
+static void
+model_rows_reordered_cb (GtkTreeModel *tree_model,
+                         GtkTreePath  *path,
+                         GtkTreeIter  *iter,
+                         int          *new_order,
+                         SearchModel  *search_model)
+{
+        SearchModelPrivate *priv = search_model->priv;
+        GtkTreePath *our_path;
+        int *old_to_new, *our_order, n_rows;
+        guint i;
+
+        settle (priv);
+
+        if (priv->positions->len == 0)
+                return;
+
+        n_rows = playlist_model_get_n_rows (priv->model);
+
+        old_to_new = g_new (int, n_rows);
+        for (i = 0; i < (guint) n_rows; i++)
+                old_to_new[new_order[i]] = i;
+
+        /**
+         * Sort pairs of new position and old index by new position,
+         * which gives our own new order.
+         **/
+        our_order = g_new (int, 2 * priv->positions->len);
+        for (i = 0; i < priv->positions->len; i++) {
+                our_order[2 * i]     = old_to_new[POSITION (priv, i)];
+                our_order[2 * i + 1] = i;
+        }
+
+        qsort (our_order,
+               priv->positions->len,
+               2 * sizeof (int),
+               (GCompareFunc) compare_ints);
+
+        for (i = 0; i < priv->positions->len; i++) {
+                POSITION (priv, i) = our_order[2 * i];
+                our_order[i] = our_order[2 * i + 1];
+        }
+
+        our_path = gtk_tree_path_new ();
+        gtk_tree_model_rows_reordered (GTK_TREE_MODEL (search_model),
+                                       our_path,
+                                       NULL,
+                                       our_order);
+        gtk_tree_path_free (our_path);
+
+        g_free (our_order);
+        g_free (old_to_new);
+}
+
+static void
+search_model_init (SearchModel *search_model)
+{
+        search_model->priv = GET_PRIVATE (search_model);
+
+        search_model->priv->positions = g_array_new (FALSE,
+                                                     FALSE,
+                                                     sizeof (int));
+}
+
+static void
+search_model_dispose (GObject *object)
+{
+        SearchModel *search_model;
+        GObjectClass *object_class;
+
+        search_model = SEARCH_MODEL (object);
+
+        if (search_model->priv->model) {
+                g_signal_handlers_disconnect_by_func
+                                        (search_model->priv->model,
+                                         model_row_changed_cb,
+                                         search_model);
+                g_signal_handlers_disconnect_by_func
+                                        (search_model->priv->model,
+                                         model_row_inserted_cb,
+                                         search_model);
+                g_signal_handlers_disconnect_by_func
+                                        (search_model->priv->model,
+                                         model_row_deleted_cb,
+                                         search_model);
+                g_signal_handlers_disconnect_by_func
+                                        (search_model->priv->model,
+                                         model_rows_reordered_cb,
+                                         search_model);
+
+                g_object_unref (search_model->priv->model);
+                search_model->priv->model = NULL;
+        }
+
+        object_class = G_OBJECT_CLASS (search_model_parent_class);
+        object_class->dispose (object);
+}
+
+static void
+search_model_finalize (GObject *object)
+{
+        SearchModel *search_model;
+        GObjectClass *object_class;
+
+        search_model = SEARCH_MODEL (object);
+
+        g_array_free (search_model->priv->positions, TRUE);
+
+        object_class = G_OBJECT_CLASS (search_model_parent_class);
+        object_class->finalize (object);
+}
+
+static void
+search_model_class_init (SearchModelClass *klass)
+{
+        GObjectClass *object_class;
+
+        object_class = G_OBJECT_CLASS (klass);
+
+        object_class->dispose  = search_model_dispose;
+        object_class->finalize = search_model_finalize;
+
+        g_type_class_add_private (klass, sizeof (SearchModelPrivate));
+}
+
+/**
+ * GtkTreeModel implementation. Everything but paths is passed on to the
+ * PlaylistModel.
+ **/
+static GtkTreeModelFlags
+search_model_get_flags (GtkTreeModel *tree_model)
+{
+        return GTK_TREE_MODEL_ITERS_PERSIST | GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static int
+search_model_get_n_columns (GtkTreeModel *tree_model)
+{
+        return PLAYLIST_MODEL_N_COLUMNS;
+}
+
+static GType
+search_model_get_column_type (GtkTreeModel *tree_model,
+                              int           index)
+{
+        SearchModel *search_model = SEARCH_MODEL (tree_model);
+
+        return gtk_tree_model_get_column_type
+                        (GTK_TREE_MODEL (search_model->priv->model), index);
+}
+
+static gboolean
+search_model_get_iter (GtkTreeModel *tree_model,
+                       GtkTreeIter  *iter,
+                       GtkTreePath  *path)
+{
+        g_return_val_if_fail (gtk_tree_path_get_depth (path) > 0, FALSE);
+
+        return get_iter_at (SEARCH_MODEL (tree_model)->priv,
+                            iter,
+                            gtk_tree_path_get_indices (path)[0]);
+}
+
+static GtkTreePath *
+search_model_get_path (GtkTreeModel *tree_model,
+                       GtkTreeIter  *iter)
+{
+        int index;
+
+        index = find_iter (SEARCH_MODEL (tree_model)->priv, iter);
+        g_return_val_if_fail (index >= 0, NULL);
+
+        return gtk_tree_path_new_from_indices (index, -1);
+}
+
+static void
+search_model_get_value (GtkTreeModel *tree_model,
+                        GtkTreeIter  *iter,
+                        int           column,
+                        GValue       *value)
+{
+        SearchModel *search_model = SEARCH_MODEL (tree_model);
+
+        gtk_tree_model_get_value (GTK_TREE_MODEL (search_model->priv->model),
+                                  iter,
+                                  column,
+                                  value);
+}
+
+static gboolean
+search_model_iter_next (GtkTreeModel *tree_model,
+                        GtkTreeIter  *iter)
+{
+        SearchModelPrivate *priv = SEARCH_MODEL (tree_model)->priv;
+        int index;
+
+        index = find_iter (priv, iter);
+        g_return_val_if_fail (index >= 0, FALSE);
+
+        return get_iter_at (priv, iter, index + 1);
+}
+
+static gboolean
+search_model_iter_children (GtkTreeModel *tree_model,
+                            GtkTreeIter  *iter,
+                            GtkTreeIter  *parent)
+{
+        if (parent)
+                return FALSE;
+
+        return get_iter_at (SEARCH_MODEL (tree_model)->priv, iter, 0);
+}
+
+static gboolean
+search_model_iter_has_child (GtkTreeModel *tree_model,
+                             GtkTreeIter  *iter)
+{
+        return FALSE;
+}
+
+static int
+search_model_iter_n_children (GtkTreeModel *tree_model,
+                              GtkTreeIter  *iter)
+{
+        if (iter)
+                return 0;
+
+        return get_n_rows (SEARCH_MODEL (tree_model)->priv);
+}
+
+static gboolean
+search_model_iter_nth_child (GtkTreeModel *tree_model,
+                             GtkTreeIter  *iter,
+                             GtkTreeIter  *parent,
+                             int           n)
+{
+        if (parent)
+                return FALSE;
+
+        return get_iter_at (SEARCH_MODEL (tree_model)->priv, iter, n);
+}
+
+static gboolean
+search_model_iter_parent (GtkTreeModel *tree_model,
+                          GtkTreeIter  *iter,
+                          GtkTreeIter  *child)
+{
+        return FALSE;
+}
+
+static void
+search_model_tree_model_init (GtkTreeModelIface *iface)
+{
+        iface->get_flags       = search_model_get_flags;
+        iface->get_n_columns   = search_model_get_n_columns;
+        iface->get_column_type = search_model_get_column_type;
+        iface->get_iter        = search_model_get_iter;
+        iface->get_path        = search_model_get_path;
+        iface->get_value       = search_model_get_value;
+        iface->iter_next       = search_model_iter_next;
+        iface->iter_children   = search_model_iter_children;
+        iface->iter_has_child  = search_model_iter_has_child;
+        iface->iter_n_children = search_model_iter_n_children;
+        iface->iter_nth_child  = search_model_iter_nth_child;
+        iface->iter_parent     = search_model_iter_parent;
+}
+
+/**
+ * search_model_new
+ * @model: A #PlaylistModel
+ * @positions: The positions of the rows of @model to show
+ * @n_positions: The number of positions in @positions
+ *
+ * Return value: A new #SearchModel showing the rows at @positions, in
+ * the order they have in @model.
+ **/
+SearchModel *
+search_model_new (PlaylistModel *model,
+                  const int     *positions,
+                  int            n_positions)
+{
+        SearchModel *search_model;
+        SearchModelPrivate *priv;
+
+        g_return_val_if_fail (IS_PLAYLIST_MODEL (model), NULL);
+        g_return_val_if_fail (positions != NULL || n_positions == 0, NULL);
+
+        search_model = g_object_new (TYPE_SEARCH_MODEL, NULL);
+        priv = search_model->priv;
+
+        priv->model = g_object_ref (model);
+
+        g_array_append_vals (priv->positions, positions, n_positions);
+        g_array_sort (priv->positions, (GCompareFunc) compare_ints);
+
+        g_signal_connect (model,
+                          "row-changed",
+                          G_CALLBACK (model_row_changed_cb),
+                          search_model);
+        g_signal_connect (model,
+                          "row-inserted",
+                          G_CALLBACK (model_row_inserted_cb),
+                          search_model);
+        g_signal_connect (model,
+                          "row-deleted",
+                          G_CALLBACK (model_row_deleted_cb),
+                          search_model);
+        g_signal_connect (model,
+                          "rows-reordered",
+                          G_CALLBACK (model_rows_reordered_cb),
+                          search_model);
+
+        return search_model;
+}
+
+/**
+ * search_model_add_positions
+ * @search_model: A #SearchModel
+ * @positions: The positions of more rows of the #PlaylistModel to show
+ * @n_positions: The number of positions in @positions
+ *
+ * Shows the rows at @positions as well, those not shown already, in the
+ * order they have in the #PlaylistModel.
+ **/
+void
+search_model_add_positions (SearchModel *search_model,
+                            const int   *positions,
+                            int          n_positions)
+{
+        SearchModelPrivate *priv;
+        GArray *sorted;
+        guint n_old, i;
+        int n_model_rows;
+
+        g_return_if_fail (IS_SEARCH_MODEL (search_model));
+        g_return_if_fail (positions != NULL || n_positions == 0);
+
+        if (n_positions <= 0)
+                return;
+
+        priv = search_model->priv;
+
+        sorted = g_array_sized_new (FALSE, FALSE, sizeof (int), n_positions);
+        g_array_append_vals (sorted, positions, n_positions);
+        g_array_sort (sorted, (GCompareFunc) compare_ints);
+
+        /**
+         * Move our positions up, leaving a gap in front for the new
+         * ones. Those are merged in in one pass, filling the gap, so
+         * that we are consistent whenever row-inserted is emitted.
+         **/
+        settle (priv);
+
+        n_old = priv->positions->len;
+        g_array_set_size (priv->positions, n_old + n_positions);
+        g_memmove (&POSITION (priv, n_positions),
+                   &POSITION (priv, 0),
+                   n_old * sizeof (int));
+
+        priv->gap_start  = 0;
+        priv->gap_length = n_positions;
+
+        n_model_rows = playlist_model_get_n_rows (priv->model);
+
+        for (i = 0; i < sorted->len; i++) {
+                GtkTreePath *path;
+                GtkTreeIter iter;
+                int position;
+                guint n_rows;
+
+                position = g_array_index (sorted, int, i);
+                if (position < 0 || position >= n_model_rows ||
+                    (i > 0 && position == g_array_index (sorted, int, i - 1)))
+                        continue;
+
+                n_rows = get_n_rows (priv);
+
+                while (priv->gap_start < n_rows &&
+                       get_position (priv, priv->gap_start) < position) {
+                        POSITION (priv, priv->gap_start) =
+                                get_position (priv, priv->gap_start);
+                        priv->gap_start++;
+                }
+
+                if (priv->gap_start < n_rows &&
+                    get_position (priv, priv->gap_start) == position)
+                        continue;
+
+                POSITION (priv, priv->gap_start) = position;
+                priv->gap_start++;
+                priv->gap_length--;
+
+                playlist_model_get_iter_at (priv->model, &iter, position);
+
+                path = gtk_tree_path_new_from_indices (priv->gap_start - 1,
+                                                       -1);
+                gtk_tree_model_row_inserted (GTK_TREE_MODEL (search_model),
+                                             path,
+                                             &iter);
+                gtk_tree_path_free (path);
+        }
+
+        settle (priv);
+
+        g_array_free (sorted, TRUE);
+}
+
+/**
+ * search_model_get_model
+ * @search_model: A #SearchModel
+ *
+ * Return value: The #PlaylistModel whose rows @search_model shows.
+ **/
+PlaylistModel *
+search_model_get_model (SearchModel *search_model)
+{
+        g_return_val_if_fail (IS_SEARCH_MODEL (search_model), NULL);
+
+        return search_model->priv->model;
+}
+
+/**
+ * search_model_get_n_rows
+ * @search_model: A #SearchModel
+ *
+ * Return value: The number of rows @search_model shows.
+ **/
+int
+search_model_get_n_rows (SearchModel *search_model)
+{
+        g_return_val_if_fail (IS_SEARCH_MODEL (search_model), 0);
+
+        return get_n_rows (search_model->priv);
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SEARCH_MODEL_H__
+#define __SEARCH_MODEL_H__
+
+#include "playlist-model.h"
+
+G_BEGIN_DECLS
+
+#define TYPE_SEARCH_MODEL \
+                (search_model_get_type ())
+#define SEARCH_MODEL(obj) \
+                (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                 TYPE_SEARCH_MODEL, \
+                 SearchModel))
+#define SEARCH_MODEL_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_CAST ((klass), \
+                 TYPE_SEARCH_MODEL, \
+                 SearchModelClass))
+#define IS_SEARCH_MODEL(obj) \
+                (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                 TYPE_SEARCH_MODEL))
+#define IS_SEARCH_MODEL_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                 TYPE_SEARCH_MODEL))
+#define SEARCH_MODEL_GET_CLASS(obj) \
+                (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+                 TYPE_SEARCH_MODEL, \
+                 SearchModelClass))
+
+typedef struct _SearchModelPrivate SearchModelPrivate;
+
+typedef struct {
+        GObject parent;
+
+        SearchModelPrivate *priv;
+} SearchModel;
+
+typedef struct {
+        GObjectClass parent_class;
+
+        /* Future padding */
+        void (* _reserved1) (void);
+        void (* _reserved2) (void);
+        void (* _reserved3) (void);
+        void (* _reserved4) (void);
+} SearchModelClass;
+
+GType
+search_model_get_type      (void) G_GNUC_CONST;
+
+SearchModel *
+search_model_new           (PlaylistModel *model,
+                            const int     *positions,
+                            int            n_positions);
+
+void
+search_model_add_positions (SearchModel   *search_model,
+                            const int     *positions,
+                            int            n_positions);
+
+PlaylistModel *
+search_model_get_model     (SearchModel   *search_model);
+
+int
+search_model_get_n_rows    (SearchModel   *search_model);
+
+G_END_DECLS
+
+#endif /* __SEARCH_MODEL_H__ */
@@ -0,0 +1,876 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "tag-cache.h"
+#include "marshal.h"
+
+/**
+ * The cache file is a hash table that is used straight from a read-only
+ * mapping, so that loading it costs nothing up front. It starts with a
+ * FileHeader, followed by the bucket table: n_buckets offsets of the
+ * first entry in each bucket. Each entry is a FileEntry followed by its
+ * NUL-terminated URI, title and artist, padded to 8 bytes. Offsets are
+ * from the start of the file, and 0 ends a bucket's chain.
+ *
+ * Entries stored after loading are kept in a hash table, which takes
+ * precedence over the file, until they are written out by
+ * tag_cache_save().
+ *
+ * Lookups do not touch the file system: stat() on slow storage is not
+ * something to do once per row on the main thread. Hits are served
+ * right away, and whether their files are still the same is checked
+ * on a thread afterwards; those that changed are reported through
+ * 'entries-stale'.
+ **/
+
+#define FILE_MAGIC      "GAKUTAGS"
+#define FILE_VERSION    1
+#define FILE_BYTE_ORDER 0x01020304
+
+typedef struct {
+        char    magic[8];
+        guint32 version;
+        guint32 byte_order; /* FILE_BYTE_ORDER as written */
+        guint32 n_buckets;
+        guint32 n_entries;
+} FileHeader;
+
+typedef struct {
+        guint32 next;
+        guint32 hash;
+        gint64  mtime;
+        gint64  size;
+        gint32  duration;
+        guint32 uri_length;
+        guint32 title_length;
+        guint32 artist_length;
+} FileEntry;
+
+typedef struct {
+        gint64  mtime;
+        gint64  size;
+        int     duration;
+        char   *title;
+        char   *artist;
+} MemEntry;
+
+/**
+ * A hit whose file is yet to be checked.
+ **/
+typedef struct {
+        char   *uri;
+        gint64  mtime;
+        gint64  size;
+} Check;
+
+G_DEFINE_TYPE (TagCache,
+               tag_cache,
+               G_TYPE_OBJECT);
+
+enum {
+        SIGNAL_ENTRIES_STALE,
+        SIGNAL_LAST
+};
+
+static guint signals[SIGNAL_LAST];
+
+struct _TagCachePrivate {
+        char          *filename;
+
+        /**
+         * The mapped cache file, or NULL.
+         **/
+        const char    *data;
+        gsize          length;
+        const guint32 *buckets;
+        guint32        n_buckets;
+        guint32        n_entries;
+
+        /**
+         * URI -> MemEntry, for what was stored since loading.
+         **/
+        GHashTable    *entries;
+        gboolean       dirty;
+
+        guint          hits;
+        guint          misses;
+
+        /**
+         * Hits not handed to @pool yet, and the idle source doing so,
+         * or 0.
+         **/
+        GArray        *unchecked; /* Check */
+        guint          check_id;
+        GThreadPool   *pool;
+};
+
+/**
+ * Hits being checked on the thread pool.
+ **/
+typedef struct {
+        TagCache  *cache;
+        GArray    *checks; /* Check */
+        GPtrArray *stale;  /* URIs in @checks */
+} CheckBatch;
+
+#define GET_PRIVATE(o) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
+                                      TYPE_TAG_CACHE, \
+                                      TagCachePrivate))
+
+static void
+mem_entry_free (MemEntry *entry)
+{
+        g_free (entry->title);
+        g_free (entry->artist);
+
+        g_slice_free (MemEntry, entry);
+}
+
+static void
+free_checks (GArray *checks)
+{
+        guint i;
+
+        for (i = 0; i < checks->len; i++)
+                g_free (g_array_index (checks, Check, i).uri);
+
+        g_array_free (checks, TRUE);
+}
+
+static void
+check_batch (CheckBatch *batch,
+             gpointer    user_data);
+
+static void
+tag_cache_init (TagCache *cache)
+{
+        cache->priv = GET_PRIVATE (cache);
+
+        cache->priv->entries =
+                g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) mem_entry_free);
+
+        cache->priv->unchecked = g_array_new (FALSE, FALSE, sizeof (Check));
+
+        cache->priv->pool = g_thread_pool_new ((GFunc) check_batch,
+                                               NULL,
+                                               1,
+                                               FALSE,
+                                               NULL);
+}
+
+static void
+tag_cache_finalize (GObject *object)
+{
+        TagCache *cache;
+        GObjectClass *object_class;
+
+        cache = TAG_CACHE (object);
+
+        /**
+         * Batches hold a reference, so none are left by now.
+         **/
+        g_thread_pool_free (cache->priv->pool, FALSE, TRUE);
+
+        if (cache->priv->check_id)
+                g_source_remove (cache->priv->check_id);
+
+        free_checks (cache->priv->unchecked);
+
+        if (cache->priv->data)
+                munmap ((void *) cache->priv->data, cache->priv->length);
+
+        g_hash_table_destroy (cache->priv->entries);
+
+        g_free (cache->priv->filename);
+
+        object_class = G_OBJECT_CLASS (tag_cache_parent_class);
+        object_class->finalize (object);
+}
+
+static void
+tag_cache_class_init (TagCacheClass *klass)
+{
+        GObjectClass *object_class;
+
+        object_class = G_OBJECT_CLASS (klass);
+
+        object_class->finalize = tag_cache_finalize;
+
+        g_type_class_add_private (klass, sizeof (TagCachePrivate));
+
+        signals[SIGNAL_ENTRIES_STALE] =
+                g_signal_new ("entries-stale",
+                              TYPE_TAG_CACHE,
+                              G_SIGNAL_RUN_LAST,
+                              G_STRUCT_OFFSET (TagCacheClass,
+                                               entries_stale),
+                              NULL,
+                              NULL,
+                              gaku_marshal_VOID__POINTER_INT,
+                              G_TYPE_NONE,
+                              2,
+                              G_TYPE_POINTER,
+                              G_TYPE_INT);
+}
+
+/**
+ * Offset of the first entry in a file with @n_buckets buckets.
+ **/
+static gsize
+entries_offset (guint32 n_buckets)
+{
+        gsize offset;
+
+        offset = sizeof (FileHeader) + n_buckets * sizeof (guint32);
+
+        return (offset + 7) & ~7;
+}
+
+/**
+ * Maps the cache file, if there is a valid one.
+ **/
+static void
+load (TagCachePrivate *priv)
+{
+        const FileHeader *header;
+        struct stat st;
+        void *map;
+        int fd;
+
+        fd = open (priv->filename, O_RDONLY);
+        if (fd < 0)
+                return;
+
+        if (fstat (fd, &st) < 0 || st.st_size < (off_t) sizeof (FileHeader)) {
+                close (fd);
+
+                return;
+        }
+
+        map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        close (fd);
+
+        if (map == MAP_FAILED)
+                return;
+
+        header = map;
+
+        if (memcmp (header->magic, FILE_MAGIC, sizeof (header->magic)) ||
+            header->version != FILE_VERSION ||
+            header->byte_order != FILE_BYTE_ORDER ||
+            header->n_buckets == 0 ||
+            entries_offset (header->n_buckets) > (gsize) st.st_size) {
+                munmap (map, st.st_size);
+
+                return;
+        }
+
+        priv->data      = map;
+        priv->length    = st.st_size;
+        priv->buckets   = (const guint32 *) (priv->data + sizeof (FileHeader));
+        priv->n_buckets = header->n_buckets;
+        priv->n_entries = header->n_entries;
+}
+
+/**
+ * Returns the entry at @offset in the cache file, or NULL if it does not
+ * lie entirely within the file. Cache files are not trusted.
+ **/
+static const FileEntry *
+get_file_entry (TagCachePrivate *priv,
+                guint32          offset)
+{
+        const FileEntry *entry;
+        const char *strings;
+        gsize avail;
+
+        if (offset % 8 ||
+            offset < entries_offset (priv->n_buckets) ||
+            offset > priv->length ||
+            priv->length - offset < sizeof (FileEntry))
+                return NULL;
+
+        entry = (const FileEntry *) (priv->data + offset);
+
+        strings = (const char *) (entry + 1);
+        avail = priv->length - offset - sizeof (FileEntry);
+
+        if (entry->uri_length >= avail ||
+            entry->title_length >= avail - entry->uri_length - 1 ||
+            entry->artist_length >= avail - entry->uri_length - 1 -
+                                    entry->title_length - 1)
+                return NULL;
+
+        if (strings[entry->uri_length] != '\0' ||
+            strings[entry->uri_length + 1 + entry->title_length] != '\0' ||
+            strings[entry->uri_length + 1 + entry->title_length + 1 +
+                    entry->artist_length] != '\0')
+                return NULL;
+
+        return entry;
+}
+
+static const char *
+file_entry_uri (const FileEntry *entry)
+{
+        return (const char *) (entry + 1);
+}
+
+static const char *
+file_entry_title (const FileEntry *entry)
+{
+        return file_entry_uri (entry) + entry->uri_length + 1;
+}
+
+static const char *
+file_entry_artist (const FileEntry *entry)
+{
+        return file_entry_title (entry) + entry->title_length + 1;
+}
+
+/**
+ * Looks @uri with hash @hash up in the cache file.
+ **/
+static const FileEntry *
+file_lookup (TagCachePrivate *priv,
+             const char      *uri,
+             guint32          hash)
+{
+        guint32 offset, n;
+
+        if (!priv->data)
+                return NULL;
+
+        offset = priv->buckets[hash % priv->n_buckets];
+
+        for (n = 0; offset && n < priv->n_entries; n++) {
+                const FileEntry *entry;
+
+                entry = get_file_entry (priv, offset);
+                if (!entry)
+                        return NULL;
+
+                if (entry->hash == hash &&
+                    !strcmp (file_entry_uri (entry), uri))
+                        return entry;
+
+                offset = entry->next;
+        }
+
+        return NULL;
+}
+
+/**
+ * Gets modification time and size of the file @uri points to.
+ **/
+static gboolean
+stat_uri (const char *uri,
+          gint64     *mtime,
+          gint64     *size)
+{
+        char *filename;
+        struct stat st;
+        int ret;
+
+        filename = g_filename_from_uri (uri, NULL, NULL);
+        if (!filename)
+                return FALSE;
+
+        ret = g_stat (filename, &st);
+
+        g_free (filename);
+
+        if (ret < 0)
+                return FALSE;
+
+        *mtime = st.st_mtime;
+        *size  = st.st_size;
+
+        return TRUE;
+}
+
+/**
+ * Reports the stale entries found in @batch, and frees it. Runs in the
+ * main loop.
+ **/
+static gboolean
+deliver_stale (CheckBatch *batch)
+{
+        TagCache *cache = batch->cache;
+
+        if (batch->stale->len > 0) {
+                cache->priv->hits   -= batch->stale->len;
+                cache->priv->misses += batch->stale->len;
+
+                g_signal_emit (cache,
+                               signals[SIGNAL_ENTRIES_STALE],
+                               0,
+                               batch->stale->pdata,
+                               batch->stale->len);
+        }
+
+        g_ptr_array_free (batch->stale, TRUE);
+        free_checks (batch->checks);
+
+        g_object_unref (cache);
+
+        g_slice_free (CheckBatch, batch);
+
+        return FALSE;
+}
+
+/**
+ * Finds the files in @batch that changed since their entries were
+ * stored. Runs in a pool thread.
+ **/
+static void
+check_batch (CheckBatch *batch,
+             gpointer    user_data)
+{
+        guint i;
+
+        for (i = 0; i < batch->checks->len; i++) {
+                Check *check = &g_array_index (batch->checks, Check, i);
+                gint64 mtime, size;
+
+                if (!stat_uri (check->uri, &mtime, &size) ||
+                    mtime != check->mtime || size != check->size)
+                        g_ptr_array_add (batch->stale, check->uri);
+        }
+
+        g_idle_add ((GSourceFunc) deliver_stale, batch);
+}
+
+/**
+ * Hands the hits collected so far to the thread pool.
+ **/
+static gboolean
+push_unchecked (TagCache *cache)
+{
+        TagCachePrivate *priv = cache->priv;
+        CheckBatch *batch;
+
+        priv->check_id = 0;
+
+        batch = g_slice_new (CheckBatch);
+
+        batch->cache  = g_object_ref (cache);
+        batch->checks = priv->unchecked;
+        batch->stale  = g_ptr_array_new ();
+
+        priv->unchecked = g_array_new (FALSE, FALSE, sizeof (Check));
+
+        g_thread_pool_push (priv->pool, batch, NULL);
+
+        return FALSE;
+}
+
+/**
+ * Remembers to check whether the file @uri points to still has @mtime
+ * and @size.
+ **/
+static void
+add_check (TagCache   *cache,
+           const char *uri,
+           gint64      mtime,
+           gint64      size)
+{
+        TagCachePrivate *priv = cache->priv;
+        Check check;
+
+        check.uri   = g_strdup (uri);
+        check.mtime = mtime;
+        check.size  = size;
+
+        g_array_append_val (priv->unchecked, check);
+
+        if (!priv->check_id) {
+                priv->check_id =
+                        g_idle_add_full (G_PRIORITY_LOW,
+                                         (GSourceFunc) push_unchecked,
+                                         cache,
+                                         NULL);
+        }
+}
+
+static const char *
+empty_to_null (const char *str)
+{
+        return (str && str[0] != '\0') ? str : NULL;
+}
+
+/**
+ * tag_cache_new
+ * @filename: The cache file
+ *
+ * Return value: A new #TagCache, holding what is in @filename if it is
+ * a valid cache file.
+ **/
+TagCache *
+tag_cache_new (const char *filename)
+{
+        TagCache *cache;
+
+        g_return_val_if_fail (filename != NULL, NULL);
+
+        cache = g_object_new (TYPE_TAG_CACHE, NULL);
+
+        cache->priv->filename = g_strdup (filename);
+
+        load (cache->priv);
+
+        return cache;
+}
+
+/**
+ * tag_cache_lookup
+ * @cache: A #TagCache
+ * @uri: An URI
+ * @title: Return location for the title, or NULL
+ * @artist: Return location for the artist, or NULL
+ * @duration: Return location for the duration in seconds, or NULL
+ *
+ * Looks up the tags of @uri, without touching the file system. Whether
+ * the file still has the modification time and size it had when the
+ * entry was stored is checked in the background afterwards;
+ * 'entries-stale' is emitted for the hits that turn out to be out of
+ * date. Returned strings are NULL if unknown, and remain valid until
+ * the next tag_cache_store() for @uri, or until @cache is finalized.
+ *
+ * Return value: TRUE on a cache hit.
+ **/
+gboolean
+tag_cache_lookup (TagCache    *cache,
+                  const char  *uri,
+                  const char **title,
+                  const char **artist,
+                  int         *duration)
+{
+        TagCachePrivate *priv;
+        const FileEntry *file_entry;
+        MemEntry *mem_entry;
+
+        g_return_val_if_fail (IS_TAG_CACHE (cache), FALSE);
+        g_return_val_if_fail (uri != NULL, FALSE);
+
+        priv = cache->priv;
+
+        mem_entry = g_hash_table_lookup (priv->entries, uri);
+        if (mem_entry) {
+                add_check (cache, uri, mem_entry->mtime, mem_entry->size);
+
+                if (title)
+                        *title = mem_entry->title;
+                if (artist)
+                        *artist = mem_entry->artist;
+                if (duration)
+                        *duration = mem_entry->duration;
+
+                priv->hits++;
+
+                return TRUE;
+        }
+
+        file_entry = file_lookup (priv, uri, g_str_hash (uri));
+        if (!file_entry) {
+                priv->misses++;
+
+                return FALSE;
+        }
+
+        add_check (cache, uri, file_entry->mtime, file_entry->size);
+
+        if (title)
+                *title = empty_to_null (file_entry_title (file_entry));
+        if (artist)
+                *artist = empty_to_null (file_entry_artist (file_entry));
+        if (duration)
+                *duration = file_entry->duration;
+
+        priv->hits++;
+
+        return TRUE;
+}
+
+/**
+ * tag_cache_store
+ * @cache: A #TagCache
+ * @uri: An URI
+ * @title: The title, or NULL
+ * @artist: The artist, or NULL
+ * @duration: The duration in seconds, or -1
+ *
+ * Stores the tags of @uri, along with the current modification time and
+ * size of the file it points to.
+ **/
+void
+tag_cache_store (TagCache   *cache,
+                 const char *uri,
+                 const char *title,
+                 const char *artist,
+                 int         duration)
+{
+        MemEntry *entry;
+        gint64 mtime, size;
+
+        g_return_if_fail (IS_TAG_CACHE (cache));
+        g_return_if_fail (uri != NULL);
+
+        if (!stat_uri (uri, &mtime, &size))
+                return;
+
+        entry = g_slice_new (MemEntry);
+
+        entry->mtime    = mtime;
+        entry->size     = size;
+        entry->duration = duration;
+        entry->title    = g_strdup (empty_to_null (title));
+        entry->artist   = g_strdup (empty_to_null (artist));
+
+        g_hash_table_replace (cache->priv->entries, g_strdup (uri), entry);
+
+        cache->priv->dirty = TRUE;
+}
+
+typedef struct {
+        GByteArray *buffer;
+        guint32    *heads;
+        guint32     n_buckets;
+        guint32     n_entries;
+} Writer;
+
+/**
+ * Appends an entry to the file being written by @writer.
+ **/
+static void
+write_entry (Writer     *writer,
+             const char *uri,
+             guint32     hash,
+             gint64      mtime,
+             gint64      size,
+             int         duration,
+             const char *title,
+             const char *artist)
+{
+        static const char padding[8];
+        FileEntry entry;
+        guint32 bucket;
+
+        if (!title)
+                title = "";
+        if (!artist)
+                artist = "";
+
+        bucket = hash % writer->n_buckets;
+
+        entry.next          = writer->heads[bucket];
+        entry.hash          = hash;
+        entry.mtime         = mtime;
+        entry.size          = size;
+        entry.duration      = duration;
+        entry.uri_length    = strlen (uri);
+        entry.title_length  = strlen (title);
+        entry.artist_length = strlen (artist);
+
+        writer->heads[bucket] = writer->buffer->len;
+        writer->n_entries++;
+
+        g_byte_array_append (writer->buffer,
+                             (const guint8 *) &entry,
+                             sizeof (FileEntry));
+        g_byte_array_append (writer->buffer,
+                             (const guint8 *) uri,
+                             entry.uri_length + 1);
+        g_byte_array_append (writer->buffer,
+                             (const guint8 *) title,
+                             entry.title_length + 1);
+        g_byte_array_append (writer->buffer,
+                             (const guint8 *) artist,
+                             entry.artist_length + 1);
+
+        g_byte_array_append (writer->buffer,
+                             (const guint8 *) padding,
+                             (8 - writer->buffer->len % 8) % 8);
+}
+
+static void
+write_mem_entry (const char *uri,
+                 MemEntry   *entry,
+                 Writer     *writer)
+{
+        write_entry (writer,
+                     uri,
+                     g_str_hash (uri),
+                     entry->mtime,
+                     entry->size,
+                     entry->duration,
+                     entry->title,
+                     entry->artist);
+}
+
+/**
+ * tag_cache_save
+ * @cache: A #TagCache
+ * @error: Location where to store a #GError if an error occurs.
+ *
+ * Writes @cache to its file, if anything was stored. The file is
+ * replaced atomically.
+ *
+ * Return value: TRUE on success, FALSE if an error occured in which case
+ * @error is set as well.
+ **/
+gboolean
+tag_cache_save (TagCache *cache,
+                GError  **error)
+{
+        TagCachePrivate *priv;
+        FileHeader header;
+        Writer writer;
+        char *dirname;
+        gboolean ret;
+        guint32 i;
+
+        g_return_val_if_fail (IS_TAG_CACHE (cache), FALSE);
+
+        priv = cache->priv;
+
+        if (!priv->dirty)
+                return TRUE;
+
+        /**
+         * Enough buckets for every entry to possibly be in one of its own.
+         **/
+        writer.n_buckets = g_hash_table_size (priv->entries) +
+                           (priv->data ? priv->n_entries : 0);
+        writer.n_buckets = MAX (writer.n_buckets, 1);
+        writer.heads = g_new0 (guint32, writer.n_buckets);
+        writer.n_entries = 0;
+
+        writer.buffer = g_byte_array_new ();
+        g_byte_array_set_size (writer.buffer,
+                               entries_offset (writer.n_buckets));
+        memset (writer.buffer->data, 0, writer.buffer->len);
+
+        g_hash_table_foreach (priv->entries,
+                              (GHFunc) write_mem_entry,
+                              &writer);
+
+        /**
+         * Carry over what we had in the file, unless stored again.
+         **/
+        for (i = 0; priv->data && i < priv->n_buckets; i++) {
+                guint32 offset, n;
+
+                offset = priv->buckets[i];
+
+                for (n = 0; offset && n < priv->n_entries; n++) {
+                        const FileEntry *entry;
+                        const char *uri;
+
+                        entry = get_file_entry (priv, offset);
+                        if (!entry)
+                                break;
+
+                        uri = file_entry_uri (entry);
+
+                        if (!g_hash_table_lookup (priv->entries, uri) &&
+                            writer.n_entries < writer.n_buckets) {
+                                write_entry (&writer,
+                                             uri,
+                                             entry->hash,
+                                             entry->mtime,
+                                             entry->size,
+                                             entry->duration,
+                                             file_entry_title (entry),
+                                             file_entry_artist (entry));
+                        }
+
+                        offset = entry->next;
+                }
+        }
+
+        memset (&header, 0, sizeof (FileHeader));
+        memcpy (header.magic, FILE_MAGIC, sizeof (header.magic));
+        header.version    = FILE_VERSION;
+        header.byte_order = FILE_BYTE_ORDER;
+        header.n_buckets  = writer.n_buckets;
+        header.n_entries  = writer.n_entries;
+
+        memcpy (writer.buffer->data, &header, sizeof (FileHeader));
+        memcpy (writer.buffer->data + sizeof (FileHeader),
+                writer.heads,
+                writer.n_buckets * sizeof (guint32));
+
+        dirname = g_path_get_dirname (priv->filename);
+        g_mkdir_with_parents (dirname, 0755);
+        g_free (dirname);
+
+        ret = g_file_set_contents (priv->filename,
+                                   (const char *) writer.buffer->data,
+                                   writer.buffer->len,
+                                   error);
+
+        g_byte_array_free (writer.buffer, TRUE);
+        g_free (writer.heads);
+
+        if (ret)
+                priv->dirty = FALSE;
+
+        return ret;
+}
+
+/**
+ * tag_cache_get_hits
+ * @cache: A #TagCache
+ *
+ * Return value: The number of lookups that were a hit.
+ **/
+guint
+tag_cache_get_hits (TagCache *cache)
+{
+        g_return_val_if_fail (IS_TAG_CACHE (cache), 0);
+
+        return cache->priv->hits;
+}
+
+/**
+ * tag_cache_get_misses
+ * @cache: A #TagCache
+ *
+ * Return value: The number of lookups that were a miss.
+ **/
+guint
+tag_cache_get_misses (TagCache *cache)
+{
+        g_return_val_if_fail (IS_TAG_CACHE (cache), 0);
+
+        return cache->priv->misses;
+}
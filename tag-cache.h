@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TAG_CACHE_H__
+#define __TAG_CACHE_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_TAG_CACHE \
+                (tag_cache_get_type ())
+#define TAG_CACHE(obj) \
+                (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                 TYPE_TAG_CACHE, \
+                 TagCache))
+#define TAG_CACHE_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_CAST ((klass), \
+                 TYPE_TAG_CACHE, \
+                 TagCacheClass))
+#define IS_TAG_CACHE(obj) \
+                (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                 TYPE_TAG_CACHE))
+#define IS_TAG_CACHE_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                 TYPE_TAG_CACHE))
+#define TAG_CACHE_GET_CLASS(obj) \
+                (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+                 TYPE_TAG_CACHE, \
+                 TagCacheClass))
+
+typedef struct _TagCachePrivate TagCachePrivate;
+
+typedef struct {
+        GObject parent;
+
+        TagCachePrivate *priv;
+} TagCache;
+
+typedef struct {
+        GObjectClass parent_class;
+
+        /* Signals */
+        void (* entries_stale) (TagCache    *cache,
+                                const char **uris,
+                                int          n_uris);
+
+        /* Future padding */
+        void (* _reserved1) (void);
+        void (* _reserved2) (void);
+        void (* _reserved3) (void);
+        void (* _reserved4) (void);
+} TagCacheClass;
+
+GType
+tag_cache_get_type   (void) G_GNUC_CONST;
+
+TagCache *
+tag_cache_new        (const char *filename);
+
+gboolean
+tag_cache_lookup     (TagCache    *cache,
+                      const char  *uri,
+                      const char **title,
+                      const char **artist,
+                      int         *duration);
+
+void
+tag_cache_store      (TagCache   *cache,
+                      const char *uri,
+                      const char *title,
+                      const char *artist,
+                      int         duration);
+
+gboolean
+tag_cache_save       (TagCache   *cache,
+                      GError    **error);
+
+guint
+tag_cache_get_hits   (TagCache   *cache);
+
+guint
+tag_cache_get_misses (TagCache   *cache);
+
+G_END_DECLS
+
+#endif /* __TAG_CACHE_H__ */
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <unistd.h>
+#include <libowl-av/owl-tag-reader.h>
+
+#include "tag-scheduler.h"
+#include "marshal.h"
+
+/**
+ * TagScheduler spreads tag scans over a number of OwlTagReaders, each
+ * running its own pipeline. Every reader is handed one URI at a time;
+ * the rest wait in our queue, so that we stay in control of the order
+ * in which they are scanned: URIs can be moved to the front at any time,
+ * for instance when their rows scroll into view.
+ **/
+
+G_DEFINE_TYPE (TagScheduler,
+               tag_scheduler,
+               G_TYPE_OBJECT);
+
+enum {
+        SIGNAL_URI_SCANNED,
+        SIGNAL_LAST
+};
+
+static guint signals[SIGNAL_LAST];
+
+typedef struct {
+        TagScheduler *scheduler;
+        OwlTagReader *tag_reader;
+
+        char         *uri; /* Being scanned, or NULL if idle */
+} Reader;
+
+struct _TagSchedulerPrivate {
+        Reader     *readers;
+        int         n_readers;
+
+        GQueue     *pending;
+        GHashTable *pending_index; /* URI -> its link in @pending */
+};
+
+#define GET_PRIVATE(o) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
+                                      TYPE_TAG_SCHEDULER, \
+                                      TagSchedulerPrivate))
+
+/**
+ * Hands the next pending URI to @reader, if any.
+ **/
+static void
+dispatch (TagScheduler *scheduler,
+          Reader       *reader)
+{
+        char *uri;
+
+        uri = g_queue_pop_head (scheduler->priv->pending);
+        if (!uri)
+                return;
+
+        g_hash_table_remove (scheduler->priv->pending_index, uri);
+
+        reader->uri = uri;
+        owl_tag_reader_scan_uri (reader->tag_reader, uri);
+}
+
+/**
+ * One of our readers is done. Pass the result on, and give it the next
+ * URI.
+ **/
+static void
+reader_uri_scanned_cb (OwlTagReader *tag_reader,
+                       const char   *uri,
+                       GError       *error,
+                       GstTagList   *tag_list,
+                       Reader       *reader)
+{
+        TagScheduler *scheduler = reader->scheduler;
+        char *scanned;
+
+        scanned = reader->uri;
+        reader->uri = NULL;
+
+        g_signal_emit (scheduler,
+                       signals[SIGNAL_URI_SCANNED],
+                       0,
+                       uri,
+                       error,
+                       tag_list);
+
+        g_free (scanned);
+
+        if (!reader->uri)
+                dispatch (scheduler, reader);
+}
+
+static void
+tag_scheduler_init (TagScheduler *scheduler)
+{
+        scheduler->priv = GET_PRIVATE (scheduler);
+
+        scheduler->priv->pending = g_queue_new ();
+        scheduler->priv->pending_index = g_hash_table_new (g_str_hash,
+                                                           g_str_equal);
+}
+
+static void
+tag_scheduler_dispose (GObject *object)
+{
+        TagScheduler *scheduler;
+        GObjectClass *object_class;
+        int i;
+
+        scheduler = TAG_SCHEDULER (object);
+
+        for (i = 0; i < scheduler->priv->n_readers; i++) {
+                Reader *reader = &scheduler->priv->readers[i];
+
+                if (!reader->tag_reader)
+                        continue;
+
+                g_signal_handlers_disconnect_by_func
+                                        (reader->tag_reader,
+                                         reader_uri_scanned_cb,
+                                         reader);
+
+                g_object_unref (reader->tag_reader);
+                reader->tag_reader = NULL;
+        }
+
+        object_class = G_OBJECT_CLASS (tag_scheduler_parent_class);
+        object_class->dispose (object);
+}
+
+static void
+tag_scheduler_finalize (GObject *object)
+{
+        TagScheduler *scheduler;
+        GObjectClass *object_class;
+        int i;
+
+        scheduler = TAG_SCHEDULER (object);
+
+        for (i = 0; i < scheduler->priv->n_readers; i++)
+                g_free (scheduler->priv->readers[i].uri);
+
+        g_free (scheduler->priv->readers);
+
+        g_hash_table_destroy (scheduler->priv->pending_index);
+
+        g_queue_foreach (scheduler->priv->pending, (GFunc) g_free, NULL);
+        g_queue_free (scheduler->priv->pending);
+
+        object_class = G_OBJECT_CLASS (tag_scheduler_parent_class);
+        object_class->finalize (object);
+}
+
+static void
+tag_scheduler_class_init (TagSchedulerClass *klass)
+{
+        GObjectClass *object_class;
+
+        object_class = G_OBJECT_CLASS (klass);
+
+        object_class->dispose  = tag_scheduler_dispose;
+        object_class->finalize = tag_scheduler_finalize;
+
+        g_type_class_add_private (klass, sizeof (TagSchedulerPrivate));
+
+        signals[SIGNAL_URI_SCANNED] =
+                g_signal_new ("uri-scanned",
+                              TYPE_TAG_SCHEDULER,
+                              G_SIGNAL_RUN_LAST,
+                              G_STRUCT_OFFSET (TagSchedulerClass,
+                                               uri_scanned),
+                              NULL,
+                              NULL,
+                              gaku_marshal_VOID__STRING_POINTER_POINTER,
+                              G_TYPE_NONE,
+                              3,
+                              G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                              G_TYPE_POINTER,
+                              G_TYPE_POINTER);
+}
+
+/**
+ * tag_scheduler_new
+ * @n_readers: The number of URIs to scan concurrently, or 0 for one per
+ * CPU
+ *
+ * Return value: A new #TagScheduler.
+ **/
+TagScheduler *
+tag_scheduler_new (int n_readers)
+{
+        TagScheduler *scheduler;
+        TagSchedulerPrivate *priv;
+        int i;
+
+        if (n_readers <= 0)
+                n_readers = MAX (sysconf (_SC_NPROCESSORS_ONLN), 1);
+
+        scheduler = g_object_new (TYPE_TAG_SCHEDULER, NULL);
+        priv = scheduler->priv;
+
+        priv->n_readers = n_readers;
+        priv->readers = g_new0 (Reader, n_readers);
+
+        for (i = 0; i < n_readers; i++) {
+                Reader *reader = &priv->readers[i];
+
+                reader->scheduler  = scheduler;
+                reader->tag_reader = owl_tag_reader_new ();
+
+                g_signal_connect (reader->tag_reader,
+                                  "uri-scanned",
+                                  G_CALLBACK (reader_uri_scanned_cb),
+                                  reader);
+        }
+
+        return scheduler;
+}
+
+/**
+ * tag_scheduler_scan_uri
+ * @scheduler: A #TagScheduler
+ * @uri: An URI
+ *
+ * Queues @uri for scanning, unless it is queued already. 'uri-scanned'
+ * is emitted when done.
+ **/
+void
+tag_scheduler_scan_uri (TagScheduler *scheduler,
+                        const char   *uri)
+{
+        TagSchedulerPrivate *priv;
+        int i;
+
+        g_return_if_fail (IS_TAG_SCHEDULER (scheduler));
+        g_return_if_fail (uri != NULL);
+
+        priv = scheduler->priv;
+
+        if (g_hash_table_lookup (priv->pending_index, uri))
+                return;
+
+        g_queue_push_tail (priv->pending, g_strdup (uri));
+        g_hash_table_insert (priv->pending_index,
+                             priv->pending->tail->data,
+                             priv->pending->tail);
+
+        for (i = 0; i < priv->n_readers; i++) {
+                if (!priv->readers[i].uri) {
+                        dispatch (scheduler, &priv->readers[i]);
+
+                        break;
+                }
+        }
+}
+
+/**
+ * tag_scheduler_prioritize
+ * @scheduler: A #TagScheduler
+ * @uris: An array of URIs
+ * @n_uris: The number of URIs in @uris
+ *
+ * Moves those of @uris that are still waiting for a reader to the front
+ * of the queue, in the order given. URIs that are not queued are
+ * ignored.
+ **/
+void
+tag_scheduler_prioritize (TagScheduler *scheduler,
+                          const char  **uris,
+                          int           n_uris)
+{
+        TagSchedulerPrivate *priv;
+        int i;
+
+        g_return_if_fail (IS_TAG_SCHEDULER (scheduler));
+        g_return_if_fail (uris != NULL || n_uris == 0);
+
+        priv = scheduler->priv;
+
+        for (i = n_uris - 1; i >= 0; i--) {
+                GList *link;
+
+                link = g_hash_table_lookup (priv->pending_index, uris[i]);
+                if (!link)
+                        continue;
+
+                g_queue_unlink (priv->pending, link);
+                g_queue_push_head_link (priv->pending, link);
+        }
+}
+
+/**
+ * tag_scheduler_get_n_readers
+ * @scheduler: A #TagScheduler
+ *
+ * Return value: The number of URIs @scheduler scans concurrently.
+ **/
+int
+tag_scheduler_get_n_readers (TagScheduler *scheduler)
+{
+        g_return_val_if_fail (IS_TAG_SCHEDULER (scheduler), 0);
+
+        return scheduler->priv->n_readers;
+}
+
+/**
+ * tag_scheduler_get_n_pending
+ * @scheduler: A #TagScheduler
+ *
+ * Return value: The number of URIs waiting for a reader.
+ **/
+guint
+tag_scheduler_get_n_pending (TagScheduler *scheduler)
+{
+        g_return_val_if_fail (IS_TAG_SCHEDULER (scheduler), 0);
+
+        return scheduler->priv->pending->length;
+}
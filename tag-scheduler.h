@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2006 OpenedHand Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TAG_SCHEDULER_H__
+#define __TAG_SCHEDULER_H__
+
+#include <glib-object.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_TAG_SCHEDULER \
+                (tag_scheduler_get_type ())
+#define TAG_SCHEDULER(obj) \
+                (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                 TYPE_TAG_SCHEDULER, \
+                 TagScheduler))
+#define TAG_SCHEDULER_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_CAST ((klass), \
+                 TYPE_TAG_SCHEDULER, \
+                 TagSchedulerClass))
+#define IS_TAG_SCHEDULER(obj) \
+                (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                 TYPE_TAG_SCHEDULER))
+#define IS_TAG_SCHEDULER_CLASS(klass) \
+                (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                 TYPE_TAG_SCHEDULER))
+#define TAG_SCHEDULER_GET_CLASS(obj) \
+                (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+                 TYPE_TAG_SCHEDULER, \
+                 TagSchedulerClass))
+
+typedef struct _TagSchedulerPrivate TagSchedulerPrivate;
+
+typedef struct {
+        GObject parent;
+
+        TagSchedulerPrivate *priv;
+} TagScheduler;
+
+typedef struct {
+        GObjectClass parent_class;
+
+        /* Signals */
+        void (* uri_scanned) (TagScheduler *scheduler,
+                              const char   *uri,
+                              GError       *error,
+                              GstTagList   *tag_list);
+
+        /* Future padding */
+        void (* _reserved1) (void);
+        void (* _reserved2) (void);
+        void (* _reserved3) (void);
+        void (* _reserved4) (void);
+} TagSchedulerClass;
+
+GType
+tag_scheduler_get_type        (void) G_GNUC_CONST;
+
+TagScheduler *
+tag_scheduler_new             (int           n_readers);
+
+void
+tag_scheduler_scan_uri        (TagScheduler *scheduler,
+                               const char   *uri);
+
+void
+tag_scheduler_prioritize      (TagScheduler *scheduler,
+                               const char  **uris,
+                               int           n_uris);
+
+int
+tag_scheduler_get_n_readers   (TagScheduler *scheduler);
+
+guint
+tag_scheduler_get_n_pending   (TagScheduler *scheduler);
+
+G_END_DECLS
+
+#endif /* __TAG_SCHEDULER_H__ */